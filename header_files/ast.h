@@ -54,7 +54,9 @@ struct ast
                             ast_data,
                             ast_string,
                             ast_entry,
-                            ast_extern
+                            ast_extern,
+                            ast_org,
+                            ast_incbin
                      } directive_type;
 
                      /** Operands associated with the directive, varies by directive_type */
@@ -68,6 +70,14 @@ struct ast
 
                             char *string;  /**< String content for .string directive */
                             char *label;   /**< Label name for .entry or .extern directives */
+                            int address;   /**< Location counter value for .org directive */
+
+                            struct
+                            {
+                                   char *path;    /**< File name, without the quotation marks */
+                                   long offset;   /**< Offset of the first word in bytes */
+                                   long length;   /**< Number of words, or INCBIN_TO_END */
+                            } incbin;      /**< Binary file for .incbin directive */
 
                      } directive_options;
 
@@ -80,6 +90,8 @@ struct ast
               {
                      int number_of_operands; /**< Number of operands used in the instruction */
 
+                     int instruction_index;  /**< Index of the mnemonic in instruction_table */
+
                      /** Operation code enum representing instruction mnemonic */
                      enum 
                      {
@@ -0,0 +1,54 @@
+#ifndef DATA_POOL_H
+#define DATA_POOL_H
+
+#include "../header_files/translation_unit.h"
+
+/**
+ * @file data_pool.h
+ * @brief Optional sharing of identical data blocks (--pool-data).
+ *
+ * Runs at the end of the first pass, before data addresses are moved after the
+ * code and before the address space is checked. The data image is cut into
+ * blocks at every data label: a block is the words from a label up to the next
+ * labeled word (or the end of the data), so the words a program reaches through
+ * a label, at label + n, stay together. A labeled block with the same words as
+ * an earlier one is dropped, and its labels are given the address of the earlier
+ * copy, so the labels share storage from then on. Data before the first label
+ * has no name to share and is always kept.
+ *
+ * A block whose label is the destination of an instruction that stores to it
+ * (mov, add, sub, lea, clr, not, inc, dec, red) is a variable: sharing it would
+ * let a write through one label show through another, so it is never dropped
+ * and never shared by a later block.
+ *
+ * The kept blocks are packed down in their original order, so a file without
+ * duplicates keeps its exact layout.
+ */
+
+/**
+ * @struct data_block
+ * @brief Words of the data image between two data labels.
+ */
+struct data_block {
+       int start;           /* Data address given by the first pass */
+       int length;          /* Number of words */
+       int new_start;       /* Address after pooling: its own, or that of the copy it shares */
+       int shared;          /* TRUE if it was dropped for an earlier identical block */
+       int written;         /* TRUE if an instruction stores to one of its labels; never shared */
+       unsigned long hash;  /* Hash of the words, to find identical blocks */
+};
+
+/**
+ * @brief Drops duplicate data blocks and aliases their labels to the kept copies.
+ *
+ * Must be called before finish_first_pass() adds ICF to the data symbols. Updates
+ * the data image, the data symbols, prog->pooled_words and prog->pooled_blocks.
+ * With --listing, also sets prog->data_map if any block was dropped.
+ *
+ * @param prog The translation unit, with every chunk of the first pass merged.
+ * @param dc In: data words placed by the first pass. Out: data words left.
+ * @return 1 if memory ran out (reported), 0 if successful.
+ */
+int pool_data(struct translation_unit *prog, int *dc);
+
+#endif /* DATA_POOL_H */
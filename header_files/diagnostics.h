@@ -0,0 +1,174 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <stdio.h>
+
+/**
+ * @file diagnostics.h
+ * @brief Collects the diagnostics of all assembler phases into one sink.
+ *
+ * Phases report structured records (phase, code, line and an optional argument).
+ * Messages are only formatted when the sink is flushed, once per input file,
+ * either as "file:line: error: message" text or as one JSON object per line.
+ */
+
+#define NO_LINE 0
+
+/**
+ * @enum diag_phase
+ * @brief The assembler stage that produced a diagnostic.
+ */
+enum diag_phase {
+       PHASE_PREPROCESSOR,
+       PHASE_FIRST_PASS,
+       PHASE_SECOND_PASS,
+       PHASE_OUTPUT,
+       NUMBER_OF_PHASES
+};
+
+/**
+ * @enum diag_code
+ * @brief Identifies the message template of a diagnostic.
+ */
+enum diag_code {
+       DIAG_SYNTAX,                     /* Errors collected by line_ast() */
+       DIAG_SYMBOL_REDEFINITION,
+       DIAG_LABEL_TYPE_REDEFINITION,
+       DIAG_ENTRY_NEVER_DEFINED,
+       DIAG_UNDEFINED_LABEL,
+       DIAG_RELATIVE_EXTERN,
+       DIAG_ORG_OVERLAP,
+       DIAG_INCBIN,
+       DIAG_ADDRESS_OVERFLOW,
+       DIAG_NO_MEMORY,
+       DIAG_OPEN_FAILED,
+       DIAG_MACRO_MISSING_NAME,
+       DIAG_MACRO_EXTRA_CHARACTERS,
+       DIAG_MACRO_RESERVED_NAME,
+       DIAG_MACRO_INVALID_NAME,
+       DIAG_MACROEND_EXTRA_CHARACTERS,
+       DIAG_MACRO_RECURSION,
+       DIAG_MACRO_LIBRARY,
+       DIAG_MACRO_LIBRARY_LINE,
+       DIAG_MEMORY_BUDGET,
+       DIAG_SPILL_FAILED,
+       DIAG_INCLUDE,
+       DIAG_REBASE,
+       NUMBER_OF_DIAG_CODES
+};
+
+/**
+ * @struct diagnostic
+ * @brief One reported problem, kept unformatted until the sink is flushed.
+ */
+struct diagnostic {
+       enum diag_phase phase;   /* Phase that reported it */
+       enum diag_code code;     /* Message template */
+       int line;                /* Source line, NO_LINE if not tied to a line */
+       char *argument;          /* Copy of the template argument, may be NULL */
+       char *file;              /* Copy of the included file the line is in, NULL for the phase's own file */
+};
+
+/**
+ * @struct diagnostics_sink
+ * @brief Buffered diagnostics of the file currently being assembled.
+ */
+struct diagnostics_sink {
+       const char *base_name;          /* Base name of the current input file */
+       enum diag_phase phase;          /* Phase new records are attributed to */
+       const char *file;               /* Included file new records are attributed to, or NULL */
+       struct diagnostic *records;     /* Collected records in report order */
+       int count;                      /* Number of records */
+       int capacity;                   /* Allocated size of records */
+       int dropped;                    /* Records discarded after max_errors was reached */
+       int flushed;                    /* Records of the file written by earlier flushes, dropped ones included */
+       int max_errors;                 /* Limit per file, 0 for no limit */
+       int json;                       /* TRUE to emit JSON lines instead of text */
+       FILE *stream;                   /* Destination of flushed diagnostics */
+};
+
+extern struct diagnostics_sink diagnostics;
+
+/**
+ * @brief Sets the error limit and output format used for all following files.
+ *
+ * @param max_errors Maximum number of diagnostics kept per file, 0 for no limit.
+ * @param json TRUE to emit JSON lines.
+ */
+void diag_configure(int max_errors, int json);
+
+/**
+ * @brief Starts collecting diagnostics for a new input file.
+ *
+ * @param base_name Base name of the file (without extension).
+ */
+void diag_begin_file(const char *base_name);
+
+/**
+ * @brief Attributes the following diagnostics to a phase.
+ *
+ * @param phase The phase that is about to run.
+ */
+void diag_set_phase(enum diag_phase phase);
+
+/**
+ * @brief Attributes the following diagnostics to a file included by the .as file.
+ *
+ * The name must stay valid until the attribution is changed back.
+ *
+ * @param file Name of the included file, or NULL for the file of the phase.
+ */
+void diag_set_file(const char *file);
+
+/**
+ * @brief Records a diagnostic for the current file and phase.
+ *
+ * @param code Message template.
+ * @param line Source line number, or NO_LINE.
+ * @param argument Text substituted into the template (copied), may be NULL.
+ */
+void diag_report(enum diag_code code, int line, const char *argument);
+
+/**
+ * @brief Tells whether the per-file error limit has been reached.
+ *
+ * @return 1 if phases should stop early, 0 otherwise.
+ */
+int diag_limit_reached(void);
+
+/**
+ * @struct diag_position
+ * @brief A point in the records of the current file, see diag_tell().
+ */
+struct diag_position {
+       int count;     /* Records kept at that point */
+       int dropped;   /* Records dropped at that point */
+};
+
+/**
+ * @brief Marks the current end of the records, so a stage can take its reports back.
+ *
+ * @return The position to pass to diag_rewind().
+ */
+struct diag_position diag_tell(void);
+
+/**
+ * @brief Discards every record reported after a position of the current file.
+ *
+ * Used by a stage that gives up and redoes its work another way, which reports
+ * the same problems again.
+ *
+ * @param position A position returned by diag_tell() for the current file.
+ */
+void diag_rewind(struct diag_position position);
+
+/**
+ * @brief Formats and writes all collected records, then clears the sink.
+ *
+ * It may be called more than once per file, to write the records before some other output.
+ *
+ * @return The number of diagnostics reported for the file so far (including dropped ones).
+ */
+int diag_flush(void);
+
+#endif /* DIAGNOSTICS_H */
@@ -0,0 +1,67 @@
+#ifndef ENCODING_H
+#define ENCODING_H
+
+#include "../header_files/ast.h"
+#include "../header_files/text_parser.h"
+
+/**
+ * @file encoding.h
+ * @brief Compile-time table of first-word templates for every instruction and operand combination.
+ *
+ * encoding_table[instruction][source mode][destination mode] holds the first word with the
+ * opcode, funct, addressing-mode fields and A bit already OR-ed together, the number of
+ * extra words the combination needs and whether the instruction accepts it. Encoding an
+ * instruction is one lookup plus OR-ing in the register numbers.
+ */
+
+#define NO_OPERAND NUMBER_OF_MODES              /* Mode slot of a missing operand */
+#define NUMBER_OF_MODE_SLOTS (NUMBER_OF_MODES + 1)
+
+#define LEGAL_SOURCE 1                          /* The instruction accepts the source slot's mode */
+#define LEGAL_DEST 2                            /* The instruction accepts the destination slot's mode */
+#define LEGAL_COMBINATION (LEGAL_SOURCE | LEGAL_DEST)
+
+/**
+ * @struct encoding_template
+ * @brief Precomputed encoding of one (mnemonic, source mode, destination mode) combination.
+ */
+struct encoding_template {
+       int first_word;    /* Opcode, funct, addressing modes and A bit */
+       int extra_words;   /* Words that follow the first word */
+       int legal;         /* LEGAL_SOURCE and LEGAL_DEST bits, LEGAL_COMBINATION if the instruction accepts both */
+};
+
+extern const struct encoding_template encoding_table[NUMBER_OF_INSTRACTIONS][NUMBER_OF_MODE_SLOTS][NUMBER_OF_MODE_SLOTS];
+
+/**
+ * @brief Returns the template of a parsed instruction line.
+ *
+ * One-operand instructions use NO_OPERAND as source mode and their operand as destination.
+ *
+ * @param ast A line whose ast_type is instruction.
+ * @return Pointer into encoding_table.
+ */
+const struct encoding_template *instruction_template(const struct ast *ast);
+
+/**
+ * @brief Checks one operand mode of an instruction against the legal bits of encoding_table.
+ *
+ * The source and destination slots are accepted independently, so the parser checks
+ * each operand as soon as it is read, before the other one is known.
+ *
+ * @param instruction_index Index of the mnemonic in instruction_table.
+ * @param destination 1 for the destination (the only operand of one-operand instructions), 0 for the source.
+ * @param mode Addressing mode of the operand.
+ * @return 1 if the instruction accepts the mode in that slot, 0 otherwise.
+ */
+int operand_legal(int instruction_index, int destination, int mode);
+
+/**
+ * @brief Encodes the first word of a parsed instruction line: its template plus the register numbers.
+ *
+ * @param ast A line whose ast_type is instruction.
+ * @return The first word.
+ */
+int instruction_first_word(const struct ast *ast);
+
+#endif /* ENCODING_H */
@@ -3,8 +3,87 @@
 
 #include <stdio.h>
 #include "../header_files/translation_unit.h"
+#include "../header_files/source_text.h"
+#include "../header_files/text_parser.h"
+#include "../header_files/ast.h"
+#include "../header_files/incbin.h"
 
-void remove_newline(char * str); 
+/* Chunks smaller than this are not worth a thread of their own */
+#define MIN_CHUNK_SIZE (1 << 16)
+
+/**
+ * @enum first_pass_event_type
+ * @brief Lines whose effect depends on the symbols and addresses of earlier chunks.
+ */
+enum first_pass_event_type {
+       EVENT_SYNTAX_ERROR,   /* message holds the parser's error text */
+       EVENT_EXTERN,         /* name was declared .extern */
+       EVENT_ENTRY,          /* name was declared .entry */
+       EVENT_CODE_LABEL,     /* name labels an instruction */
+       EVENT_DATA_LABEL,     /* name labels a .data, .string or .incbin directive */
+       EVENT_ORG,            /* value is the address given to .org */
+       EVENT_INCBIN          /* blob holds the mapped words, or message why they could not be loaded */
+};
+
+/**
+ * @struct first_pass_event
+ * @brief One such line, with chunk-local counters that are made absolute when merging.
+ */
+struct first_pass_event {
+       enum first_pass_event_type type;
+       int line;                        /* Line number inside the chunk, from 0 */
+       int code_offset;                 /* Instruction words of the chunk before this line */
+       int data_offset;                 /* Data words of the chunk before this line, .incbin words included */
+       int value;                       /* .org address */
+       char name[MAX_LABEL_LEN + 1];    /* Symbol name */
+       char *message;                   /* Syntax error text, owned by the event */
+       struct incbin blob;              /* .incbin words, unmapped with the event */
+};
+
+/**
+ * @struct symbol_reference
+ * @brief An operand that names a label, kept by --check instead of encoding the line,
+ * and by --pool-data if the instruction stores to it.
+ */
+struct symbol_reference {
+       int line;                        /* Line number (inside the chunk, from 0, until merged) */
+       int relative;                    /* TRUE for a relative (&label) operand */
+       int written;                     /* TRUE for the destination of mov, add, sub, lea, clr, not, inc, dec or red */
+       char label[MAX_LINE_LEN + 1];    /* The label as written */
+};
+
+/**
+ * @struct first_pass_chunk
+ * @brief Result of parsing one chunk of lines, independently of all other chunks.
+ */
+struct first_pass_chunk {
+       const struct source_text *source;   /* Text the chunk belongs to */
+       size_t begin;                       /* Offset of the first line */
+       size_t end;                         /* Offset following the last line */
+       int line_count;                     /* Number of lines */
+       int code_words;                     /* Instruction words, ignoring .org */
+       struct first_pass_event *events;    /* Events in line order */
+       int event_count;                    /* Number of events */
+       int event_capacity;                 /* Allocated size of events */
+       int *data;                          /* .data and .string words in order */
+       int data_count;                     /* Number of data words */
+       int data_capacity;                  /* Allocated size of data */
+       int blob_words;                     /* Data words loaded by .incbin, kept in the events */
+       struct symbol_reference *references;   /* Label operands in line order, with --check; written ones with --pool-data */
+       int reference_count;                /* Number of label operands */
+       int reference_capacity;             /* Allocated size of references */
+       int failed;                         /* TRUE if memory ran out */
+};
+
+/**
+ * @struct first_pass_merge
+ * @brief Counters carried from one merged chunk to the next.
+ */
+struct first_pass_merge {
+       int ic;     /* Instruction address following the merged lines */
+       int dc;     /* Data words of the merged lines */
+       int line;   /* Number of the next line */
+};
 
 /**
  * Searches for a symbol by name in the symbol table.
@@ -32,13 +111,72 @@ struct ext *extSearch(struct ext *externals, const int externals_size, const cha
  * resolve .extern/.entry directives, and validate instructions.
  * Also calculates final instruction and data counters.
  *
+ * With --jobs N the text is split into up to N chunks that are parsed on separate
+ * threads. Each chunk only records its local counters, data words and the lines that
+ * define or declare symbols; the chunks are then merged in order, which assigns the
+ * final addresses (a prefix sum of the chunk sizes) and reports the same diagnostics,
+ * in the same order, as a serial pass. The chunk ranges and their starting addresses
+ * are kept in prog->chunks for the second pass.
+ *
  * @param prog Pointer to the main translation_unit structure containing program state.
  * @param amFileName Name of the input file (used for error reporting).
- * @param amFile File pointer to the opened .am source file.
+ * @param source Contents of the .am source file.
  * @return 1 if any errors occurred during the pass, 0 if successful.
  */
-int firstPass(struct translation_unit *prog, const char *amFileName, FILE *amFile);
+int firstPass(struct translation_unit *prog, const char *amFileName, const struct source_text *source);
+
+
+/**
+ * Records the effect of one parsed line on a chunk: its event (if any), its data
+ * words and its instruction size. Does not touch shared state, so it can run on any
+ * thread that owns the chunk. Takes ownership of line_struct->error.
+ *
+ * @param chunk The chunk the line belongs to; the line becomes its next line.
+ * @param line_struct The parsed line.
+ */
+void first_pass_record_line(struct first_pass_chunk *chunk, struct ast *line_struct);
+
+/**
+ * Merges parsed chunks, in order, into the translation unit: assigns the final
+ * addresses, fills the symbol table and data image, reports diagnostics and records
+ * the chunk ranges in prog->chunks. Frees the chunks and the chunks array.
+ *
+ * @param prog Pointer to the translation unit.
+ * @param chunks Chunks in line order (allocated with malloc).
+ * @param chunk_count Number of chunks.
+ * @return 1 if any errors occurred, 0 if successful.
+ */
+int merge_first_pass_chunks(struct translation_unit *prog, struct first_pass_chunk *chunks, int chunk_count);
+
+/**
+ * Starts merging at the first line, address and data word.
+ *
+ * @param merge The counters to reset.
+ */
+void first_pass_merge_start(struct first_pass_merge *merge);
 
+/**
+ * Applies the events of one chunk to the symbol table and advances the counters
+ * past its lines. Leaves the chunk's data words to the caller, which places them
+ * from data word merge->dc (the value before the call).
+ *
+ * @param prog Pointer to the translation unit.
+ * @param chunk The next chunk in line order; it is not freed.
+ * @param merge Counters after the previous chunk.
+ * @return 1 if any errors occurred, 0 if successful.
+ */
+int merge_first_pass_chunk(struct translation_unit *prog, const struct first_pass_chunk *chunk, struct first_pass_merge *merge);
+
+/**
+ * Ends the first pass once every chunk is merged: records IC, DC and ICF, checks
+ * the address space and the .entry declarations, moves the data symbols after the
+ * code and collects the entries.
+ *
+ * @param prog Pointer to the translation unit.
+ * @param merge Counters after the last chunk.
+ * @return 1 if any errors occurred, 0 if successful.
+ */
+int finish_first_pass(struct translation_unit *prog, const struct first_pass_merge *merge);
 
 /**
  * @brief Removes the trailing newline character from a string, if present.
@@ -0,0 +1,67 @@
+#ifndef INCBIN_H
+#define INCBIN_H
+
+#include <stddef.h>
+
+/**
+ * @file incbin.h
+ * @brief Binary files loaded into the data image by the .incbin directive.
+ *
+ * A file holds data words back to back, MEMORY_WORD_BYTES little-endian bytes
+ * each: the layout of the pages of the memory image. The file is mapped with
+ * mmap() and its words are copied into the data image page by page, without
+ * being parsed or converted.
+ *
+ * The directive is `.incbin "file" [, offset [, length]]`. The offset is in bytes
+ * and the length in words; without a length every word from the offset to the
+ * end of the file is loaded, and the remaining bytes must then be whole words.
+ */
+
+#define INCBIN_TO_END (-1)   /* Length of an .incbin without one: up to the end of the file */
+
+/**
+ * @struct incbin
+ * @brief Words of an .incbin file, mapped into memory.
+ */
+struct incbin {
+       void *map;                   /* Start of the mapping, NULL if nothing is mapped */
+       size_t map_length;           /* Length of the mapping */
+       const unsigned char *bytes;  /* First word to load, inside the mapping */
+       int words;                   /* Number of words to load */
+};
+
+/**
+ * @brief Finds how many words an .incbin loads, without mapping the file.
+ *
+ * @param path Name of the file.
+ * @param offset Offset of the first word, in bytes.
+ * @param length Number of words, or INCBIN_TO_END.
+ * @param words Output: number of words.
+ * @param error Output: why the range is not valid, if it is not.
+ * @return 1 if the range is valid, 0 otherwise.
+ */
+int incbin_measure(const char *path, long offset, long length, int *words, const char **error);
+
+/**
+ * @brief Maps the words of an .incbin.
+ *
+ * Safe to call from worker threads: nothing is reported, the reason of a failure
+ * is returned instead. An empty range leaves nothing mapped.
+ *
+ * @param blob Receives the mapping; a zero-initialized struct on failure.
+ * @param path Name of the file.
+ * @param offset Offset of the first word, in bytes.
+ * @param length Number of words, or INCBIN_TO_END.
+ * @param error Output: why the file could not be loaded, if it could not.
+ * @return 1 if successful, 0 otherwise.
+ */
+int incbin_open(struct incbin *blob, const char *path, long offset, long length, const char **error);
+
+/**
+ * @brief Unmaps an .incbin and resets it to empty.
+ *
+ * @param blob The blob to close; an empty blob is left as is.
+ */
+void incbin_close(struct incbin *blob);
+
+#endif /* INCBIN_H */
@@ -0,0 +1,129 @@
+#ifndef INCLUDES_H
+#define INCLUDES_H
+
+#include <stdio.h>
+
+/**
+ * @file includes.h
+ * @brief Source files pulled in by the .include directive, and the -MD dependency file.
+ *
+ * The directive is `.include "file"`, alone on its line. The preprocessor reads
+ * the named file in place of the line, as if its text were written there, so
+ * macros defined in it can be called after the directive. A relative name is
+ * looked up in the directory of the file holding the directive.
+ *
+ * Every file is read at most once per translation unit: a second .include of
+ * the same file (the same device and inode, whatever the name) is skipped, so
+ * shared definitions need no include guards and a cycle of includes ends by
+ * itself. The .as file counts as already included.
+ */
+
+#define MAX_INCLUDE_DEPTH 16   /* Files open at once, the .as file included */
+
+/**
+ * @struct included_file
+ * @brief A file read by the preprocessor for the current translation unit.
+ */
+struct included_file {
+       char *path;              /* Name it was opened by */
+       unsigned long device;    /* Identity of the file, for the once-only rule */
+       unsigned long inode;
+};
+
+/**
+ * @struct include_frame
+ * @brief A file whose reading is suspended while a file it includes is read.
+ */
+struct include_frame {
+       FILE *file;    /* Positioned after the .include line */
+       int line;      /* Number of that line */
+       int current;   /* Index of the file in include_state.files */
+};
+
+/**
+ * @struct include_state
+ * @brief The files of a translation unit and the stack of open ones.
+ */
+struct include_state {
+       struct included_file *files;    /* Every file read, in order; files[0] is the .as file */
+       int file_count;                 /* Number of files */
+       int file_capacity;              /* Allocated size of files */
+       struct include_frame *frames;   /* Suspended files, innermost last */
+       int depth;                      /* Number of frames */
+       int frame_capacity;             /* Allocated size of frames */
+       int current;                    /* Index of the file being read */
+};
+
+/**
+ * @brief Told the files a translation unit read, once its preprocessing ends.
+ */
+typedef void (*include_observer)(const struct include_state *state);
+
+/**
+ * @brief Checks if a line is an .include directive.
+ *
+ * @param trimmed_line The line, without leading whitespace.
+ * @return 1 if the line starts with the directive name, 0 otherwise.
+ */
+int is_include_directive(const char *trimmed_line);
+
+/**
+ * @brief Records the .as file as the first file of a translation unit.
+ *
+ * @param state A zero-initialized state.
+ * @param as_file_name Name of the .as file.
+ * @return 1 if successful, 0 on memory allocation failure (reported).
+ */
+int includes_begin(struct include_state *state, const char *as_file_name);
+
+/**
+ * @brief Handles an .include line: opens the named file and suspends the current one.
+ *
+ * Problems with the directive or the file are reported as include diagnostics.
+ * Once a file is opened, the following diagnostics are attributed to it.
+ *
+ * @param state The include state.
+ * @param trimmed_line The directive, without leading whitespace.
+ * @param input In: the file being read. Out: the included file, if one was opened.
+ * @param line_counter In: the line of the directive. Out: 0, if a file was opened.
+ * @return 1 if the line is valid (whether its file was opened or already read), 0 on error.
+ */
+int include_open(struct include_state *state, char *trimmed_line, FILE **input, int *line_counter);
+
+/**
+ * @brief Goes back to the file that included the one just read to its end.
+ *
+ * @param state The include state.
+ * @param input In: the exhausted file, closed here. Out: the including file.
+ * @param line_counter Out: the line of the .include directive.
+ * @return 1 if reading resumes in an including file, 0 if input is the .as file.
+ */
+int include_close(struct include_state *state, FILE **input, int *line_counter);
+
+/**
+ * @brief Writes <name>.d, a make rule making the outputs depend on every file read.
+ *
+ * @param base_name Base name of the file (without extension).
+ * @param state The include state, after preprocessing.
+ * @return 1 if successful, 0 if the file could not be written (reported).
+ */
+int write_dependency_file(const char *base_name, const struct include_state *state);
+
+/**
+ * @brief Sets the function told the files of every translation unit (--watch uses it).
+ *
+ * @param observer The function, or NULL for none.
+ */
+void includes_set_observer(include_observer observer);
+
+/**
+ * @brief Tells the observer, if one is set, every file a translation unit read.
+ *
+ * Called once per translation unit when preprocessing ends, also after an error,
+ * on the thread that preprocessed it.
+ *
+ * @param state The include state, after preprocessing.
+ */
+void includes_end(const struct include_state *state);
+
+#endif /* INCLUDES_H */
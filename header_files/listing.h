@@ -0,0 +1,155 @@
+#ifndef LISTING_H
+#define LISTING_H
+
+#include "../header_files/preprocessor.h"
+
+/**
+ * @file listing.h
+ * @brief The .lst listing and the binary address index (--listing).
+ *
+ * The preprocessor records where every .am line came from (its .as line, or the
+ * line of an included file, and the macro call that produced it, if any). The second pass appends one entry per
+ * instruction or data directive while encoding. Entries are appended in address
+ * order, so the index is sorted without an extra step.
+ *
+ * <name>.lst lists each entry as address, encoded words and source text.
+ *
+ * <name>.idx is the same map in binary form. All numbers are little-endian:
+ *   header   "AIDX", version (u32), record count (u32), file count (u32), macro count (u32)
+ *   records  address (u32), source line (u32), .am line (u32), file (u16), macro (u16)
+ *   strings  file names, then macro names, each null-terminated
+ * The records are 16 bytes each and sorted by address, so a reader can binary
+ * search them in place. A macro of INDEX_NO_MACRO means the line was not expanded
+ * from a macro. File 0 is the .as file and the others are the files it included
+ * (.include), in order of first use; the line is a line of that file.
+ */
+
+#define NO_MACRO (-1)
+#define INDEX_NO_MACRO 0xFFFF
+#define INDEX_VERSION 1
+
+struct translation_unit;
+struct source_text;
+
+/**
+ * @struct line_origin
+ * @brief Where one .am line came from.
+ */
+struct line_origin {
+       int line;    /* Line of the source file (of the macro call, for expanded lines) */
+       int macro;   /* Index into line_map.macros, or NO_MACRO */
+       int file;    /* 0 for the .as file, else 1 + index into line_map.files */
+};
+
+/**
+ * @struct line_map
+ * @brief Origins of all .am lines, indexed by .am line number - 1.
+ */
+struct line_map {
+       struct line_origin *lines;                 /* One origin per .am line */
+       int count;                                 /* Number of lines */
+       int capacity;                              /* Allocated size of lines */
+       char (*macros)[MAX_MACRO_LEN + 1];         /* Names of the macros that were expanded */
+       int macro_count;                           /* Number of names */
+       int macro_capacity;                        /* Allocated size of macros */
+       char **files;                              /* Names of the included files that were read */
+       int file_count;                            /* Number of names */
+       int file_capacity;                         /* Allocated size of files */
+       int file;                                  /* File new lines come from, as in line_origin */
+       int open_line;                             /* TRUE while the last .am line has no newline yet */
+};
+
+/**
+ * @struct listing_entry
+ * @brief An instruction or data directive and the words it occupies.
+ */
+struct listing_entry {
+       int address;   /* Address of the first word */
+       int words;     /* Number of words */
+       int line;      /* .am line number */
+};
+
+/**
+ * @struct listing
+ * @brief Entries of the code and data sections, each in address order.
+ */
+struct listing {
+       struct listing_entry *code;
+       int code_count;
+       int code_capacity;
+       struct listing_entry *data;   /* Addresses are absolute (after the code) */
+       int data_count;
+       int data_capacity;
+};
+
+/**
+ * @brief Records the origin of the .am text the preprocessor just wrote.
+ *
+ * A new origin is added for every .am line the text starts.
+ *
+ * @param map The line map.
+ * @param text Text written to the .am file.
+ * @param length Number of characters.
+ * @param line The line the text comes from, in the file set in map->file.
+ * @param macro Index of the expanded macro in map->macros, or NO_MACRO.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int line_map_record(struct line_map *map, const char *text, size_t length, int line, int macro);
+
+/**
+ * @brief Returns the index of a macro name in the map, adding it on first use.
+ *
+ * @param map The line map.
+ * @param name Name of the macro.
+ * @return The index, or NO_MACRO on memory allocation failure.
+ */
+int line_map_macro(struct line_map *map, const char *name);
+
+/**
+ * @brief Returns the file number of an included file in the map, adding it on first use.
+ *
+ * @param map The line map.
+ * @param path Name of the included file.
+ * @return The number for line_origin.file, or 0 on memory allocation failure.
+ */
+int line_map_file(struct line_map *map, const char *path);
+
+/**
+ * @brief Appends an entry to a listing section.
+ *
+ * @param entries Pointer to the section's array.
+ * @param count Pointer to the number of entries.
+ * @param capacity Pointer to the allocated size.
+ * @param address Address of the first word.
+ * @param words Number of words.
+ * @param line .am line number.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int listing_append(struct listing_entry **entries, int *count, int *capacity, int address, int words, int line);
+
+/**
+ * @brief Writes <name>.lst and <name>.idx.
+ *
+ * @param base_name Base name of the file (without extension).
+ * @param prog The assembled translation unit.
+ * @param source The .am text.
+ * @param map Origins of the .am lines.
+ */
+void print_listing_files(const char *base_name, const struct translation_unit *prog,
+                         const struct source_text *source, const struct line_map *map);
+
+/**
+ * @brief Frees the arrays of a line map.
+ *
+ * @param map The line map.
+ */
+void free_line_map(struct line_map *map);
+
+/**
+ * @brief Frees the arrays of a listing.
+ *
+ * @param listing The listing.
+ */
+void free_listing(struct listing *listing);
+
+#endif /* LISTING_H */
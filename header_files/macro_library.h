@@ -0,0 +1,128 @@
+#ifndef MACRO_LIBRARY_H
+#define MACRO_LIBRARY_H
+
+#include <stddef.h>
+
+/**
+ * @file macro_library.h
+ * @brief Precompiled macro libraries (--build-macro-lib, --macro-lib).
+ *
+ * A macro library holds the definitions of a macro-only source, already
+ * validated and with their nested calls expanded. It is built once:
+ *
+ *   assembler --build-macro-lib prelude.mlib prelude
+ *
+ * and then mapped read-only before each .as file is preprocessed:
+ *
+ *   assembler --macro-lib prelude.mlib file1 file2
+ *
+ * The library's macros behave as if their definitions were written at the
+ * top of every file, but they are neither parsed nor checked again: a call is
+ * looked up in the library's hash index and the stored body is copied out as
+ * is. As with repeated definitions in one file, the first definition of a
+ * name wins, so a library macro takes precedence over one the file defines.
+ *
+ * File layout, all numbers in the byte order of the machine that built it:
+ *
+ *   struct macro_library_header
+ *   unsigned int buckets[bucket_count]        entry index + 1, 0 if empty
+ *   struct macro_library_entry entries[macro_count]
+ *   char bodies[body_bytes]                   expanded bodies, back to back
+ *
+ * The index uses open addressing with linear probing over a power-of-two
+ * number of buckets, at most half of them in use.
+ */
+
+#define MACRO_LIBRARY_MAGIC "MLIB"
+#define MACRO_LIBRARY_MAGIC_LEN 4
+#define MACRO_LIBRARY_VERSION 1
+#define MACRO_LIBRARY_BYTE_ORDER 0x01020304U
+#define MACRO_LIBRARY_NAME_LEN 32   /* MAX_MACRO_LEN + 1 */
+
+/**
+ * @struct macro_library_header
+ * @brief Start of a library file.
+ */
+struct macro_library_header {
+       char magic[MACRO_LIBRARY_MAGIC_LEN];   /* MACRO_LIBRARY_MAGIC, not terminated */
+       unsigned int version;                   /* MACRO_LIBRARY_VERSION */
+       unsigned int byte_order;                /* MACRO_LIBRARY_BYTE_ORDER as written by the builder */
+       unsigned int macro_count;               /* Number of entries */
+       unsigned int bucket_count;              /* Number of index buckets, a power of two */
+       unsigned int body_bytes;                /* Size of the bodies block */
+};
+
+/**
+ * @struct macro_library_entry
+ * @brief One macro of a library file.
+ */
+struct macro_library_entry {
+       char name[MACRO_LIBRARY_NAME_LEN];   /* Macro name, terminated */
+       unsigned int hash;                   /* Hash of the name */
+       unsigned int body_offset;            /* Start of the body in the bodies block */
+       unsigned int body_length;            /* Length of the body */
+};
+
+/**
+ * @struct macro_library
+ * @brief A library file mapped into memory.
+ */
+struct macro_library {
+       void *map;                                  /* The whole file, NULL if none is open */
+       size_t map_length;                          /* Size of the mapping */
+       const struct macro_library_header *header;  /* Points into map */
+       const unsigned int *buckets;                /* Hash index */
+       const struct macro_library_entry *entries;  /* Macro entries */
+       const char *bodies;                         /* Expanded bodies */
+};
+
+/**
+ * @brief FNV-1a hash of a macro name, as stored in library entries.
+ *
+ * @param name Name of the macro.
+ * @return The hash.
+ */
+unsigned int macro_name_hash(const char *name);
+
+/**
+ * @brief Compiles the macro definitions of source files into a library file.
+ *
+ * The sources may only hold macro definitions, blank lines and comments.
+ * Diagnostics are reported per source file. The library is written to a
+ * temporary file and renamed over the old one, so assemblers that have the
+ * old library mapped keep reading consistent contents.
+ *
+ * @param library_path Path of the library file to write.
+ * @param files Base names of the sources (without extension).
+ * @param count Number of sources.
+ * @return 1 if a source had errors or the file could not be written, 0 if successful.
+ */
+int macro_library_build(const char *library_path, char const *files[], int count);
+
+/**
+ * @brief Maps a library file and checks its header and index.
+ *
+ * @param library The library to fill.
+ * @param path Path of the library file.
+ * @param error Output pointer to a description of the problem if it fails.
+ * @return 1 if successful, 0 if the file cannot be used.
+ */
+int macro_library_open(struct macro_library *library, const char *path, const char **error);
+
+/**
+ * @brief Looks up a macro by name.
+ *
+ * @param library An open library.
+ * @param name Name of the macro.
+ * @return The entry of the macro, or NULL if the library does not define it.
+ */
+const struct macro_library_entry *macro_library_find(const struct macro_library *library, const char *name);
+
+/**
+ * @brief Unmaps a library; does nothing if none is open.
+ *
+ * @param library The library to close.
+ */
+void macro_library_close(struct macro_library *library);
+
+#endif /* MACRO_LIBRARY_H */
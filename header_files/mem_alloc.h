@@ -3,9 +3,50 @@
 
 #include "../header_files/translation_unit.h"
 #include "../header_files/preprocessor.h"
+#include "../header_files/diagnostics.h"
+#include "../header_files/first_pass.h"
+#include "../header_files/second_pass.h"
+#include "../header_files/listing.h"
+#include "../header_files/peephole.h"
+#include "../header_files/parallel_preprocessor.h"
+#include "../header_files/includes.h"
 
 #define INITIAL_CAPASITY 4
 
+/*
+ * Every allocation of the assembler goes through mem_malloc(), mem_calloc(),
+ * mem_realloc() and mem_free(). They behave like the standard functions; after
+ * alloc_accounting_start() they also count calls, bytes, the bytes realloc had to
+ * copy and the peak of live bytes, per phase (the phase diagnostics are attributed
+ * to) and per file. The counters are updated atomically, so worker threads may
+ * allocate too.
+ */
+
+/**
+ * Turns allocation accounting on. Must be called before the first allocation,
+ * since accounted blocks carry a size header that mem_free() relies on.
+ */
+void alloc_accounting_start(void);
+
+/**
+ * Writes the allocation counters of the file just assembled to stderr and starts
+ * counting the next file. Does nothing unless accounting is on.
+ *
+ * @param base_name Base name of the file (without extension).
+ */
+void alloc_report_file(const char *base_name);
+
+/**
+ * Writes the counters summed over all files to stderr. Does nothing unless
+ * accounting is on.
+ */
+void alloc_report_total(void);
+
+void *mem_malloc(size_t size);
+void *mem_calloc(size_t count, size_t size);
+void *mem_realloc(void *block, size_t size);
+void mem_free(void *block);
+
 /**
  * Ensures the symbol table has enough capacity to store a new symbol.
  *
@@ -30,6 +71,24 @@ int ensure_externals_capacity(struct translation_unit *prog);
  */
 int ensure_entries_capacity(struct translation_unit *prog);
 
+/**
+ * Ensures the label operands of a translation unit have space for more references.
+ *
+ * @param prog Pointer to the translation unit.
+ * @param count Number of references about to be added.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int ensure_references_capacity(struct translation_unit *prog, int count);
+
+/**
+ * Ensures the relocation table of a translation unit has space for more addresses.
+ *
+ * @param prog Pointer to the translation unit.
+ * @param count Number of addresses about to be added.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int ensure_relocations_capacity(struct translation_unit *prog, int count);
+
 /**
  * Builds a filename by appending the extension to the base name.
  * Allocates memory for the result.
@@ -55,6 +114,17 @@ int ensure_macro_table_capacity(struct MacroTable *table);
  */
 int ensure_macro_lines_capacity(struct Macro *macro);
 
+/**
+ * Appends text to the flattened body of a macro, growing it as needed.
+ * Failures are not reported here, since bodies are also built on worker threads.
+ *
+ * @param macro Pointer to the macro.
+ * @param text Text to append (not null-terminated).
+ * @param length Number of characters to append.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int append_to_flat_body(struct Macro *macro, const char *text, size_t length);
+
 /**
  * Frees all memory associated with a macro table.
  *
@@ -62,5 +132,191 @@ int ensure_macro_lines_capacity(struct Macro *macro);
  */
 void free_macro_table(struct MacroTable *table);
 
-#endif /* MEM_ALLOC_H */
+/**
+ * Ensures the diagnostics sink has enough capacity to store a new record.
+ *
+ * @param sink Pointer to the diagnostics sink.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int ensure_diagnostics_capacity(struct diagnostics_sink *sink);
+
+/**
+ * Ensures a memory image has enough capacity to store a new page pointer.
+ *
+ * @param image Pointer to the memory image.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int ensure_memory_pages_capacity(struct memory_image *image);
+
+/**
+ * Ensures the event array of a first pass chunk has space for one more event.
+ * Runs on worker threads, so failures are not reported here; the merge reports them.
+ *
+ * @param chunk Pointer to the chunk.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int ensure_chunk_events_capacity(struct first_pass_chunk *chunk);
 
+/**
+ * Ensures the data array of a first pass chunk has space for more words.
+ * Runs on worker threads, so failures are not reported here; the merge reports them.
+ *
+ * @param chunk Pointer to the chunk.
+ * @param count Number of words about to be added.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int ensure_chunk_data_capacity(struct first_pass_chunk *chunk, int count);
+
+/**
+ * Ensures the label operands of a first pass chunk have space for one more reference.
+ * Runs on worker threads, so failures are not reported here; the merge reports them.
+ *
+ * @param chunk Pointer to the chunk.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int ensure_chunk_references_capacity(struct first_pass_chunk *chunk);
+
+/**
+ * Ensures the address list of an external symbol has space for one more address.
+ *
+ * @param external Pointer to the external symbol.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int ensure_ext_addresses_capacity(struct ext *external);
+
+/**
+ * Ensures the extern use list of a second pass chunk has space for one more use.
+ * Runs on worker threads, so failures are not reported here; the merge reports them.
+ *
+ * @param chunk Pointer to the chunk.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int ensure_chunk_uses_capacity(struct second_pass_chunk *chunk);
+
+/**
+ * Ensures the relocation list of a second pass chunk has space for one more address.
+ * Runs on worker threads, so failures are not reported here; the merge reports them.
+ *
+ * @param chunk Pointer to the chunk.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int ensure_chunk_relocations_capacity(struct second_pass_chunk *chunk);
+
+/**
+ * Ensures the report list of a second pass chunk has space for one more diagnostic.
+ * Runs on worker threads, so failures are not reported here; the merge reports them.
+ *
+ * @param chunk Pointer to the chunk.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int ensure_chunk_reports_capacity(struct second_pass_chunk *chunk);
+
+/**
+ * Ensures the run list of a preprocessor scan has space for one more run.
+ *
+ * @param scan Pointer to the scan.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int ensure_preprocess_runs_capacity(struct preprocess_scan *scan);
+
+/**
+ * Ensures the piece list of a preprocessor chunk has space for one more piece.
+ * Runs on worker threads, so failures are not reported here.
+ *
+ * @param chunk Pointer to the chunk.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int ensure_chunk_pieces_capacity(struct preprocess_chunk *chunk);
+
+/**
+ * Ensures the file list of an include state has space for one more file.
+ *
+ * @param state Pointer to the include state.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int ensure_included_files_capacity(struct include_state *state);
+
+/**
+ * Ensures the stack of an include state has space for one more suspended file.
+ *
+ * @param state Pointer to the include state.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int ensure_include_frames_capacity(struct include_state *state);
+
+/**
+ * Closes the suspended files of an include state and frees its memory.
+ *
+ * @param state Pointer to the include state.
+ */
+void free_include_state(struct include_state *state);
+
+/**
+ * Empties a first pass chunk for its next lines: frees what its events own and
+ * clears its counters, keeping the arrays for reuse.
+ *
+ * @param chunk Pointer to the chunk.
+ */
+void reset_first_pass_chunk(struct first_pass_chunk *chunk);
+
+/**
+ * Frees the events (with their messages) and data words of a first pass chunk.
+ *
+ * @param chunk Pointer to the chunk.
+ */
+void free_first_pass_chunk(struct first_pass_chunk *chunk);
+
+/**
+ * Ensures a source text has space for more characters and a terminator.
+ * Runs on worker threads, so failures are not reported here.
+ *
+ * @param source Pointer to the source text.
+ * @param length Number of characters about to be appended.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int ensure_source_text_capacity(struct source_text *source, size_t length);
+
+/**
+ * Ensures the line map has space for one more .am line.
+ *
+ * @param map Pointer to the line map.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int ensure_line_map_capacity(struct line_map *map);
+
+/**
+ * Ensures the line map has space for one more macro name.
+ *
+ * @param map Pointer to the line map.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int ensure_line_map_macros_capacity(struct line_map *map);
+
+/**
+ * Ensures the line map has space for one more included file name.
+ *
+ * @param map Pointer to the line map.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int ensure_line_map_files_capacity(struct line_map *map);
+
+/**
+ * Ensures a listing section has space for one more entry.
+ * Runs on worker threads, so failures are not reported here.
+ *
+ * @param entries Pointer to the section's array.
+ * @param count Number of entries in the section.
+ * @param capacity Pointer to the allocated size.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int ensure_listing_capacity(struct listing_entry **entries, int count, int *capacity);
+
+/**
+ * Ensures the optimizer's list of lines has space for one more entry.
+ *
+ * @param program Pointer to the optimizer's lines.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int ensure_peephole_capacity(struct peephole_program *program);
+
+#endif /* MEM_ALLOC_H */
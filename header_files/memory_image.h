@@ -0,0 +1,133 @@
+#ifndef MEMORY_IMAGE_H
+#define MEMORY_IMAGE_H
+
+#include <limits.h>
+
+/**
+ * @file memory_image.h
+ * @brief Sparse, page-based storage for the code and data images.
+ *
+ * Words are kept in fixed-size pages that are only allocated when a word inside
+ * them is written. Pages are kept sorted by page number, so the images can be
+ * walked in address order while skipping every gap that was never written
+ * (for example the space left by an .org directive).
+ *
+ * Machine words are 24 bits wide and are packed into 3 bytes each. memory_write()
+ * keeps only the low 24 bits of a value and memory_read() sign-extends them back,
+ * so values like -1 survive a round trip while stray high bits never reach the
+ * output.
+ *
+ * An image is only ever used by one thread at a time; allocation failures are
+ * not reported here but returned to the caller.
+ */
+
+#define MEMORY_PAGE_BITS 8
+#define MEMORY_PAGE_SIZE (1 << MEMORY_PAGE_BITS)
+#define MEMORY_PAGE_MASK (MEMORY_PAGE_SIZE - 1)
+
+#define MEMORY_WORD_BITS 24
+#define MEMORY_WORD_BYTES 3
+#define MEMORY_WORD_MASK ((1L << MEMORY_WORD_BITS) - 1)
+#define MEMORY_WORD_SIGN_BIT (1L << (MEMORY_WORD_BITS - 1))
+
+/**
+ * @struct memory_page
+ * @brief MEMORY_PAGE_SIZE consecutive words and a bitmap of the written ones.
+ */
+struct memory_page {
+       int page_number;                                   /* address >> MEMORY_PAGE_BITS */
+       unsigned char words[MEMORY_PAGE_SIZE * MEMORY_WORD_BYTES];  /* Stored words, MEMORY_WORD_BYTES each, little-endian */
+       unsigned char used[MEMORY_PAGE_SIZE / CHAR_BIT];   /* Bit set for every written word */
+};
+
+/**
+ * @struct memory_image
+ * @brief Sparse word-addressed image. A zero-initialized struct is an empty image.
+ */
+struct memory_image {
+       struct memory_page **pages;   /* Allocated pages, sorted by page_number */
+       int page_count;               /* Number of allocated pages */
+       int page_capacity;            /* Allocated size of the pages array */
+       int word_count;               /* Number of written words */
+       int last_page;                /* Index of the most recently used page */
+};
+
+/**
+ * @struct memory_cursor
+ * @brief Position of an in-order walk over the written words of an image.
+ */
+struct memory_cursor {
+       int page;     /* Index into pages */
+       int offset;   /* Next offset inside the page to examine */
+};
+
+/**
+ * @brief Stores a word, allocating its page on first use.
+ *
+ * @param image The image to write to.
+ * @param address Word address, must be non-negative.
+ * @param word The value to store; only its low MEMORY_WORD_BITS bits are kept.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int memory_write(struct memory_image *image, int address, int word);
+
+/**
+ * @brief Stores consecutive words that are already packed, MEMORY_WORD_BYTES little-endian bytes each.
+ *
+ * The bytes are copied into the pages as they are, one memcpy() per page.
+ *
+ * @param image The image to write to.
+ * @param address Address of the first word, must be non-negative.
+ * @param bytes The packed words.
+ * @param count Number of words.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int memory_write_bytes(struct memory_image *image, int address, const unsigned char *bytes, int count);
+
+/**
+ * @brief Reads a word.
+ *
+ * @param image The image to read from.
+ * @param address Word address.
+ * @return The stored word, sign-extended from MEMORY_WORD_BITS bits, or 0 if the address was never written.
+ */
+int memory_read(struct memory_image *image, int address);
+
+/**
+ * @brief Starts an in-order walk over the written words of an image.
+ *
+ * @param cursor Cursor to initialize.
+ */
+void memory_cursor_start(struct memory_cursor *cursor);
+
+/**
+ * @brief Advances a walk to the next written word.
+ *
+ * @param image The image being walked.
+ * @param cursor Cursor returned by memory_cursor_start().
+ * @param address Output: address of the word.
+ * @param word Output: the stored word, sign-extended from MEMORY_WORD_BITS bits.
+ * @return 1 if a word was returned, 0 at the end of the image.
+ */
+int memory_next(const struct memory_image *image, struct memory_cursor *cursor, int *address, int *word);
+
+/**
+ * @brief Moves the pages of one image to the end of another.
+ *
+ * Every address of tail must be at or above the last page of image, so only the
+ * two boundary pages can overlap; their words are combined. tail is left empty.
+ *
+ * @param image The image to extend.
+ * @param tail The image whose pages are moved.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int memory_append(struct memory_image *image, struct memory_image *tail);
+
+/**
+ * @brief Frees all pages of an image and resets it to empty.
+ *
+ * @param image The image to free.
+ */
+void free_memory_image(struct memory_image *image);
+
+#endif /* MEMORY_IMAGE_H */
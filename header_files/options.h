@@ -0,0 +1,57 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+/**
+ * @file options.h
+ * @brief Command-line options of the assembler.
+ *
+ * Options are written before the input file names, e.g.
+ * "assembler --max-errors 20 --json --jobs 4 file1 file2".
+ */
+
+#define MAX_JOBS 256   /* Most threads --jobs may ask for; each one is a chunk with its own buffers */
+
+/**
+ * @struct assembler_options
+ * @brief Settings that apply to every input file of a run.
+ */
+struct assembler_options {
+       int max_errors;   /* Diagnostics kept per file before stopping early, 0 for no limit */
+       int json;         /* Emit diagnostics as JSON lines */
+       int jobs;         /* Threads a pass may split its work across, 0 or 1 for none */
+       int pipeline;     /* Overlap preprocessing, parsing and the first pass on separate threads */
+       int listing;      /* Also write the .lst listing and the .idx address index */
+       int stream;       /* Write the .ob code words while encoding instead of keeping the code image */
+       int profile;      /* Report hardware performance counters per phase on stderr */
+       int alloc_stats;  /* Report allocation counts and bytes per phase on stderr */
+       int optimize;     /* Remove instructions without effect between the passes */
+       int watch;        /* Keep running and reassemble files whose contents change */
+       int memory_budget;   /* KiB for assembling in bounded memory, 0 for the normal passes */
+       int check;        /* Only report diagnostics: no .am, .ob, .ent or .ext files, no encoding */
+       int dependencies; /* -MD: write a make rule listing the files each .as file includes to <name>.d */
+       int relocations;  /* Also write the .rel relocation table */
+       int pool_data;    /* Store identical labeled data blocks once, aliasing their labels */
+       int rebase;       /* Move the assembled files to rebase_address instead of assembling them */
+       int rebase_address;   /* New address of the first word, with --rebase */
+       const char *macro_library;         /* Precompiled macro library mapped for every file, or NULL */
+       const char *build_macro_library;   /* Compile the input files into this macro library instead, or NULL */
+       const char *trace;                 /* Write a Chrome trace of the files, phases and worker tasks here, or NULL */
+};
+
+extern struct assembler_options options;
+
+/**
+ * @brief Parses the leading options of the command line into the global options.
+ *
+ * @param argc Argument count.
+ * @param argv Argument vector.
+ * @return Index of the first file name, or 0 if an option is invalid.
+ */
+int parse_options(int argc, char const *argv[]);
+
+/**
+ * @brief Prints the usage line listing all options.
+ */
+void print_usage(void);
+
+#endif /* OPTIONS_H */
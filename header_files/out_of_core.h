@@ -0,0 +1,96 @@
+#ifndef OUT_OF_CORE_H
+#define OUT_OF_CORE_H
+
+#include "../header_files/translation_unit.h"
+#include "../header_files/text_parser.h"
+
+/**
+ * @file out_of_core.h
+ * @brief Assembling in bounded memory (--memory-budget KIB).
+ *
+ * The normal passes keep the whole .am text, the code and data images and the
+ * extern references in memory. In this mode only the symbol table stays in
+ * memory, and everything that grows with the size of the program goes to
+ * temporary files:
+ *
+ *   1. One pass reads the .am file line by line. It fills the symbol table
+ *      through the usual first pass merge and encodes every instruction at
+ *      once. An operand that names a label gets a placeholder word and a fixup
+ *      record. Code words, fixups and data words are appended to three spill
+ *      files.
+ *   2. Once every symbol is known, a merge pass reads the code words and the
+ *      fixups side by side (both are in address order), patches the words and
+ *      writes the .ob file, followed by the data words. Every extern reference
+ *      goes to a fourth spill file.
+ *   3. The extern references are sorted by symbol (in order of first use) and
+ *      address with an external merge sort, and written as the .ext file.
+ *
+ * The budget is split between the stdio buffers of the spill files and the
+ * sort, so the memory used apart from the symbol table does not depend on the
+ * size of the input. If the symbol table outgrows its share of the budget the
+ * file fails with a memory-budget error. Output and diagnostics are the same
+ * as those of the normal passes.
+ */
+
+#define KIB 1024L
+#define MIN_MEMORY_BUDGET 16         /* KiB */
+#define SPILL_BUFFER_SHARE 16        /* Each of the four spill files buffers budget / 16 */
+#define SORT_SHARE 4                 /* The .ext sort holds budget / 4 of records */
+#define SYMBOL_SHARE 2               /* The symbol table may use budget / 2 */
+#define MERGE_FAN_IN 8               /* Sorted runs merged at once */
+#define NO_FIXUP_ADDRESS (-1)        /* Fixup of a line with a syntax error: diagnostics only */
+
+/**
+ * @enum fixup_kind
+ * @brief How a fixup's operand word is computed from the symbol.
+ */
+enum fixup_kind {
+       FIXUP_DIRECT,     /* Address of the symbol, R or E */
+       FIXUP_RELATIVE    /* Distance from the instruction to the symbol, A */
+};
+
+/**
+ * @struct fixup
+ * @brief An operand word whose value depends on a symbol, spilled by the first pass.
+ */
+struct fixup {
+       int address;                      /* Address of the operand word, NO_FIXUP_ADDRESS for none */
+       int instruction_address;          /* Address of the instruction's first word */
+       int line;                         /* .am line, for diagnostics */
+       int kind;                         /* enum fixup_kind */
+       char label[MAX_LABEL_LEN + 1];    /* Symbol name */
+};
+
+/**
+ * @struct spilled_word
+ * @brief A code word with its address, as spilled by the first pass.
+ */
+struct spilled_word {
+       int address;
+       int word;
+};
+
+/**
+ * @struct spilled_extern
+ * @brief A reference to an external symbol, sorted for the .ext file.
+ */
+struct spilled_extern {
+       int rank;      /* Order of the symbol's first use */
+       int symbol;    /* Index in the symbol table */
+       int address;   /* Address of the operand word */
+};
+
+/**
+ * @brief Assembles a preprocessed file within a memory budget.
+ *
+ * Reads base_name.am and writes the .ob, .ent and .ext files unless an error is
+ * found. Diagnostics go to the diagnostics sink.
+ *
+ * @param prog An empty translation unit; its symbol table and entries are filled.
+ * @param base_name Base name of the file (without extension).
+ * @param budget Memory budget in bytes.
+ * @return 1 if any error occurred, 0 if the output files were written.
+ */
+int out_of_core_assemble(struct translation_unit *prog, const char *base_name, long budget);
+
+#endif /* OUT_OF_CORE_H */
@@ -4,6 +4,22 @@
 #include <stdio.h>
 #include "../header_files/translation_unit.h"
 
+#define OB_LINE_LENGTH 15            /* "%07d %06x\n": every .ob word line has the same width */
+#define OB_STREAM_EXTENSION ".ob.part"
+
+/*
+ * A .ob file written while the second pass encodes (--stream).
+ *
+ * The header is written as soon as the first pass has counted IC and DC. Since every
+ * word line has the same width, the line of the n-th instruction word starts at
+ * code_offset + n * OB_LINE_LENGTH, so each chunk of the second pass writes its words
+ * in place as it encodes them. The file is renamed to <name>.ob once complete.
+ */
+struct ob_stream {
+       char *path;          /* File being written, <name>.ob.part */
+       char *final_path;    /* <name>.ob */
+       long code_offset;    /* Offset of the first code line (the header's length) */
+};
 
 
 /*
@@ -24,6 +40,57 @@ void print_24bit_as_hex(FILE *f, int value);
  */
 void print_ob_file(const char *bname, const struct translation_unit *program);
 
+/*
+ * Starts a streamed .ob file: creates it and writes the header line.
+ *
+ * Parameters:
+ *   stream  - The stream to initialize.
+ *   bname   - The base name of the file.
+ *   program - Pointer to the translation unit after the first pass.
+ *
+ * Returns 1 if successful, 0 if the file could not be created (reported).
+ */
+int ob_stream_open(struct ob_stream *stream, const char *bname, const struct translation_unit *program);
+
+/*
+ * Opens a streamed .ob file positioned at the line of an instruction word. Every
+ * thread uses its own handle, so it does not report errors itself.
+ *
+ * Parameters:
+ *   stream     - The stream.
+ *   first_word - Number of instruction words before the position.
+ *
+ * Returns the handle, or NULL on failure.
+ */
+FILE *ob_stream_seek(const struct ob_stream *stream, int first_word);
+
+/*
+ * Writes one word line to a .ob file.
+ *
+ * Parameters:
+ *   f       - The file to write to.
+ *   address - Address of the word.
+ *   word    - The word.
+ */
+void print_ob_line(FILE *f, int address, int word);
+
+/*
+ * Appends the data section to a streamed .ob file and gives it its final name.
+ *
+ * Parameters:
+ *   stream  - The stream; its names are freed.
+ *   program - Pointer to the translation unit containing IC and the data image.
+ */
+void ob_stream_finish(struct ob_stream *stream, const struct translation_unit *program);
+
+/*
+ * Deletes a streamed .ob file after an error, so no partial output is left.
+ *
+ * Parameters:
+ *   stream - The stream; its names are freed.
+ */
+void ob_stream_discard(struct ob_stream *stream);
+
 /*
  * Generates the entry file (.ent) containing all entry symbols and their addresses.
  *
@@ -42,4 +109,17 @@ void print_ent_file(const char *bname, const struct translation_unit *program);
  */
 void print_ext_file(const char *bname, const struct translation_unit *program);
 
+/*
+ * Generates the relocation file (.rel), written with --relocations. Its first line is
+ * the address the file was assembled at (STARTING_ADDRESS), followed by the address of
+ * every word that holds the address of a label of the file, in increasing order: the
+ * words that change when the file is loaded elsewhere. The file is written even if it
+ * lists no word, so its absence means the .ob file cannot be rebased.
+ *
+ * Parameters:
+ *   bname   - The base name of the file.
+ *   program - Pointer to the translation unit containing the relocation table.
+ */
+void print_rel_file(const char *bname, const struct translation_unit *program);
+
 #endif /* OUTPUT_FILES_H */
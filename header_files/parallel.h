@@ -0,0 +1,57 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stddef.h>
+
+/**
+ * @file parallel.h
+ * @brief Runs independent tasks on worker threads.
+ *
+ * Passes that split their input into chunks describe each chunk in an array of
+ * task structs and hand the array to parallel_run(). The tasks must not touch
+ * shared state (in particular the diagnostics sink); results are merged by the
+ * caller after parallel_run() returns.
+ */
+
+/**
+ * @brief Work function applied to one task struct.
+ */
+typedef void (*parallel_task)(void *task);
+
+/**
+ * @brief Runs a function on every element of a task array and waits for all of them.
+ *
+ * The first task runs on the calling thread and each other task on its own thread.
+ * If a thread cannot be created, its task runs on the calling thread instead.
+ *
+ * @param run The work function.
+ * @param tasks Array of task structs.
+ * @param task_size Size of one task struct.
+ * @param count Number of tasks.
+ */
+void parallel_run(parallel_task run, void *tasks, size_t task_size, int count);
+
+/**
+ * @brief Runs every task of an array on its own thread, all at the same time.
+ *
+ * Unlike parallel_run(), tasks may wait for each other (for example a producer
+ * and a consumer), so either all of them run concurrently or none runs: the
+ * threads wait at a start barrier, and if one cannot be created the others are
+ * released without running their task.
+ *
+ * @param run The work function.
+ * @param tasks Array of task structs.
+ * @param task_size Size of one task struct.
+ * @param count Number of tasks.
+ * @return 1 if all tasks ran, 0 if none did.
+ */
+int parallel_run_together(parallel_task run, void *tasks, size_t task_size, int count);
+
+/**
+ * @brief Reads a monotonic clock.
+ *
+ * @return Seconds since an arbitrary fixed point.
+ */
+double monotonic_seconds(void);
+
+#endif /* PARALLEL_H */
@@ -0,0 +1,99 @@
+#ifndef PARALLEL_PREPROCESSOR_H
+#define PARALLEL_PREPROCESSOR_H
+
+#include <stddef.h>
+
+#include "../header_files/preprocessor.h"
+#include "../header_files/source_text.h"
+
+/**
+ * @file parallel_preprocessor.h
+ * @brief Macro expansion on several threads (--jobs N).
+ *
+ * The serial preprocessor goes line by line because a line is a call only if
+ * the macro was defined above it. Here that rule is kept in two phases:
+ *
+ *   1. A scan on the calling thread reads the whole .as file and handles the
+ *      definitions (mcro ... mcroend), which is cheap. Every other line goes
+ *      into a run of consecutive lines, together with the number of macros
+ *      defined above it.
+ *   2. The runs are split into chunks. Each chunk is expanded on its own thread,
+ *      into a buffer of its own and against a private copy of the macro table
+ *      whose count is set to that of each run. The buffers are then written to
+ *      the .am file in order.
+ *
+ * Only the scan reports diagnostics, and a worker that meets a recursive macro
+ * gives up. In both cases the reports are taken back and the file is
+ * preprocessed serially, so a file with errors gets the diagnostics of the
+ * serial preprocessor, in the same order. The .am file is the same either way.
+ * A file with an .include directive is also left to the serial preprocessor.
+ */
+
+#define MIN_PREPROCESS_CHUNK_SIZE (1 << 16)   /* Smallest part of the .as file worth a thread */
+
+/**
+ * @struct preprocess_run
+ * @brief Consecutive lines outside macro definitions, all seeing the same macros.
+ */
+struct preprocess_run {
+       size_t begin;      /* Offset of the first line in the .as text */
+       size_t end;        /* Offset following the last line */
+       int first_line;    /* Line number of the first line */
+       int macro_count;   /* Macros defined above the run */
+};
+
+/**
+ * @struct preprocess_scan
+ * @brief Result of the definition scan.
+ */
+struct preprocess_scan {
+       struct MacroTable table;        /* Every macro of the file, in order of definition */
+       struct preprocess_run *runs;    /* Lines left to expand, in order */
+       int run_count;                  /* Number of runs */
+       int run_capacity;               /* Allocated size of runs */
+};
+
+/**
+ * @struct expansion_piece
+ * @brief Origin of one piece of expanded text, kept for the --listing line map.
+ */
+struct expansion_piece {
+       int line;                          /* .as line that produced it */
+       int length;                        /* Number of characters */
+       char macro[MAX_MACRO_LEN + 1];     /* Expanded macro, empty for a copied line */
+};
+
+/**
+ * @struct preprocess_chunk
+ * @brief Runs expanded by one worker, and the text it produced.
+ */
+struct preprocess_chunk {
+       const struct source_text *source;          /* The whole .as file */
+       const struct preprocess_run *runs;         /* First run of the chunk */
+       int run_count;                             /* Number of runs */
+       const struct MacroTable *definitions;      /* Table built by the scan, read only */
+       int record_pieces;                         /* TRUE to fill pieces */
+       struct source_text output;                 /* Expanded text */
+       struct expansion_piece *pieces;            /* Origin of every piece of output */
+       int piece_count;                           /* Number of pieces */
+       int piece_capacity;                        /* Allocated size of pieces */
+       int failed;                                /* TRUE on a recursive macro or memory failure */
+};
+
+/**
+ * @brief Preprocesses a file on several threads, if it is large enough and has no errors.
+ *
+ * If nothing is written, any diagnostics reported on the way are taken back and
+ * the caller runs the serial preprocessor, which writes the same .am file.
+ *
+ * @param basename Base name of the source file (without extension).
+ * @param library Precompiled macros, may be NULL.
+ * @param map Receives the origin of every .am line (for --listing), may be NULL.
+ * @param jobs Number of threads to use.
+ * @param error Set to 1 if the line map could not be filled.
+ * @return 1 if the .am file was written, 0 if the serial preprocessor must run.
+ */
+int preprocess_in_parallel(const char *basename, const struct macro_library *library, struct line_map *map,
+                           int jobs, int *error);
+
+#endif /* PARALLEL_PREPROCESSOR_H */
@@ -0,0 +1,83 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include "../header_files/translation_unit.h"
+#include "../header_files/source_text.h"
+
+/**
+ * @file peephole.h
+ * @brief Optional removal of instructions that have no effect (--optimize).
+ *
+ * Runs between the two passes, once the first pass has assigned every
+ * instruction its address. The instructions are read from the .am text and
+ * matched against a table of rewrites that never change what a program does:
+ *
+ *   mov rX, rX            register copied onto itself
+ *   jmp L                 L is the next instruction (also jmp &L)
+ *   clr X / mov #0, X     the mov is dropped; only if it has no label, so
+ *                         nothing can jump to it
+ *   add #0, X / sub #0, X
+ *
+ * Only cmp sets the zero flag, so none of these removals change it. A label
+ * on a removed instruction moves to the instruction that followed it, which is
+ * where execution would have continued anyway. Dropping an instruction can
+ * turn a jmp into a jump to the next instruction, so the rules are applied
+ * until nothing changes.
+ *
+ * Afterwards the instruction addresses are assigned again (.org addresses stay
+ * fixed), the code and data symbols and the chunk starts of the first pass are
+ * updated, and the second pass skips the removed lines.
+ */
+
+/**
+ * @enum peephole_rule
+ * @brief The rewrites, in the order they are reported.
+ */
+enum peephole_rule {
+       RULE_MOV_SELF,       /* mov rX, rX */
+       RULE_JMP_NEXT,       /* jmp to the next instruction */
+       RULE_CLR_MOV_ZERO,   /* mov #0, X after clr X */
+       RULE_ADD_ZERO,       /* add #0, X or sub #0, X */
+       NUMBER_OF_PEEPHOLE_RULES
+};
+
+/**
+ * @struct peephole_entry
+ * @brief An instruction or .org line of the source, in line order.
+ */
+struct peephole_entry {
+       int line;                          /* .am line number */
+       int address;                       /* Address given by the first pass; the new address for .org */
+       int words;                         /* Instruction words, 0 for .org */
+       int rule;                          /* Rule that can remove the line, NO_RULE if none */
+       int target;                        /* jmp: address it jumps to, NO_TARGET if not a code label */
+       int removed;                       /* TRUE once a rule removed it */
+       int new_address;                   /* Address after the removals */
+       int words_before;                  /* Kept instruction words before the line */
+};
+
+/**
+ * @struct peephole_program
+ * @brief The entries of one source file.
+ */
+struct peephole_program {
+       struct peephole_entry *entries;   /* Entries in line order */
+       int count;                        /* Number of entries */
+       int capacity;                     /* Allocated size of entries */
+       int line_count;                   /* Number of .am lines */
+};
+
+/**
+ * @brief Removes instructions without effect and updates the addresses of the rest.
+ *
+ * Must only be called after a first pass without errors. Sets prog->removed_lines
+ * and writes the number of words saved per rule to stderr.
+ *
+ * @param prog The translation unit filled by the first pass.
+ * @param source Contents of the .am file.
+ * @param base_name Base name of the file, for the report.
+ * @return 1 if memory ran out, 0 if successful.
+ */
+int peephole_optimize(struct translation_unit *prog, const struct source_text *source, const char *base_name);
+
+#endif /* PEEPHOLE_H */
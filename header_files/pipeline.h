@@ -0,0 +1,37 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "../header_files/translation_unit.h"
+#include "../header_files/source_text.h"
+
+/**
+ * @file pipeline.h
+ * @brief Overlaps preprocessing, parsing and the first pass of one file.
+ *
+ * With --pipeline the three stages run on separate threads connected by bounded
+ * ring buffers of line records: the preprocessor hands every expanded line to the
+ * parser as soon as it is written, and the parser hands the parsed line to the
+ * first pass bookkeeping. The result (symbols, data image, diagnostics, the .am
+ * text for the second pass) is the same as running the stages one after another.
+ * After each file the share of the wall time every stage spent working (rather
+ * than waiting on its neighbours) is written to stderr.
+ */
+
+#define PIPELINE_RING_SIZE 1024     /* Records per ring buffer, a power of two */
+#define PIPELINE_UNAVAILABLE (-1)   /* The stage threads could not be started */
+
+/**
+ * @brief Preprocesses a file and runs its first pass as a pipeline.
+ *
+ * @param prog The translation unit to fill.
+ * @param base_name Base name of the file (without extension).
+ * @param source Receives the .am text, for the second pass.
+ * @param map Receives the origins of the .am lines, may be NULL.
+ * @param preprocessor_error Set to 1 if the preprocessor failed; nothing else is kept then.
+ * @return 1 if the first pass found errors, 0 if not, or PIPELINE_UNAVAILABLE if
+ *         threads could not be started and nothing was done.
+ */
+int pipeline_first_pass(struct translation_unit *prog, const char *base_name,
+                        struct source_text *source, struct line_map *map, int *preprocessor_error);
+
+#endif /* PIPELINE_H */
@@ -4,12 +4,15 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "../header_files/macro_library.h"
+
 /* Maximum lengths for macro names and lines */
 #define MAX_MACRO_LEN 31
 #define LINE_MAX_LEN 80
 
 #define INITIAL_NUMBER_OF_LINES 0
 #define INITIAL_LINES_CAPASITY 0
+#define INITIAL_MACRO_INDEX_SIZE 16   /* Buckets of the macro name index, a power of two */
 
 #define MACRO_DEF_SIZE 4
 #define MACRO_END_DEF_SIZE 7
@@ -29,6 +32,11 @@ struct Macro {
        char (*lines)[LINE_MAX_LEN];             /* Dynamic array of lines in the macro */
        int line_count;                          /* Number of lines in the macro */
        int capacity;                            /* Allocated capacity for lines */
+       char *flat_body;                         /* Body with nested calls expanded, built on first use */
+       size_t flat_length;                      /* Length of flat_body */
+       size_t flat_capacity;                    /* Allocated size of flat_body */
+       int flat_macro_count;                    /* Macro count when flat_body was built */
+       int expanding;                           /* TRUE while being flattened, to detect cycles */
 };
 
 /**
@@ -39,6 +47,7 @@ enum type {
        macro_def = 1,           /* Start of a macro definition */
        macro_end_def,           /* End of a macro definition */
        macro_call,              /* Line is a macro call */
+       include_line,            /* Line is an .include directive */
        any_other_line_type      /* Regular line (not macro related) */
 };
 
@@ -50,6 +59,10 @@ struct MacroTable {
        struct Macro *macros;    /* Dynamic array of macros */
        int count;               /* Number of macros stored */
        int capacity;            /* Allocated size of the macros array */
+       const struct macro_library *library;   /* Library macros, looked up first; may be NULL */
+       struct Macro library_macro;            /* Library macro matched by the last call */
+       int *index;              /* Hash index of the names: first macro of a name + 1, 0 if empty */
+       int index_size;          /* Buckets in index, a power of two; at most half are used */
 };
 
 /**
@@ -96,6 +109,12 @@ int is_macro_end_def(char *trimmed_line, struct Macro *macro_pointer, int *error
 /**
  * @brief Checks if a line is a macro call.
  *
+ * A call is a macro name alone on its line. Names are found through the hash
+ * index of the table, and only the first count macros are visible. The library
+ * of the table is searched first. A library macro is returned as
+ * macro_table->library_macro, whose flat_body points into the mapped library
+ * and stays valid until the next call.
+ *
  * @param line_buffer The line to analyze.
  * @param macro_pointer Output pointer to the matched macro (if found).
  * @param macro_table Pointer to the macro table.
@@ -112,6 +131,54 @@ int is_macro_call(char *line_buffer, struct Macro **macro_pointer, struct MacroT
  */
 void add_line_to_macro(struct Macro *macro_pointer, const char *trimmed_line, int * error_flag);
 
+/**
+ * @brief Builds (or reuses) the fully expanded body of a macro.
+ *
+ * Body lines that call other macros are replaced by the callee's flattened body, so
+ * a call is a single bulk copy of flat_body. The result is memoized and rebuilt only
+ * when more macros were defined since, because that can turn body lines into calls.
+ *
+ * @param macro_table Pointer to the macro table.
+ * @param macro The macro to flatten.
+ * @param error_flag Pointer to an error flag to set if needed.
+ * @param line_count Line of the call, for diagnostics.
+ * @return 1 if flat_body is ready, 0 on a recursive call or memory failure.
+ */
+int flatten_macro(struct MacroTable *macro_table, struct Macro *macro, int *error_flag, int line_count);
+
+/**
+ * @enum flatten_result
+ * @brief Outcome of build_flat_body().
+ */
+enum flatten_result {
+       FLATTEN_DONE,         /* flat_body is ready */
+       FLATTEN_RECURSIVE,    /* The macro calls itself, directly or through others */
+       FLATTEN_NO_MEMORY     /* Memory allocation failed */
+};
+
+/**
+ * @brief Builds the fully expanded body of a macro like flatten_macro(), without reporting.
+ *
+ * Touches nothing but the table, so a worker thread may use it on a table of its own.
+ *
+ * @param macro_table Pointer to the macro table.
+ * @param macro The macro to flatten.
+ * @param recursive Receives the macro that was reached again, on FLATTEN_RECURSIVE.
+ * @return A value from enum flatten_result.
+ */
+int build_flat_body(struct MacroTable *macro_table, struct Macro *macro, const struct Macro **recursive);
+
+/**
+ * @brief Receives the expanded text as it is written to the .am file.
+ *
+ * @param context Argument given to preprocess_to().
+ * @param text Expanded text, one or more whole lines (not null-terminated).
+ * @param length Number of characters.
+ */
+struct line_map;
+
+typedef void (*preprocessor_output)(void *context, const char *text, size_t length);
+
 /**
  * @brief Runs the preprocessor stage: expands macros and outputs a cleaned .am file.
  *
@@ -121,7 +188,26 @@ void add_line_to_macro(struct Macro *macro_pointer, const char *trimmed_line, in
 void preprocessor(char *basename, int *error);
 
 /**
- * @brief Determines the type of a given line: macro definition, call, end, or regular line.
+ * @brief Runs the preprocessor and also hands every piece of output to a callback.
+ *
+ * Lets a later stage start on the expanded lines while the file is still being
+ * preprocessed.
+ * Without a callback, --jobs N expands large files on several threads
+ * (parallel_preprocessor.h).
+ * With --check no .am file is written and the text only goes to the callback.
+ * An .include directive is replaced by the text of its file (includes.h), and
+ * with -MD the files read are written to a .d file.
+ *
+ * @param basename Base name of the source file (without extension).
+ * @param error Pointer to an int that will be set to 1 if any error occurred.
+ * @param output Callback receiving the text written to the .am file, may be NULL.
+ * @param context Argument passed to output.
+ * @param map Receives the origin of every .am line (for --listing), may be NULL.
+ */
+void preprocess_to(char *basename, int *error, preprocessor_output output, void *context, struct line_map *map);
+
+/**
+ * @brief Determines the type of a given line: macro definition, call, end, .include, or regular line.
  *
  * @param trimmed_line The line to classify.
  * @param macro_pointer Pointer to the current macro being defined or called.
@@ -0,0 +1,69 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "../header_files/diagnostics.h"
+
+/**
+ * @file profile.h
+ * @brief Hardware performance counters per assembler phase (--profile).
+ *
+ * Cycles, instructions, branch misses and cache misses are read with Linux
+ * perf_event_open() around each phase (the same phases diagnostics are attributed
+ * to), together with the wall time. Counters are inherited by the worker threads a
+ * phase starts, so parallel passes are counted in full. A table is written to
+ * stderr after each file and a total after the last one.
+ *
+ * When a counter cannot be opened (no permission, no PMU in a container or a
+ * virtual machine, not Linux) its column shows "n/a" and the wall time is still
+ * measured.
+ */
+
+/**
+ * @enum profile_counter
+ * @brief The hardware events that are counted.
+ */
+enum profile_counter {
+       COUNTER_CYCLES,
+       COUNTER_INSTRUCTIONS,
+       COUNTER_BRANCH_MISSES,
+       COUNTER_CACHE_MISSES,
+       NUMBER_OF_COUNTERS
+};
+
+/**
+ * @struct profile_sample
+ * @brief Measurements of one phase, or the sum of several.
+ */
+struct profile_sample {
+       double seconds;                         /* Wall time */
+       double counts[NUMBER_OF_COUNTERS];      /* Events, scaled if the counter was multiplexed */
+       int runs;                               /* Number of measured intervals */
+};
+
+/**
+ * @brief Opens the counters. Until it is called the other functions do nothing.
+ *
+ * @return The number of counters that could be opened.
+ */
+int profile_start(void);
+
+/**
+ * @brief Ends the measurement of the current phase (if any) and starts one for a phase.
+ *
+ * @param phase The phase that is about to run.
+ */
+void profile_phase(enum diag_phase phase);
+
+/**
+ * @brief Ends the current phase and writes the table of one file to stderr.
+ *
+ * @param base_name Base name of the file (without extension).
+ */
+void profile_end_file(const char *base_name);
+
+/**
+ * @brief Writes the totals of all files to stderr and closes the counters.
+ */
+void profile_stop(void);
+
+#endif /* PROFILE_H */
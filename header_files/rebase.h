@@ -0,0 +1,31 @@
+#ifndef REBASE_H
+#define REBASE_H
+
+/**
+ * @file rebase.h
+ * @brief Moving an assembled file to another load address (--rebase BASE).
+ *
+ * A file assembled with --relocations has a .rel file listing the words that
+ * hold the address of one of its labels (the words with the R bit). Loading the
+ * file at a new base moves every word by the same distance, and adds that
+ * distance to the address inside each listed word; nothing else changes, so the
+ * file does not need to be assembled again.
+ *
+ * The .rel addresses are in increasing order, like the word lines of the .ob
+ * file, so both are read side by side in a single pass, one line at a time.
+ */
+
+/**
+ * @brief Rewrites <name>.ob, <name>.rel and, if present, <name>.ent and <name>.ext for a new base.
+ *
+ * The new files are written under temporary names and replace the old ones only
+ * once all of them are complete. The .rel file records the new base, so a file
+ * can be rebased again. Problems are reported as rebase diagnostics.
+ *
+ * @param base_name Base name of the file (without extension).
+ * @param new_base Address the first word is loaded at from now on.
+ * @return 1 if the file could not be rebased, 0 if successful.
+ */
+int rebase_object(const char *base_name, int new_base);
+
+#endif /* REBASE_H */
@@ -0,0 +1,91 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <stddef.h>
+
+/**
+ * @file ring_buffer.h
+ * @brief Bounded single-producer/single-consumer queue of fixed-size records.
+ *
+ * One thread pushes and one thread pops. The indices are published with
+ * acquire/release atomics, so the common case takes no lock; a side that finds
+ * the buffer full (or empty) yields until the other side catches up. Records are
+ * filled and read in place: *_slot() returns the record, and ring_push() or
+ * ring_pop() hands it over to the other side.
+ */
+
+#define CACHE_LINE_SIZE 64
+
+/**
+ * @struct ring_buffer
+ * @brief A queue connecting two pipeline stages.
+ */
+struct ring_buffer {
+       char *slots;                            /* capacity records of slot_size bytes */
+       size_t slot_size;                       /* Size of one record */
+       unsigned long mask;                     /* capacity - 1, capacity is a power of two */
+       char pad0[CACHE_LINE_SIZE];
+       unsigned long head;                     /* Records pushed so far, written by the producer */
+       char pad1[CACHE_LINE_SIZE];
+       unsigned long tail;                     /* Records popped so far, written by the consumer */
+       char pad2[CACHE_LINE_SIZE];
+       int closed;                             /* Set by the producer after its last record */
+};
+
+/**
+ * @brief Allocates the records of a ring buffer.
+ *
+ * @param ring The ring buffer to initialize.
+ * @param slot_size Size of one record.
+ * @param capacity Number of records, must be a power of two.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int ring_init(struct ring_buffer *ring, size_t slot_size, unsigned long capacity);
+
+/**
+ * @brief Waits for a free record (producer side).
+ *
+ * @param ring The ring buffer.
+ * @param waited Incremented by the seconds spent waiting for the consumer.
+ * @return The record to fill.
+ */
+void *ring_push_slot(struct ring_buffer *ring, double *waited);
+
+/**
+ * @brief Publishes the record returned by ring_push_slot().
+ *
+ * @param ring The ring buffer.
+ */
+void ring_push(struct ring_buffer *ring);
+
+/**
+ * @brief Signals that no more records will be pushed.
+ *
+ * @param ring The ring buffer.
+ */
+void ring_close(struct ring_buffer *ring);
+
+/**
+ * @brief Waits for the next record (consumer side).
+ *
+ * @param ring The ring buffer.
+ * @param waited Incremented by the seconds spent waiting for the producer.
+ * @return The oldest record, or NULL once the buffer is closed and empty.
+ */
+void *ring_pop_slot(struct ring_buffer *ring, double *waited);
+
+/**
+ * @brief Releases the record returned by ring_pop_slot() back to the producer.
+ *
+ * @param ring The ring buffer.
+ */
+void ring_pop(struct ring_buffer *ring);
+
+/**
+ * @brief Frees the records of a ring buffer.
+ *
+ * @param ring The ring buffer.
+ */
+void ring_free(struct ring_buffer *ring);
+
+#endif /* RING_BUFFER_H */
@@ -1,9 +1,11 @@
 #ifndef SECOND_PASS_H
 #define SECOND_PASS_H
+#include <stdio.h>
 #include "../header_files/translation_unit.h"
+#include "../header_files/ast.h"
+#include "../header_files/diagnostics.h"
+#include "../header_files/output.h"
 
-#define MAX_SYMBOLS 100
-#define MAX_MEM_SIZE 1024
 #define A 4
 #define R 2
 #define E 1 
@@ -15,6 +17,49 @@
 #define REG_SRC_SHIFT    13
 #define REG_DEST_SHIFT    8
 
+/**
+ * @struct extern_use
+ * @brief An operand word that refers to an external symbol.
+ */
+struct extern_use {
+       int symbol;    /* Index of the symbol in the symbol table */
+       int address;   /* Address of the operand word */
+};
+
+/**
+ * @struct second_pass_report
+ * @brief A diagnostic found by a worker thread, reported after all chunks are encoded.
+ */
+struct second_pass_report {
+       enum diag_code code;
+       int line;
+       char label[MAX_LINE_LEN + 1];   /* Operand label the diagnostic is about */
+};
+
+/**
+ * @struct second_pass_chunk
+ * @brief Encoding of one first pass chunk, built without touching shared state.
+ */
+struct second_pass_chunk {
+       const struct source_text *source;         /* Text the chunk belongs to */
+       const struct source_chunk *range;         /* Lines, first line number and first address */
+       const struct translation_unit *prog;      /* Final symbol table, only read */
+       const struct ob_stream *stream;           /* Streamed .ob file, or NULL */
+       FILE *ob;                                 /* This chunk's handle on the streamed file */
+       struct memory_image code_image;           /* Words encoded by this chunk, unless streamed */
+       struct extern_use *uses;                  /* Extern references in address order */
+       int use_count;                            /* Number of extern references */
+       int use_capacity;                         /* Allocated size of uses */
+       int *relocations;                         /* Addresses of the R words, with --relocations */
+       int relocation_count;                     /* Number of R words */
+       int relocation_capacity;                  /* Allocated size of relocations */
+       struct second_pass_report *reports;       /* Diagnostics in line order */
+       int report_count;                         /* Number of diagnostics */
+       int report_capacity;                      /* Allocated size of reports */
+       struct listing listing;                   /* Listing entries, with --listing */
+       int failed;                               /* TRUE if memory ran out */
+       int stream_failed;                        /* TRUE if writing the streamed file failed */
+};
 
 /**
  * Performs the second pass over the assembly source file.
@@ -25,11 +70,34 @@
  * - Handles .extern symbols and updates their usage addresses.
  * - Reports errors for undefined symbols or memory issues.
  *
+ * Every chunk of the first pass is encoded on its own thread, starting at the
+ * address the first pass assigned to it. The chunks' code images, extern
+ * references, relocations and diagnostics are then merged in chunk (and so address) order,
+ * which makes the output identical to encoding the file serially.
+ *
+ * With a stream, each chunk writes its words straight into the .ob file at the
+ * chunk's place instead of keeping them (the code image stays empty unless the
+ * listing needs it).
+ *
  * @param prog Pointer to the translation unit (holds symbol table, memory, externals, etc.).
- * @param amFile Opened file pointer to the preprocessed .am source file.
+ * @param source Contents of the preprocessed .am source file.
+ * @param stream The .ob file to write the code words to, or NULL to keep them in prog->code_image.
  * @return 1 if any errors were encountered, 0 if successful.
  */
-int secondPass(struct translation_unit *prog, FILE *amFile);
+int secondPass(struct translation_unit *prog, const struct source_text *source, const struct ob_stream *stream);
+
+/**
+ * Resolves the label operands recorded by the first pass with --check, instead of
+ * encoding anything.
+ *
+ * Reports the same undefined-label and relative-extern errors as secondPass(), in
+ * the same order. Labels are looked up by binary search in a sorted index of the
+ * symbol table.
+ *
+ * @param prog Pointer to the translation unit, after the first pass.
+ * @return 1 if any errors were encountered, 0 if every label resolves.
+ */
+int check_references(struct translation_unit *prog);
 
 #endif
 
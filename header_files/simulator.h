@@ -0,0 +1,98 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <stdio.h>
+
+/**
+ * @file simulator.h
+ * @brief Instruction-set simulator for object (.ob) images produced by the assembler.
+ *
+ * The simulator loads the address/word pairs of an .ob file into memory and executes
+ * the 16 machine instructions. Every instruction word is decoded once into a
+ * struct decoded_instruction (handler, addressing modes, registers and extra words)
+ * and cached by address, so the execution loop only dispatches through the cache.
+ */
+
+#define SIM_MEMORY_SIZE (1 << 21)        /* Addresses fit the 21-bit operand field */
+#define SIM_STACK_SIZE 1024              /* Depth of the jsr/rts return stack */
+#define SIM_NUMBER_OF_OPCODES 64         /* Opcode field is 6 bits wide */
+#define SIM_NUMBER_OF_FUNCTS 32          /* Funct field is 5 bits wide */
+
+#define WORD_MASK 0xFFFFFF
+#define ARE_MASK 0x7
+#define OPCODE_MASK 0x3F
+#define FUNCT_MASK 0x1F
+#define OPERAND_TYPE_MASK 0x3
+#define REGISTER_MASK 0x7
+
+#define SIM_OK 0
+#define SIM_ERROR 1
+
+struct machine;
+struct decoded_instruction;
+
+/** Executes one decoded instruction located at @p address. */
+typedef void (*sim_handler)(struct machine *m, const struct decoded_instruction *d, int address);
+
+/**
+ * @struct decoded_instruction
+ * @brief Cached decoding of one instruction word and its extra operand words.
+ */
+struct decoded_instruction {
+       sim_handler handler;      /* Handler from the dispatch table, NULL if not decoded yet */
+       int length;               /* Number of words including the first word */
+       int number_of_operands;   /* 0, 1 or 2 */
+       int mode[2];              /* Addressing mode of the source [0] and destination [1] */
+       int reg[2];               /* Register numbers for register operands */
+       int value[2];             /* Sign-extended value field of the extra words */
+       int are[2];               /* A/R/E bits of the extra words */
+};
+
+/**
+ * @struct machine
+ * @brief Complete state of a simulated program.
+ */
+struct machine {
+       int *memory;                          /* SIM_MEMORY_SIZE words, 24 bits each */
+       unsigned char *loaded;                /* TRUE for each address the image or a store gave a word */
+       int registers[8];                     /* r0 - r7, sign-extended */
+       int pc;                               /* Address of the next instruction */
+       int zero_flag;                        /* Set by cmp, tested by bne */
+       int stack[SIM_STACK_SIZE];            /* Return addresses pushed by jsr */
+       int sp;                               /* Number of return addresses on the stack */
+       int code_start;                       /* Lowest code address in the image */
+       int code_end;                         /* One past the highest code address */
+       struct decoded_instruction *decoded;  /* Decode cache for [code_start, code_end) */
+       unsigned long steps;                  /* Executed instructions */
+       int halted;                           /* TRUE once stop ran or an error occurred */
+       int error;                            /* SIM_ERROR if execution failed */
+       FILE *in;                             /* Input for red */
+       FILE *out;                            /* Output for prn */
+};
+
+/**
+ * @brief Allocates the machine memory and loads an .ob file into it.
+ *
+ * @param m Machine to initialize.
+ * @param obFileName Name of the object file.
+ * @return SIM_OK on success, SIM_ERROR if the file cannot be read or is malformed.
+ */
+int sim_load(struct machine *m, const char *obFileName);
+
+/**
+ * @brief Runs the loaded program until stop, an error, or @p max_steps instructions.
+ *
+ * @param m Loaded machine.
+ * @param max_steps Upper bound on executed instructions, 0 for no bound.
+ * @return SIM_OK if the program stopped normally, SIM_ERROR otherwise.
+ */
+int sim_run(struct machine *m, unsigned long max_steps);
+
+/**
+ * @brief Frees the memory and decode cache of a machine.
+ *
+ * @param m Machine to release.
+ */
+void sim_free(struct machine *m);
+
+#endif /* SIMULATOR_H */
@@ -0,0 +1,89 @@
+#ifndef SOURCE_TEXT_H
+#define SOURCE_TEXT_H
+
+#include <stddef.h>
+
+/**
+ * @file source_text.h
+ * @brief The preprocessed (.am) source held in memory.
+ *
+ * Both passes read the same .am text. Keeping it in one buffer lets a pass split
+ * it into chunks at line boundaries and hand each chunk to a different thread.
+ * Lines are returned exactly as fgets() with a MAX_LINE_LEN + 1 buffer would
+ * return them, so line numbers in diagnostics do not depend on the chunking.
+ */
+
+/**
+ * @struct source_text
+ * @brief Contents of a source file.
+ */
+struct source_text {
+       char *text;      /* File contents, null-terminated */
+       size_t length;   /* Number of characters, without the terminator */
+       size_t capacity; /* Allocated size of text */
+};
+
+/**
+ * @struct source_chunk
+ * @brief A range of whole lines and the counters in effect where it starts.
+ */
+struct source_chunk {
+       size_t begin;        /* Offset of the first character */
+       size_t end;          /* Offset following the last character */
+       int first_line;      /* Line number of the first line */
+       int first_address;   /* Instruction address at the start of the chunk */
+       int first_data;      /* Data counter at the start of the chunk */
+       int first_word;      /* Instruction words encoded before the chunk */
+};
+
+/**
+ * @brief Reads a whole file into memory.
+ *
+ * @param source Receives the contents.
+ * @param filename Name of the file to read.
+ * @return 1 if successful, 0 if the file could not be read or memory ran out.
+ */
+int load_source_text(struct source_text *source, const char *filename);
+
+/**
+ * @brief Appends characters to a source text that is built incrementally.
+ *
+ * A zero-initialized struct is an empty text. Failures are not reported here,
+ * since the text is built on a worker thread.
+ *
+ * @param source The source text.
+ * @param text Characters to append.
+ * @param length Number of characters.
+ * @return 1 if successful, 0 on memory allocation failure.
+ */
+int append_source_text(struct source_text *source, const char *text, size_t length);
+
+/**
+ * @brief Copies the line starting at a position, like fgets() would.
+ *
+ * At most MAX_LINE_LEN characters are copied; the newline, if reached, is kept.
+ *
+ * @param source The source text.
+ * @param position Offset of the line.
+ * @param line Buffer of at least MAX_LINE_LEN + 1 characters.
+ * @return Offset of the following line.
+ */
+size_t next_source_line(const struct source_text *source, size_t position, char *line);
+
+/**
+ * @brief Finds the first line start at or after a position.
+ *
+ * @param source The source text.
+ * @param position Any offset into the text.
+ * @return Offset of the next line start, or the text length if there is none.
+ */
+size_t source_line_boundary(const struct source_text *source, size_t position);
+
+/**
+ * @brief Frees the text and resets the struct to empty.
+ *
+ * @param source The source text to free.
+ */
+void free_source_text(struct source_text *source);
+
+#endif /* SOURCE_TEXT_H */
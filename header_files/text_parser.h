@@ -7,7 +7,7 @@
 
 #define MAX_LABEL_LEN 31
 #define NUMBER_OF_INSTRACTIONS 16
-#define NUMBER_OF_DIRECTIVES 4
+#define NUMBER_OF_DIRECTIVES 6
 #define NUMBER_OF_REGISTERS 8
 
 #define MAX_SIGNED_DATA  ((1 << 23) - 1)    /*  2^23 - 1 = 8,388,607 */
@@ -30,6 +30,8 @@
 #define STRING 1
 #define ENTRY 2
 #define EXTERN 3
+#define ORG 4
+#define INCBIN 5
 #define NOT_A_DIRECTIVE -1
 
 
@@ -44,6 +46,39 @@ struct string_seperation_result {
        int strings_count;          /* Number of tokens found */
 };
 
+/* Addressing modes as bits of a legality mask */
+#define NUMBER_OF_MODES 4
+#define MODE_BIT(mode) (1 << (mode))
+#define MODES_NONE 0
+#define MODES_1    (MODE_BIT(ast_direct))
+#define MODES_12   (MODE_BIT(ast_direct) | MODE_BIT(ast_relative))
+#define MODES_13   (MODE_BIT(ast_direct) | MODE_BIT(ast_register))
+#define MODES_013  (MODE_BIT(ast_instant) | MODE_BIT(ast_direct) | MODE_BIT(ast_register))
+
+/*
+ * The instruction set, expanded by X(name, opcode, funct, legal source modes,
+ * legal destination modes, number of operands). Both instruction_table and the
+ * precomputed encoding_table are generated from this list; the legal modes only
+ * go into encoding_table, which the parser checks operands against.
+ */
+#define INSTRUCTION_LIST(X) \
+       X(mov,  0,  0, MODES_013,  MODES_13,  2) \
+       X(cmp,  1,  0, MODES_013,  MODES_013, 2) \
+       X(add,  2,  1, MODES_013,  MODES_13,  2) \
+       X(sub,  2,  2, MODES_013,  MODES_13,  2) \
+       X(lea,  4,  0, MODES_1,    MODES_13,  2) \
+       X(clr,  5,  1, MODES_NONE, MODES_13,  1) \
+       X(not,  5,  2, MODES_NONE, MODES_13,  1) \
+       X(inc,  5,  3, MODES_NONE, MODES_13,  1) \
+       X(dec,  5,  4, MODES_NONE, MODES_13,  1) \
+       X(jmp,  9,  1, MODES_NONE, MODES_12,  1) \
+       X(bne,  9,  2, MODES_NONE, MODES_12,  1) \
+       X(jsr,  9,  3, MODES_NONE, MODES_12,  1) \
+       X(red,  12, 0, MODES_NONE, MODES_13,  1) \
+       X(prn,  13, 0, MODES_NONE, MODES_013, 1) \
+       X(rts,  14, 0, MODES_NONE, MODES_NONE, 0) \
+       X(stop, 15, 0, MODES_NONE, MODES_NONE, 0)
+
 /**
  * @struct instruction
  * @brief Represents an instruction's metadata.
@@ -52,13 +87,12 @@ struct instruction {
        char *name;                              /* Instruction name (e.g., "mov") */
        int opCode;                              /* Opcode value */
        int funct;                               /* Function code */
-       const char *operands_legal_types[MAX_NUMBER_OF_OPERANDS];     /* Legal addressing types for src and dest */
        int number_of_operands;                  /* Expected number of operands */
 };
 
 /* Global arrays */
 extern char *register_names[NUMBER_OF_REGISTERS];                 /* Valid register names: r0 to r7 */
-extern char *directive_names[NUMBER_OF_DIRECTIVES];                /* Valid directive names: data, string, entry, extern */
+extern char *directive_names[NUMBER_OF_DIRECTIVES];                /* Valid directive names: data, string, entry, extern, org, incbin */
 extern struct instruction instruction_table[NUMBER_OF_INSTRACTIONS];/* Table of supported instructions */
 
 /**
@@ -69,6 +103,18 @@ extern struct instruction instruction_table[NUMBER_OF_INSTRACTIONS];/* Table of
  */
 void append_error(char **error, const char *new_msg);
 
+/**
+ * @brief Parses a decimal number and checks that it lies in a range.
+ *
+ * @param str The number, with no surrounding characters.
+ * @param min Smallest allowed value.
+ * @param max Largest allowed value.
+ * @param result Output pointer to store the parsed number.
+ * @param allow_sign Whether a leading '+' or '-' is accepted.
+ * @return VALID_NUMBER if valid, INVALID_NUMBER otherwise.
+ */
+int legal_number(char *str, int min, int max, int *result, int allow_sign);
+
 /**
  * @brief Checks if a label is valid (not a keyword, starts with letter, etc.).
  *
@@ -125,7 +171,7 @@ int legal_string(char *str);
  * @brief Returns the directive type based on the token (e.g., ".data", ".entry").
  *
  * @param str The directive token.
- * @return Integer code: 0=data, 1=string, 2=entry, 3=extern, or -1 if invalid.
+ * @return Integer code: 0=data, 1=string, 2=entry, 3=extern, 4=org, 5=incbin, or -1 if invalid.
  */
 int check_directive(char *str);
 
@@ -0,0 +1,76 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/**
+ * @file trace.h
+ * @brief Timeline of a run in the Chrome trace event format (--trace FILE).
+ *
+ * Every input file, every phase function (preprocessor, firstPass, secondPass,
+ * the print_*_file functions, ...) and every task a pass hands to a worker
+ * thread becomes a complete ("X") event with its start, duration, process and
+ * thread id. Counters such as lines and symbols are attached to the events as
+ * arguments and also written as counter ("C") events, which draw a track per
+ * counter. The file is a JSON array that chrome://tracing and Perfetto open
+ * directly; events are written as they end, so a run stopped early (--watch
+ * ends with Ctrl-C) still leaves a readable file.
+ *
+ * Until trace_start() is called every function returns at once, so the hooks
+ * cost a test and a call per phase when the option is off.
+ */
+
+/**
+ * @struct trace_arg
+ * @brief A named number attached to an event.
+ */
+struct trace_arg {
+       const char *name;
+       long value;
+};
+
+/**
+ * @brief Opens the trace file. Until it is called the other functions do nothing.
+ *
+ * @param path Name of the file to write.
+ * @return 1 if successful, 0 if the file could not be opened.
+ */
+int trace_start(const char *path);
+
+/**
+ * @brief Reads the trace clock, to pass as the start of an event later.
+ *
+ * @return Microseconds since trace_start(), or 0 when not tracing.
+ */
+double trace_clock(void);
+
+/**
+ * @brief Writes an event that started at a given time and ends now, on the calling thread.
+ *
+ * Safe to call from worker threads.
+ *
+ * @param name Name of the event, usually the function that ran.
+ * @param category Category of the event ("file", "phase", "output" or "task").
+ * @param start Value of trace_clock() when the event started.
+ * @param args Numbers to attach to the event, may be NULL.
+ * @param arg_count Number of args.
+ */
+void trace_event(const char *name, const char *category, double start, const struct trace_arg *args, int arg_count);
+
+/**
+ * @brief Writes the current value of a counter.
+ *
+ * @param name Name of the counter track.
+ * @param value Its value from now on.
+ */
+void trace_counter(const char *name, long value);
+
+/**
+ * @brief Writes the buffered events to the file.
+ */
+void trace_flush(void);
+
+/**
+ * @brief Ends the trace and closes the file.
+ */
+void trace_stop(void);
+
+#endif /* TRACE_H */
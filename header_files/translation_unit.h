@@ -1,17 +1,22 @@
 #ifndef TRANSLATION_UNIT_H
 #define TRANSLATION_UNIT_H
-#define MAX_MEMORY_SIZE 1024
+
+#include "../header_files/memory_image.h"
+#include "../header_files/source_text.h"
+#include "../header_files/listing.h"
 
 #define STARTING_ADDRESS 100
+#define MAX_ADDRESS ((1 << 20) - 1)   /* Largest address a 21-bit signed operand word can hold */
 
 /**
  * Structure representing the entire program during both passes of the assembler.
  * Holds all memory images, symbol metadata, and output tracking structures.
  */
 struct translation_unit {
-       int code_image[MAX_MEMORY_SIZE];                     /** Holds encoded instruction words */
-       int IC;                              /** Instruction Counter starting at 100 */
-       int data_image[MAX_MEMORY_SIZE];                     /** Holds encoded .data and .string values */
+       struct memory_image code_image;     /** Encoded instruction words, indexed by address */
+       int IC;                              /** Number of instruction words, counted by the first pass */
+       int ICF;                             /** Address following the last instruction, where data starts */
+       struct memory_image data_image;     /** Encoded .data and .string values, indexed from 0 */
        int DC;                              /** Data Counter */
        struct symbol *symbol_table;        /** Symbol table with labels and their attributes */
        int symCount;                       /** Number of defined symbols */
@@ -22,6 +27,20 @@ struct translation_unit {
        struct symbol **entries;            /** Pointers to symbols marked as entry */
        int entries_count;                  /** Number of entries */
        int entries_capacity;               /** Capacity of the entries array */
+       struct source_chunk *chunks;        /** Line ranges the first pass split the source into */
+       int chunk_count;                    /** Number of chunks */
+       struct listing listing;             /** Address to line map of the encoded words (--listing) */
+       char *removed_lines;                /** Per .am line, TRUE if --optimize removed its instruction; NULL if none was */
+       struct symbol_reference *references;   /** Label operands left to resolve, with --check */
+       int reference_count;                /** Number of label operands */
+       int reference_capacity;             /** Capacity of the references array */
+       int line_count;                     /** Number of .am lines read by the first pass */
+       int *relocations;                   /** Addresses of the words holding a relocatable address, in increasing order (--relocations) */
+       int relocation_count;               /** Number of relocated words */
+       int relocation_capacity;            /** Capacity of the relocations array */
+       int *data_map;                      /** Per data address of the first pass, its address after --pool-data (-1 if shared); NULL if unchanged */
+       int pooled_words;                   /** Data words --pool-data saved */
+       int pooled_blocks;                  /** Data blocks --pool-data shared with an earlier copy */
 };
 
 /**
@@ -46,8 +65,9 @@ struct symbol {
  */
 struct ext {
        char *externalName;       /** Name of the external symbol */
-       int addresses[MAX_MEMORY_SIZE];      /** Memory locations where it is used */
+       int *addresses;           /** Memory locations where it is used, in increasing order */
        int address_count;        /** Number of times it was used */
+       int address_capacity;     /** Capacity of the addresses array */
 };
 
 
@@ -0,0 +1,40 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+/**
+ * @file watch.h
+ * @brief Reassembling sources when they change (--watch).
+ *
+ * After the first run the assembler keeps going and waits for inotify events
+ * on the directories of the sources of each input: its .as file and every file
+ * it included, as the preprocessor reports them at the end of each run.
+ * Watching directories rather than the files themselves also catches editors
+ * that save by writing a new file and renaming it over the old one.
+ *
+ * A save often arrives as a burst of events (truncate, several writes, close),
+ * so events are collected until none has arrived for WATCH_DEBOUNCE_MS. Then
+ * each touched source is read and hashed, and only the inputs with a source
+ * whose contents differ from the last assembled version are assembled again.
+ * Every reassembly prints one line with its result and time on stderr.
+ *
+ * Only Linux has inotify; elsewhere --watch reports that and stops.
+ */
+
+#define WATCH_DEBOUNCE_MS 30
+
+/**
+ * @brief Assembles one file, returns 1 if it failed and 0 if it succeeded.
+ */
+typedef int (*watch_assemble)(const char *base_name);
+
+/**
+ * @brief Assembles the input files, then reassembles them whenever their sources change, until interrupted.
+ *
+ * @param files Base names of the input files (without extension).
+ * @param count Number of files.
+ * @param assemble Called for each file once, then for each file with a changed source.
+ * @return 1 if watching could not start; otherwise it does not return.
+ */
+int watch_files(char const *files[], int count, watch_assemble assemble);
+
+#endif /* WATCH_H */
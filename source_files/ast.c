@@ -56,6 +56,7 @@ struct ast line_ast(char * line)
                             ast.ast_type = instruction;
                             ast.ast_options.ast_instruction.opCode = check_inst->opCode;
                             ast.ast_options.ast_instruction.funct = check_inst->funct;
+                            ast.ast_options.ast_instruction.instruction_index = check_inst - instruction_table;
 
                             /* Parse instruction operands */
                             parse_instruction_operands(&result.strings[contains_label + 1], result.strings_count - contains_label - 1, check_inst, &ast);
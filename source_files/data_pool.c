@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../header_files/data_pool.h"
+#include "../header_files/first_pass.h"
+#include "../header_files/memory_image.h"
+#include "../header_files/mem_alloc.h"
+#include "../header_files/diagnostics.h"
+#include "../header_files/options.h"
+
+#define TRUE 1
+#define FALSE 0
+#define FNV_OFFSET_BASIS 2166136261UL
+#define FNV_PRIME 16777619UL
+#define HASH_MASK 0xFFFFFFFFUL
+#define MIN_POOL_INDEX_SIZE 16
+#define EMPTY_SLOT 0
+
+
+static int compare_addresses(const void *a, const void *b) {
+       int first = *(const int *)a;
+       int second = *(const int *)b;
+
+       return (first > second) - (first < second);
+}
+
+
+static int compare_address_to_block(const void *address, const void *element) {
+       int first = *(const int *)address;
+       int second = ((const struct data_block *)element)->start;
+
+       return (first > second) - (first < second);
+}
+
+
+/* Data addresses of the data labels below dc, sorted and without repeats; NULL if memory ran out */
+static int *label_addresses(const struct translation_unit *prog, int dc, int *count) {
+       int *addresses = mem_malloc((prog->symCount > 0 ? prog->symCount : 1) * sizeof(int));
+       int i, kept;
+
+       if (!addresses)
+              return NULL;
+
+       *count = 0;
+       for (i = 0; i < prog->symCount; i++) {
+              if ((prog->symbol_table[i].symType == symData || prog->symbol_table[i].symType == symEntryData) &&
+                  prog->symbol_table[i].address < dc)
+                     addresses[(*count)++] = prog->symbol_table[i].address;
+       }
+
+       qsort(addresses, (size_t)*count, sizeof(int), compare_addresses);
+       for (i = 0, kept = 0; i < *count; i++) {
+              if (kept == 0 || addresses[kept - 1] != addresses[i])
+                     addresses[kept++] = addresses[i];
+       }
+       *count = kept;
+       return addresses;
+}
+
+
+/* FNV-1a over the words of a block */
+static unsigned long hash_block(struct memory_image *image, const struct data_block *block) {
+       unsigned long hash = FNV_OFFSET_BASIS;
+       int i;
+
+       for (i = 0; i < block->length; i++) {
+              hash ^= (unsigned long)(memory_read(image, block->start + i) & MEMORY_WORD_MASK);
+              hash = (hash * FNV_PRIME) & HASH_MASK;
+       }
+       return hash;
+}
+
+
+static int same_words(struct memory_image *image, const struct data_block *a, const struct data_block *b) {
+       int i;
+
+       if (a->hash != b->hash || a->length != b->length)
+              return FALSE;
+       for (i = 0; i < a->length; i++) {
+              if (memory_read(image, a->start + i) != memory_read(image, b->start + i))
+                     return FALSE;
+       }
+       return TRUE;
+}
+
+
+/* Marks the blocks an instruction stores to, from the written label operands the first pass kept */
+static void mark_written_blocks(struct translation_unit *prog, struct data_block *blocks, int count, int dc) {
+       struct symbol *symbol;
+       struct data_block *block;
+       int i;
+
+       for (i = 0; i < prog->reference_count; i++) {
+              if (!prog->references[i].written)
+                     continue;
+              symbol = symbolLookUp(prog->symbol_table, prog->symCount, prog->references[i].label);
+              if (!symbol || (symbol->symType != symData && symbol->symType != symEntryData) || symbol->address >= dc)
+                     continue;
+              block = bsearch(&symbol->address, blocks, (size_t)count, sizeof(struct data_block), compare_address_to_block);
+              if (block)
+                     block->written = TRUE;
+       }
+}
+
+
+/*
+ * Decides which blocks are kept, with an open-addressing index of the kept labeled
+ * blocks by hash, and gives every block its new address. Returns the new data size,
+ * or -1 if memory ran out.
+ */
+static int share_blocks(struct memory_image *image, struct data_block *blocks, int count, int first_labeled) {
+       int *index;
+       int size = MIN_POOL_INDEX_SIZE;
+       int new_dc = 0;
+       int slot;
+       int i;
+
+       while (size < count * 2)
+              size *= 2;
+       index = mem_calloc(size, sizeof(int));
+       if (!index)
+              return -1;
+
+       for (i = 0; i < count; i++) {
+              blocks[i].new_start = new_dc;
+              if (i >= first_labeled && !blocks[i].written) {
+                     blocks[i].hash = hash_block(image, &blocks[i]);
+                     slot = (int)(blocks[i].hash & (unsigned long)(size - 1));
+                     while (index[slot] != EMPTY_SLOT && !same_words(image, &blocks[index[slot] - 1], &blocks[i]))
+                            slot = (slot + 1) & (size - 1);
+
+                     if (index[slot] != EMPTY_SLOT) {
+                            /* An identical block is kept already: share its words */
+                            blocks[i].new_start = blocks[index[slot] - 1].new_start;
+                            blocks[i].shared = TRUE;
+                            continue;
+                     }
+                     index[slot] = i + 1;
+              }
+              new_dc += blocks[i].length;
+       }
+
+       mem_free(index);
+       return new_dc;
+}
+
+
+/* Packs the kept blocks into a new image; returns FALSE if memory ran out */
+static int pack_blocks(struct translation_unit *prog, const struct data_block *blocks, int count) {
+       struct memory_image packed;
+       int i, w;
+
+       memset(&packed, 0, sizeof(packed));
+       for (i = 0; i < count; i++) {
+              for (w = 0; w < blocks[i].length && !blocks[i].shared; w++) {
+                     if (!memory_write(&packed, blocks[i].new_start + w, memory_read(&prog->data_image, blocks[i].start + w))) {
+                            free_memory_image(&packed);
+                            return FALSE;
+                     }
+              }
+       }
+
+       free_memory_image(&prog->data_image);
+       prog->data_image = packed;
+       return TRUE;
+}
+
+
+/* With --listing: the new address of every old data address, -1 for the words of a dropped block */
+static int map_addresses(struct translation_unit *prog, const struct data_block *blocks, int count, int dc, int new_dc) {
+       int i, w;
+
+       prog->data_map = mem_malloc((dc + 1) * sizeof(int));
+       if (!prog->data_map)
+              return FALSE;
+
+       for (i = 0; i < count; i++) {
+              for (w = 0; w < blocks[i].length; w++)
+                     prog->data_map[blocks[i].start + w] = blocks[i].shared ? -1 : blocks[i].new_start + w;
+       }
+       prog->data_map[dc] = new_dc;
+       return TRUE;
+}
+
+
+int pool_data(struct translation_unit *prog, int *dc) {
+       struct data_block *blocks;
+       struct data_block *block;
+       int *labels;
+       int label_count;
+       int first_labeled;
+       int count;
+       int new_dc;
+       int i;
+
+       labels = label_addresses(prog, *dc, &label_count);
+       if (!labels) {
+              diag_report(DIAG_NO_MEMORY, NO_LINE, "data pool");
+              return TRUE;
+       }
+
+       /* Words before the first label form a block of their own, which is never shared */
+       first_labeled = (*dc > 0 && (label_count == 0 || labels[0] > 0)) ? 1 : 0;
+       count = first_labeled + label_count;
+       blocks = mem_calloc(count > 0 ? count : 1, sizeof(struct data_block));
+       if (!blocks) {
+              diag_report(DIAG_NO_MEMORY, NO_LINE, "data pool");
+              mem_free(labels);
+              return TRUE;
+       }
+       for (i = first_labeled; i < count; i++)
+              blocks[i].start = labels[i - first_labeled];
+       for (i = 0; i < count; i++)
+              blocks[i].length = (i + 1 < count ? blocks[i + 1].start : *dc) - blocks[i].start;
+       mem_free(labels);
+       mark_written_blocks(prog, blocks, count, *dc);
+
+       new_dc = share_blocks(&prog->data_image, blocks, count, first_labeled);
+       if (new_dc < 0 || (new_dc < *dc && (!pack_blocks(prog, blocks, count) ||
+                                           (options.listing && !map_addresses(prog, blocks, count, *dc, new_dc))))) {
+              diag_report(DIAG_NO_MEMORY, NO_LINE, "data pool");
+              mem_free(blocks);
+              return TRUE;
+       }
+
+       /* Every data label starts a block; a label past the last word stays at the end */
+       for (i = 0; i < prog->symCount; i++) {
+              if (prog->symbol_table[i].symType != symData && prog->symbol_table[i].symType != symEntryData)
+                     continue;
+              block = bsearch(&prog->symbol_table[i].address, blocks, (size_t)count, sizeof(struct data_block),
+                              compare_address_to_block);
+              prog->symbol_table[i].address = block ? block->new_start : new_dc;
+       }
+
+       prog->pooled_words = *dc - new_dc;
+       for (i = 0; i < count; i++)
+              prog->pooled_blocks += blocks[i].shared;
+       *dc = new_dc;
+
+       mem_free(blocks);
+       return FALSE;
+}
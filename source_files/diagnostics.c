@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../header_files/diagnostics.h"
+#include "../header_files/mem_alloc.h"
+
+
+struct diagnostics_sink diagnostics = {0};
+
+/* Message templates, indexed by enum diag_code. Each takes at most one %s. */
+static const char *diag_templates[NUMBER_OF_DIAG_CODES] = {
+       "syntax error: %s",
+       "redefinition of symbol \"%s\"",
+       "redefinition of label type: \"%s\"",
+       "symbol \"%s\" declared entry but was never defined",
+       "undefined label \"%s\"",
+       "undefined label(extern label) \"%s\"",
+       ".org %s is below the current instruction address",
+       ".incbin %s",
+       "code and data exceed the largest address %s",
+       "memory error: could not expand %s",
+       "could not open file %s",
+       "missing macro name after 'mcro'",
+       "extra characters after macro name '%s'",
+       "macro name conflicts with an instruction '%s'",
+       "invalid macro name '%s'",
+       "extra characters after 'mcroend' in macro definition",
+       "macro '%s' calls itself through nested macro calls",
+       "macro library %s",
+       "only macro definitions, comments and blank lines may appear in a macro library source",
+       "the symbol table needs more than %s of the memory budget",
+       "could not write or read back the temporary %s file",
+       ".include %s",
+       "cannot rebase: %s"
+};
+
+/* Machine-readable names of the codes, used in JSON output */
+static const char *diag_code_names[NUMBER_OF_DIAG_CODES] = {
+       "syntax",
+       "symbol-redefinition",
+       "label-type-redefinition",
+       "entry-never-defined",
+       "undefined-label",
+       "relative-extern",
+       "org-overlap",
+       "incbin",
+       "address-overflow",
+       "no-memory",
+       "open-failed",
+       "macro-missing-name",
+       "macro-extra-characters",
+       "macro-reserved-name",
+       "macro-invalid-name",
+       "mcroend-extra-characters",
+       "macro-recursion",
+       "macro-library",
+       "macro-library-line",
+       "memory-budget",
+       "spill-failed",
+       "include",
+       "rebase"
+};
+
+static const char *phase_names[NUMBER_OF_PHASES] = {
+       "preprocessor", "first_pass", "second_pass", "output"
+};
+
+/* Source extension each phase reads, so messages name the file the line belongs to */
+static const char *phase_extensions[NUMBER_OF_PHASES] = {
+       ".as", ".am", ".am", ""
+};
+
+
+void diag_configure(int max_errors, int json) {
+       diagnostics.max_errors = max_errors;
+       diagnostics.json = json;
+}
+
+
+void diag_begin_file(const char *base_name) {
+       diagnostics.base_name = base_name;
+       diagnostics.phase = PHASE_PREPROCESSOR;
+       diagnostics.file = NULL;
+       diagnostics.count = 0;
+       diagnostics.dropped = 0;
+       diagnostics.flushed = 0;
+}
+
+
+void diag_set_phase(enum diag_phase phase) {
+       diagnostics.phase = phase;
+}
+
+
+void diag_set_file(const char *file) {
+       diagnostics.file = file;
+}
+
+
+int diag_limit_reached(void) {
+       return diagnostics.max_errors > 0 && diagnostics.count >= diagnostics.max_errors;
+}
+
+
+struct diag_position diag_tell(void) {
+       struct diag_position position;
+
+       position.count = diagnostics.count;
+       position.dropped = diagnostics.dropped;
+       return position;
+}
+
+
+void diag_rewind(struct diag_position position) {
+       while (diagnostics.count > position.count) {
+              diagnostics.count--;
+              mem_free(diagnostics.records[diagnostics.count].argument);
+              mem_free(diagnostics.records[diagnostics.count].file);
+       }
+       diagnostics.dropped = position.dropped;
+}
+
+
+void diag_report(enum diag_code code, int line, const char *argument) {
+       struct diagnostic *record;
+
+       if (diag_limit_reached()) {
+              diagnostics.dropped++;
+              return;
+       }
+
+       if (!ensure_diagnostics_capacity(&diagnostics)) {
+              diagnostics.dropped++;
+              return;
+       }
+
+       record = &diagnostics.records[diagnostics.count];
+       record->phase = diagnostics.phase;
+       record->code = code;
+       record->line = line;
+       record->argument = NULL;
+       record->file = NULL;
+
+       if (argument) {
+              record->argument = mem_malloc(strlen(argument) + 1);
+              if (record->argument)
+                     strcpy(record->argument, argument);
+       }
+       if (diagnostics.file) {
+              record->file = mem_malloc(strlen(diagnostics.file) + 1);
+              if (record->file)
+                     strcpy(record->file, diagnostics.file);
+       }
+       diagnostics.count++;
+}
+
+
+/* Writes str as a JSON string literal */
+static void print_json_string(FILE *f, const char *str) {
+       fputc('"', f);
+       for (; *str; str++) {
+              switch (*str) {
+                     case '"':  fputs("\\\"", f); break;
+                     case '\\': fputs("\\\\", f); break;
+                     case '\n': fputs("\\n", f); break;
+                     case '\t': fputs("\\t", f); break;
+                     case '\r': fputs("\\r", f); break;
+                     default:
+                            if ((unsigned char)*str < ' ')
+                                   fprintf(f, "\\u%04x", (unsigned char)*str);
+                            else
+                                   fputc(*str, f);
+              }
+       }
+       fputc('"', f);
+}
+
+
+static void print_record(FILE *f, const struct diagnostic *record) {
+       const char *template = diag_templates[record->code];
+       const char *argument = record->argument ? record->argument : "";
+       char *message;
+       char *file_name;
+
+       /* The template has at most one %s, so this bounds the formatted length */
+       message = mem_malloc(strlen(template) + strlen(argument) + 1);
+       if (!message)
+              return;
+       sprintf(message, template, argument);
+
+       /* Lines of an included file are named after that file */
+       if (record->file)
+              file_name = build_filename(record->file, "");
+       else
+              file_name = build_filename(diagnostics.base_name, phase_extensions[record->phase]);
+
+       if (diagnostics.json) {
+              fputs("{\"file\":", f);
+              print_json_string(f, file_name ? file_name : diagnostics.base_name);
+              fprintf(f, ",\"line\":%d,\"phase\":\"%s\",\"code\":\"%s\",\"message\":",
+                      record->line, phase_names[record->phase], diag_code_names[record->code]);
+              print_json_string(f, message);
+              fputs("}\n", f);
+       }
+       else if (record->line != NO_LINE) {
+              fprintf(f, "%s:%d: error: %s\n", file_name ? file_name : diagnostics.base_name, record->line, message);
+       }
+       else {
+              fprintf(f, "%s: error: %s\n", file_name ? file_name : diagnostics.base_name, message);
+       }
+
+       mem_free(file_name);
+       mem_free(message);
+}
+
+
+int diag_flush(void) {
+       FILE *f = diagnostics.stream ? diagnostics.stream : stdout;
+       int total = diagnostics.flushed + diagnostics.count + diagnostics.dropped;
+       int i;
+
+       for (i = 0; i < diagnostics.count; i++) {
+              print_record(f, &diagnostics.records[i]);
+              mem_free(diagnostics.records[i].argument);
+              mem_free(diagnostics.records[i].file);
+       }
+
+       if (diagnostics.dropped > 0 && !diagnostics.json) {
+              fprintf(f, "%s: too many errors, %d more not shown (--max-errors %d)\n",
+                      diagnostics.base_name, diagnostics.dropped, diagnostics.max_errors);
+       }
+       fflush(f);
+
+       diagnostics.count = 0;
+       diagnostics.dropped = 0;
+       diagnostics.flushed = total;
+       return total;
+}
@@ -0,0 +1,81 @@
+#include "../header_files/encoding.h"
+#include "../header_files/second_pass.h"
+
+
+/* Addressing-mode field value; a missing operand leaves the field 0 */
+#define MODE_FIELD(mode) ((mode) == NO_OPERAND ? 0 : (mode))
+
+/* Immediate, direct and relative operands take an extra word; registers and missing operands do not */
+#define EXTRA_WORDS(mode) ((mode) < ast_register ? 1 : 0)
+
+/* An empty mask means the operand must be missing */
+#define ACCEPTS(mask, mode) ((mode) == NO_OPERAND ? (mask) == MODES_NONE : (((mask) >> (mode)) & 1))
+
+#define TEMPLATE(opcode, funct, src_modes, dest_modes, src, dest) \
+       { ((opcode) << OPCODE_SHIFT) | ((funct) << FUNCT_SHIFT) | \
+         (MODE_FIELD(src) << OPERAND_TYPE_SOURCE_SHIFT) | (MODE_FIELD(dest) << OPERAND_TYPE_DEST_SHIFT) | A, \
+         EXTRA_WORDS(src) + EXTRA_WORDS(dest), \
+         (ACCEPTS(src_modes, src) ? LEGAL_SOURCE : 0) | (ACCEPTS(dest_modes, dest) ? LEGAL_DEST : 0) }
+
+#define TEMPLATE_ROW(opcode, funct, src_modes, dest_modes, src) \
+       { TEMPLATE(opcode, funct, src_modes, dest_modes, src, ast_instant), \
+         TEMPLATE(opcode, funct, src_modes, dest_modes, src, ast_direct), \
+         TEMPLATE(opcode, funct, src_modes, dest_modes, src, ast_relative), \
+         TEMPLATE(opcode, funct, src_modes, dest_modes, src, ast_register), \
+         TEMPLATE(opcode, funct, src_modes, dest_modes, src, NO_OPERAND) }
+
+#define TEMPLATE_TABLE(name, opcode, funct, src_modes, dest_modes, operands) \
+       { TEMPLATE_ROW(opcode, funct, src_modes, dest_modes, ast_instant), \
+         TEMPLATE_ROW(opcode, funct, src_modes, dest_modes, ast_direct), \
+         TEMPLATE_ROW(opcode, funct, src_modes, dest_modes, ast_relative), \
+         TEMPLATE_ROW(opcode, funct, src_modes, dest_modes, ast_register), \
+         TEMPLATE_ROW(opcode, funct, src_modes, dest_modes, NO_OPERAND) },
+
+
+const struct encoding_template encoding_table[NUMBER_OF_INSTRACTIONS][NUMBER_OF_MODE_SLOTS][NUMBER_OF_MODE_SLOTS] = {
+       INSTRUCTION_LIST(TEMPLATE_TABLE)
+};
+
+
+const struct encoding_template *instruction_template(const struct ast *ast) {
+       int src = NO_OPERAND;
+       int dest = NO_OPERAND;
+
+       /* With two operands the first is the source; a single operand is always the destination */
+       if (ast->ast_options.ast_instruction.number_of_operands == 2) {
+              src = ast->ast_options.ast_instruction.oprand[0].oprand_type;
+              dest = ast->ast_options.ast_instruction.oprand[1].oprand_type;
+       }
+       else if (ast->ast_options.ast_instruction.number_of_operands == 1) {
+              dest = ast->ast_options.ast_instruction.oprand[0].oprand_type;
+       }
+
+       return &encoding_table[ast->ast_options.ast_instruction.instruction_index][src][dest];
+}
+
+
+int operand_legal(int instruction_index, int destination, int mode) {
+       /* The other slot is left empty; only the bit of this slot is read */
+       if (destination)
+              return (encoding_table[instruction_index][NO_OPERAND][mode].legal & LEGAL_DEST) != 0;
+       return (encoding_table[instruction_index][mode][NO_OPERAND].legal & LEGAL_SOURCE) != 0;
+}
+
+
+int instruction_first_word(const struct ast *ast) {
+       int word = instruction_template(ast)->first_word;
+
+       if (ast->ast_options.ast_instruction.number_of_operands == 2) {
+              if (ast->ast_options.ast_instruction.oprand[0].oprand_type == ast_register)
+                     word |= (ast->ast_options.ast_instruction.oprand[0].oprand_options.register_number << REG_SRC_SHIFT);
+              if (ast->ast_options.ast_instruction.oprand[1].oprand_type == ast_register)
+                     word |= (ast->ast_options.ast_instruction.oprand[1].oprand_options.register_number << REG_DEST_SHIFT);
+       }
+
+       /* A single operand is the destination */
+       if (ast->ast_options.ast_instruction.number_of_operands == 1 &&
+           ast->ast_options.ast_instruction.oprand[0].oprand_type == ast_register)
+              word |= (ast->ast_options.ast_instruction.oprand[0].oprand_options.register_number << REG_DEST_SHIFT);
+
+       return word;
+}
@@ -5,6 +5,11 @@
 #include "../header_files/ast.h"
 #include "../header_files/translation_unit.h"
 #include "../header_files/mem_alloc.h"
+#include "../header_files/diagnostics.h"
+#include "../header_files/encoding.h"
+#include "../header_files/options.h"
+#include "../header_files/parallel.h"
+#include "../header_files/data_pool.h"
 
 
 
@@ -20,156 +25,317 @@ void remove_newline(char *str) {
 
 
 
-int firstPass(struct translation_unit *prog, const char* amFileName, FILE *amFile) {
-        char line[MAX_LINE_LEN + 1] = {0};
-        int ic = 100, dc = 0;
-        int errorFlag = FALSE;
-        int lineC = 1;
-        int i;
-        struct ast line_struct = {0};
-        struct symbol *SymFind;
+/* Appends an event for the current line of a chunk, returns NULL if memory ran out */
+static struct first_pass_event *add_event(struct first_pass_chunk *chunk, enum first_pass_event_type type) {
+       struct first_pass_event *event;
 
-        while (fgets(line, sizeof(line), amFile)) {
-                remove_newline(line); 
-                line_struct = line_ast(line);
+       if (!ensure_chunk_events_capacity(chunk)) {
+              chunk->failed = TRUE;
+              return NULL;
+       }
 
-                /** If the line contains a syntax error, print it and skip to the next line */
-                if (line_struct.error != NULL && line_struct.error[0] != '\0') {
-                        printf("%s: line: %d: syntax error: %s\n", amFileName, lineC, line_struct.error);
-                        lineC++;
-                        errorFlag = TRUE;
-                        continue;
-                }
+       event = &chunk->events[chunk->event_count++];
+       event->type = type;
+       event->line = chunk->line_count;
+       event->code_offset = chunk->code_words;
+       event->data_offset = chunk->data_count + chunk->blob_words;
+       event->value = 0;
+       event->name[0] = '\0';
+       event->message = NULL;
+       memset(&event->blob, 0, sizeof(event->blob));
+       return event;
+}
 
-                if(line_struct.ast_type == comment || line_struct.ast_type == empty)
-                {
-                        lineC++;
+
+/* Adds a symbol event, copying the name out of the line buffer */
+static void add_symbol_event(struct first_pass_chunk *chunk, enum first_pass_event_type type, const char *name) {
+       struct first_pass_event *event = add_event(chunk, type);
+
+       if (event) {
+              strncpy(event->name, name, MAX_LABEL_LEN);
+              event->name[MAX_LABEL_LEN] = '\0';
+       }
+}
+
+
+/* Formats why an .incbin failed as the argument of its diagnostic, returns NULL if memory ran out */
+static char *incbin_message(const char *path, const char *error) {
+       char *message = mem_malloc(strlen(path) + strlen(error) + 5);
+
+       if (message)
+              sprintf(message, "\"%s\": %s", path, error);
+       return message;
+}
+
+
+/* TRUE if the instruction stores to its destination operand (sub, not, inc and dec share the opcodes below) */
+static int writes_destination(const struct ast *line_struct) {
+        switch (line_struct->ast_options.ast_instruction.opCode) {
+                case OP_MOV:
+                case OP_ADD:
+                case OP_LEA:
+                case OP_CLR:
+                case OP_RED:
+                        return TRUE;
+                default:
+                        return FALSE;
+        }
+}
+
+
+/*
+ * Keeps the label operands of an instruction for check_references(), even on a line
+ * with a syntax error. Without --check only the labels stored to are kept, for pool_data().
+ */
+static void add_references(struct first_pass_chunk *chunk, const struct ast *line_struct) {
+        struct symbol_reference *reference;
+        int written;
+        int type;
+        int i;
+
+        for (i = 0; i < line_struct->ast_options.ast_instruction.number_of_operands; i++) {
+                type = line_struct->ast_options.ast_instruction.oprand[i].oprand_type;
+                written = type == ast_direct && writes_destination(line_struct) &&
+                          i == line_struct->ast_options.ast_instruction.number_of_operands - 1;
+                if ((type != ast_direct && type != ast_relative) || (!options.check && !written))
                         continue;
+
+                if (!ensure_chunk_references_capacity(chunk)) {
+                        chunk->failed = TRUE;
+                        return;
                 }
-                /** Handle .extern directive: add symbol to the symbol table with address 0 */
-                if (line_struct.ast_type == directive &&
-                    line_struct.ast_options.ast_directive.directive_type == ast_extern) {
+                reference = &chunk->references[chunk->reference_count++];
+                reference->line = chunk->line_count;
+                reference->relative = (type == ast_relative);
+                reference->written = written;
+                strncpy(reference->label, line_struct->ast_options.ast_instruction.oprand[i].oprand_options.label, MAX_LINE_LEN);
+                reference->label[MAX_LINE_LEN] = '\0';
+        }
+}
 
-                        SymFind = symbolLookUp(prog->symbol_table, prog->symCount,
-                                line_struct.ast_options.ast_directive.directive_options.label);
 
-                        /** Add symbol only if it's not already in the table */
-                        if (!SymFind) 
-                        {
-                                if (!ensure_symbol_table_capacity(prog)) 
-                                {
-                                        printf("Memory error: Could not expand symbol table.\n");
-                                        errorFlag = TRUE;
-                                        break; 
-                                }
-                                strcpy(prog->symbol_table[prog->symCount].symName, line_struct.ast_options.ast_directive.directive_options.label);
-                                prog->symbol_table[prog->symCount].symType = symExtern;
-                                prog->symbol_table[prog->symCount].address = 0;
-                                prog->symCount++;
-                        }
+void first_pass_record_line(struct first_pass_chunk *chunk, struct ast *line_struct) {
+        struct first_pass_event *event;
+        const char *str;
+        const char *error;
+        int len;
+        int i;
 
-                        lineC++;
-                        continue;
-                } 
+        /** With --check, label operands are resolved after the merge instead of being encoded */
+        if ((options.check || (options.pool_data && !options.memory_budget)) && line_struct->ast_type == instruction)
+                add_references(chunk, line_struct);
+
+        /** A syntax error is reported when merging; the line is skipped */
+        if (line_struct->error != NULL && line_struct->error[0] != '\0') {
+                event = add_event(chunk, EVENT_SYNTAX_ERROR);
+                if (event)
+                        event->message = line_struct->error;
+                else
+                        mem_free(line_struct->error);
+                chunk->line_count++;
+                return;
+        }
+        mem_free(line_struct->error);
 
-                /** If the line contains a label, add it to the symbol table with appropriate type and address */
-                if (line_struct.label_name[0] != '\0' &&
-                    (line_struct.ast_type == instruction ||
-                     (line_struct.ast_type == directive &&
-                      (line_struct.ast_options.ast_directive.directive_type == ast_data ||
-                       line_struct.ast_options.ast_directive.directive_type == ast_string)))) {
+        if (line_struct->ast_type == comment || line_struct->ast_type == empty) {
+                chunk->line_count++;
+                return;
+        }
 
-                        SymFind = symbolLookUp(prog->symbol_table, prog->symCount, line_struct.label_name); 
+        /** .extern: the symbol is added when merging, if it is not in the table yet */
+        if (line_struct->ast_type == directive &&
+            line_struct->ast_options.ast_directive.directive_type == ast_extern) {
+                add_symbol_event(chunk, EVENT_EXTERN, line_struct->ast_options.ast_directive.directive_options.label);
+                chunk->line_count++;
+                return;
+        }
 
-                        if (SymFind) {
-                                /**
-                                 * If the symbol was previously marked as .entry,
-                                 * assign the correct type and update its address
-                                 */
-                                if (SymFind->symType == symEntry) {
-                                        SymFind->symType = (line_struct.ast_type == instruction) ? symEntryCode : symEntryData;
-                                        SymFind->address = (line_struct.ast_type == instruction) ? ic : dc;
-                                } else {
-                                        /** Otherwise, it's a redefinition error */
-                                        printf("%s: error in line %d redefinition of symbol: \"%s\"\n", amFileName, lineC, line_struct.label_name);
-                                        errorFlag = TRUE;
-                                }
-                        } 
-                        else {
-                                /** Add new symbol with appropriate type and address */
-                                if (!ensure_symbol_table_capacity(prog)) {
-                                        printf("Memory error: Could not expand symbol table.\n");
-                                        errorFlag = TRUE;
-                                        break;
-                                }
-                                strcpy(prog->symbol_table[prog->symCount].symName, line_struct.label_name);
-                                prog->symbol_table[prog->symCount].symType = (line_struct.ast_type == instruction) ? symCode : symData;
-                                prog->symbol_table[prog->symCount].address = (line_struct.ast_type == instruction) ? ic : dc;
-                                prog->symCount++;
-                        }
+        /** Labels of instructions and data get their address from the counters before the line */
+        if (line_struct->label_name[0] != '\0') {
+                if (line_struct->ast_type == instruction)
+                        add_symbol_event(chunk, EVENT_CODE_LABEL, line_struct->label_name);
+                else if (line_struct->ast_type == directive &&
+                         (line_struct->ast_options.ast_directive.directive_type == ast_data ||
+                          line_struct->ast_options.ast_directive.directive_type == ast_string ||
+                          line_struct->ast_options.ast_directive.directive_type == ast_incbin))
+                        add_symbol_event(chunk, EVENT_DATA_LABEL, line_struct->label_name);
+        }
+
+        /** Update instruction counter based on the type of operands */
+        if (line_struct->ast_type == instruction) {
+                /** One word for the instruction itself plus the extra words of its encoding template */
+                chunk->code_words += 1 + instruction_template(line_struct)->extra_words;
+        }
+
+        /** Handle .data directive: copy numeric values into the chunk's data words */
+        else if (line_struct->ast_type == directive &&
+                 line_struct->ast_options.ast_directive.directive_type == ast_data) {
+
+                len = line_struct->ast_options.ast_directive.directive_options.data.number_of_operands;
+                if (!ensure_chunk_data_capacity(chunk, len)) {
+                        chunk->failed = TRUE;
+                        return;
                 }
+                for (i = 0; i < len; i++) {
+                        chunk->data[chunk->data_count++] = line_struct->ast_options.ast_directive.directive_options.data.number[i];
+                }
+        }
 
-                /** Update instruction counter based on the type of operands */
-                if (line_struct.ast_type == instruction) {
-                        ic++; /** One word for the instruction itself */
-                        if(line_struct.ast_options.ast_instruction.number_of_operands > 0)
-                                ic += (line_struct.ast_options.ast_instruction.oprand[0].oprand_type < ast_register);
-                        if(line_struct.ast_options.ast_instruction.number_of_operands > 1)
-                                ic += (line_struct.ast_options.ast_instruction.oprand[1].oprand_type < ast_register);
-                        
+        else if (line_struct->ast_type == directive &&
+                line_struct->ast_options.ast_directive.directive_type == ast_string) {
+
+                /* Extract the string from the AST node */
+                str = line_struct->ast_options.ast_directive.directive_options.string;
+                len = strlen(str);
+
+                /* Copy characters of the string (excluding the quotation marks) and a null terminator */
+                if (!ensure_chunk_data_capacity(chunk, len)) {
+                        chunk->failed = TRUE;
+                        return;
                 }
+                for (i = 1; i <= len - 1; i++) /* skipping the opening quotation mark */
+                {
+                        chunk->data[chunk->data_count++] = (i < len - 1) ? (int)str[i] : 0;
+                }
+        }
 
-                /** Handle .data directive: copy numeric values into the data image */
-                else if (line_struct.ast_type == directive &&
-                         line_struct.ast_options.ast_directive.directive_type == ast_data) {
+        /* .org depends on the instruction address, which is only known when merging */
+        else if (line_struct->ast_type == directive &&
+                line_struct->ast_options.ast_directive.directive_type == ast_org) {
+                event = add_event(chunk, EVENT_ORG);
+                if (event)
+                        event->value = line_struct->ast_options.ast_directive.directive_options.address;
 
-                        memcpy(&prog->data_image[prog->DC],
-                               line_struct.ast_options.ast_directive.directive_options.data.number,
-                               line_struct.ast_options.ast_directive.directive_options.data.number_of_operands * sizeof(int));
-                        dc += line_struct.ast_options.ast_directive.directive_options.data.number_of_operands;
-                        prog->DC = dc;
+                /* A label on the line names the new address, so it comes after the move */
+                if (line_struct->label_name[0] != '\0')
+                        add_symbol_event(chunk, EVENT_CODE_LABEL, line_struct->label_name);
+        }
+
+        /* .incbin: the file is mapped here and its words are copied to the data image when merging */
+        else if (line_struct->ast_type == directive &&
+                line_struct->ast_options.ast_directive.directive_type == ast_incbin) {
+                event = add_event(chunk, EVENT_INCBIN);
+                if (event && !incbin_open(&event->blob,
+                                          line_struct->ast_options.ast_directive.directive_options.incbin.path,
+                                          line_struct->ast_options.ast_directive.directive_options.incbin.offset,
+                                          line_struct->ast_options.ast_directive.directive_options.incbin.length,
+                                          &error)) {
+                        event->message = incbin_message(line_struct->ast_options.ast_directive.directive_options.incbin.path, error);
+                        if (!event->message)
+                                chunk->failed = TRUE;
+                }
+                else if (event) {
+                        chunk->blob_words += event->blob.words;
                 }
+        }
+
+        else if (line_struct->ast_type == directive &&
+                line_struct->ast_options.ast_directive.directive_type == ast_entry) {
+                add_symbol_event(chunk, EVENT_ENTRY, line_struct->ast_options.ast_directive.directive_options.label);
+        }
 
-                else if (line_struct.ast_type == directive &&
-                        line_struct.ast_options.ast_directive.directive_type == ast_string) {
+        chunk->line_count++;
+}
 
-                        /* Extract the string from the AST node */
-                        const char *str = line_struct.ast_options.ast_directive.directive_options.string;
-                        int len = strlen(str);
-                        int i;
 
-                        /* Copy characters of the string (excluding the quotation marks) into the data image */
-                        for (i = 1; i < len - 1; i++) /* skipping the quotation marks */ 
-                        {
-                                if (prog->DC >= MAX_MEMORY_SIZE) {
-                                        printf("%s:%d: Error: Data memory overflow while handling .string\n", amFileName, lineC);
-                                        errorFlag = TRUE;
-                                        break;
+/*
+ * Parses the lines of one chunk. Runs on a worker thread: it only touches the chunk,
+ * so symbols and diagnostics are left as events for merge_first_pass_chunks().
+ */
+static void parse_chunk(void *task) {
+        struct first_pass_chunk *chunk = task;
+        char line[MAX_LINE_LEN + 1];
+        size_t position = chunk->begin;
+        struct ast line_struct;
+
+        while (position < chunk->end && !chunk->failed) {
+                position = next_source_line(chunk->source, position, line);
+                remove_newline(line);
+                line_struct = line_ast(line);
+                first_pass_record_line(chunk, &line_struct);
+        }
+}
+
+
+/* Adds a symbol to the table, returns FALSE if memory ran out */
+static int add_symbol(struct translation_unit *prog, const char *name, int type, int address) {
+        if (!ensure_symbol_table_capacity(prog))
+                return FALSE;
+
+        strcpy(prog->symbol_table[prog->symCount].symName, name);
+        prog->symbol_table[prog->symCount].symType = type;
+        prog->symbol_table[prog->symCount].address = address;
+        prog->symCount++;
+        return TRUE;
+}
+
+
+/*
+ * Applies one event to the symbol table. *ic is the instruction address of the event's
+ * line and dc its data address. Returns TRUE if an error was found.
+ */
+static int apply_event(struct translation_unit *prog, const struct first_pass_event *event, int lineC, int *ic, int dc) {
+        struct symbol *SymFind;
+        char number[MAX_LINE_LEN + 1];
+
+        switch (event->type) {
+                case EVENT_SYNTAX_ERROR:
+                        diag_report(DIAG_SYNTAX, lineC, event->message);
+                        return TRUE;
+
+                /** Handle .extern directive: add symbol to the symbol table with address 0 */
+                case EVENT_EXTERN:
+                        /** Add symbol only if it's not already in the table */
+                        if (!symbolLookUp(prog->symbol_table, prog->symCount, event->name))
+                                return !add_symbol(prog, event->name, symExtern, 0);
+                        return FALSE;
+
+                /** A labeled instruction or data line: add the label with the matching type and address */
+                case EVENT_CODE_LABEL:
+                case EVENT_DATA_LABEL:
+                        SymFind = symbolLookUp(prog->symbol_table, prog->symCount, event->name);
+
+                        if (SymFind) {
+                                /**
+                                 * If the symbol was previously marked as .entry,
+                                 * assign the correct type and update its address
+                                 */
+                                if (SymFind->symType == symEntry) {
+                                        SymFind->symType = (event->type == EVENT_CODE_LABEL) ? symEntryCode : symEntryData;
+                                        SymFind->address = (event->type == EVENT_CODE_LABEL) ? *ic : dc;
+                                        return FALSE;
                                 }
-                                prog->data_image[prog->DC++] = (int)str[i];
-                                dc++;
+                                /** Otherwise, it's a redefinition error */
+                                diag_report(DIAG_SYMBOL_REDEFINITION, lineC, event->name);
+                                return TRUE;
                         }
-
-                        /* Add null terminator at the end of the string */
-                        if (prog->DC < MAX_MEMORY_SIZE) 
-                        {
-                                prog->data_image[prog->DC++] = 0;
-                                dc++;
-                        } 
-                        else 
-                        {
-                                printf("%s:%d: Error: No space for null terminator in .string\n", amFileName, lineC);
-                                errorFlag = TRUE;
+                        /** Add new symbol with appropriate type and address */
+                        return !add_symbol(prog, event->name,
+                                           (event->type == EVENT_CODE_LABEL) ? symCode : symData,
+                                           (event->type == EVENT_CODE_LABEL) ? *ic : dc);
+
+                /* An .incbin whose file could not be loaded; its words are copied when the chunk is merged */
+                case EVENT_INCBIN:
+                        if (event->message) {
+                                diag_report(DIAG_INCBIN, lineC, event->message);
+                                return TRUE;
                         }
-                }
+                        return FALSE;
+
+                /* Handle .org directive: move the instruction counter forward to a fixed address */
+                case EVENT_ORG:
+                        if (event->value < *ic) {
+                                /* Moving backwards could overlap instructions that were already placed */
+                                sprintf(number, "%d", event->value);
+                                diag_report(DIAG_ORG_OVERLAP, lineC, number);
+                                return TRUE;
+                        }
+                        *ic = event->value;
+                        return FALSE;
 
                 /* Handle .entry directive: mark the symbol as entry if already in the table, or add it */
-                else if (line_struct.ast_type == directive &&
-                        line_struct.ast_options.ast_directive.directive_type == ast_entry) {
-
-                        /* Look up the symbol in the symbol table */
-                        SymFind = symbolLookUp(prog->symbol_table, prog->symCount,
-                                        line_struct.ast_options.ast_directive.directive_options.label);
+                case EVENT_ENTRY:
+                        SymFind = symbolLookUp(prog->symbol_table, prog->symCount, event->name);
 
                         if (SymFind) {
                                 /* Update the symbol type if it was previously defined as code or data */
@@ -179,44 +345,227 @@ int firstPass(struct translation_unit *prog, const char* amFileName, FILE *amFil
                                         SymFind->symType = symEntryData;
                                 } else {
                                         /* Error: .entry redefinition on existing entry or extern */
-                                        printf("%s: error in line %d redefinition of label type: \"%s\"\n",
-                                        amFileName, lineC,
-                                        line_struct.ast_options.ast_directive.directive_options.label);
-                                        errorFlag = TRUE;
-                                }
-                        } 
-                        else {
-                                /* If not found, add the symbol as an entry with no address yet */
-                                if (!ensure_symbol_table_capacity(prog)) 
-                                {
-                                        printf("Memory error: Could not expand symbol table.\n");
-                                        errorFlag = TRUE;
-                                        break; 
+                                        diag_report(DIAG_LABEL_TYPE_REDEFINITION, lineC, event->name);
+                                        return TRUE;
                                 }
-                                strcpy(prog->symbol_table[prog->symCount].symName,
-                                line_struct.ast_options.ast_directive.directive_options.label);
-                                prog->symbol_table[prog->symCount].symType = symEntry;
-                                prog->symCount++;
+                                return FALSE;
                         }
-                
+                        /* If not found, add the symbol as an entry with no address yet */
+                        return !add_symbol(prog, event->name, symEntry, 0);
+        }
+
+        return FALSE;
+}
+
+
+/*
+ * Writes the data words of a chunk to the data image from address dc: the parsed
+ * words in order, with the words of every .incbin placed where its line was.
+ * Returns FALSE if memory ran out.
+ */
+static int copy_chunk_data(struct translation_unit *prog, const struct first_pass_chunk *chunk, int dc) {
+        const struct first_pass_event *event;
+        int parsed = 0;   /* Words of chunk->data copied */
+        int placed = 0;   /* Data words of the chunk copied, .incbin words included */
+        int end;
+        int e;
+
+        for (e = 0; e <= chunk->event_count; e++) {
+                event = (e < chunk->event_count) ? &chunk->events[e] : NULL;
+                if (event && (event->type != EVENT_INCBIN || event->blob.words == 0))
+                        continue;
+
+                /* Parsed words up to the .incbin, or up to the end of the chunk */
+                end = event ? event->data_offset : chunk->data_count + chunk->blob_words;
+                for (; placed < end; placed++, parsed++) {
+                        if (!memory_write(&prog->data_image, dc + placed, chunk->data[parsed]))
+                                return FALSE;
                 }
 
-                lineC++;
+                if (event) {
+                        if (!memory_write_bytes(&prog->data_image, dc + placed, event->blob.bytes, event->blob.words))
+                                return FALSE;
+                        placed += event->blob.words;
+                }
+        }
+        return TRUE;
+}
+
+
+/* Splits the source into up to options.jobs chunks of whole lines */
+static struct first_pass_chunk *split_source(const struct source_text *source, int *chunk_count) {
+        struct first_pass_chunk *chunks;
+        size_t begin = 0;
+        int count = (options.jobs > 1) ? options.jobs : 1;
+        int i;
+
+        if ((size_t)count > source->length / MIN_CHUNK_SIZE)
+                count = (int)(source->length / MIN_CHUNK_SIZE);
+        if (count < 1)
+                count = 1;
+
+        chunks = mem_calloc(count, sizeof(struct first_pass_chunk));
+        if (!chunks) {
+                diag_report(DIAG_NO_MEMORY, NO_LINE, "first pass chunks");
+                return NULL;
+        }
+
+        for (i = 0; i < count; i++) {
+                chunks[i].source = source;
+                chunks[i].begin = begin;
+                chunks[i].end = (i == count - 1) ? source->length
+                                                  : source_line_boundary(source, source->length / count * (i + 1));
+                begin = chunks[i].end;
+        }
+
+        *chunk_count = count;
+        return chunks;
+}
+
+
+int firstPass(struct translation_unit *prog, const char* amFileName, const struct source_text *source) {
+        struct first_pass_chunk *chunks;
+        int chunk_count;
+
+        chunks = split_source(source, &chunk_count);
+        if (!chunks)
+                return TRUE;
+
+        /** Parse all chunks at once; each one only needs its own lines */
+        parallel_run(parse_chunk, chunks, sizeof(struct first_pass_chunk), chunk_count);
+
+        return merge_first_pass_chunks(prog, chunks, chunk_count);
+}
+
+
+void first_pass_merge_start(struct first_pass_merge *merge) {
+        merge->ic = STARTING_ADDRESS;
+        merge->dc = 0;
+        merge->line = 1;
+}
+
+
+int merge_first_pass_chunk(struct translation_unit *prog, const struct first_pass_chunk *chunk, struct first_pass_merge *merge) {
+        const struct first_pass_event *event;
+        int errorFlag = FALSE;
+        int base = merge->ic;
+        int base_offset = 0;
+        int ic;
+        int e, r;
+
+        if (chunk->failed) {
+                diag_report(DIAG_NO_MEMORY, NO_LINE, "first pass chunk");
+                errorFlag = TRUE;
+        }
+
+        /**
+         * Inside a chunk the address of an event is base + (code_offset - base_offset),
+         * where base is rebased by every .org.
+         */
+        for (e = 0; e < chunk->event_count && !diag_limit_reached(); e++) {
+                event = &chunk->events[e];
+                ic = base + event->code_offset - base_offset;
+                errorFlag |= apply_event(prog, event, merge->line + event->line, &ic, merge->dc + event->data_offset);
+                base = ic;
+                base_offset = event->code_offset;
+        }
+
+        /** Label operands wait for the whole symbol table (--check) */
+        if (chunk->reference_count > 0) {
+                if (ensure_references_capacity(prog, chunk->reference_count)) {
+                        for (r = 0; r < chunk->reference_count; r++) {
+                                prog->references[prog->reference_count] = chunk->references[r];
+                                prog->references[prog->reference_count++].line += merge->line;
+                        }
+                }
+                else {
+                        errorFlag = TRUE;
+                }
+        }
+
+        merge->ic = base + chunk->code_words - base_offset;
+        merge->dc += chunk->data_count + chunk->blob_words;
+        merge->line += chunk->line_count;
+        prog->IC += chunk->code_words;
+        return errorFlag;
+}
+
+
+int merge_first_pass_chunks(struct translation_unit *prog, struct first_pass_chunk *chunks, int chunk_count) {
+        struct first_pass_merge merge;
+        int errorFlag = FALSE;
+        int c;
+
+        prog->chunk_count = chunk_count;
+        prog->chunks = mem_malloc(prog->chunk_count * sizeof(struct source_chunk));
+        if (!prog->chunks) {
+                diag_report(DIAG_NO_MEMORY, NO_LINE, "first pass chunks");
+                prog->chunk_count = 0;
+                for (c = 0; c < chunk_count; c++)
+                        free_first_pass_chunk(&chunks[c]);
+                mem_free(chunks);
+                return TRUE;
+        }
+
+        /** Merge the chunks in order; the running counters are a prefix sum of the chunk sizes */
+        first_pass_merge_start(&merge);
+        for (c = 0; c < prog->chunk_count; c++) {
+                prog->chunks[c].begin = chunks[c].begin;
+                prog->chunks[c].end = chunks[c].end;
+                prog->chunks[c].first_line = merge.line;
+                prog->chunks[c].first_address = merge.ic;
+                prog->chunks[c].first_data = merge.dc;
+                prog->chunks[c].first_word = prog->IC;
+
+                errorFlag |= merge_first_pass_chunk(prog, &chunks[c], &merge);
+
+                /** Copy the chunk's data words after those of the earlier chunks */
+                if (!copy_chunk_data(prog, &chunks[c], prog->chunks[c].first_data)) {
+                        diag_report(DIAG_NO_MEMORY, NO_LINE, "data image");
+                        errorFlag = TRUE;
+                }
+        }
+
+        for (c = 0; c < prog->chunk_count; c++)
+                free_first_pass_chunk(&chunks[c]);
+        mem_free(chunks);
+
+        /** Identical data blocks are stored once, before the address space is checked */
+        if (options.pool_data)
+                errorFlag |= pool_data(prog, &merge.dc);
+
+        return finish_first_pass(prog, &merge) | errorFlag;
+}
+
+
+int finish_first_pass(struct translation_unit *prog, const struct first_pass_merge *merge) {
+        int errorFlag = FALSE;
+        int i;
+        char number[MAX_LINE_LEN + 1];
+
+        prog->DC = merge->dc;
+        prog->line_count = merge->line - 1;
+
+        /** Code and data must fit in the address space an operand word can reference */
+        if (merge->ic + merge->dc - 1 > MAX_ADDRESS) {
+                sprintf(number, "%d", MAX_ADDRESS);
+                diag_report(DIAG_ADDRESS_OVERFLOW, NO_LINE, number);
+                errorFlag = TRUE;
         }
+        prog->ICF = merge->ic;
 
         /** Final pass over the symbol table after reading all lines */
         for (i = 0; i < prog->symCount; i++) {
                 /** If a symbol was marked as .entry but never defined, raise an error */
                 if (prog->symbol_table[i].symType == symEntry) {
-                        printf("%s: error symbol: \"%s\" declared entry but was never defined.\n",
-                               amFileName, prog->symbol_table[i].symName);
+                        diag_report(DIAG_ENTRY_NEVER_DEFINED, NO_LINE, prog->symbol_table[i].symName);
                         errorFlag = TRUE;
                 }
 
                 /** For data symbols, add IC to shift them after the code segment */
                 if (prog->symbol_table[i].symType == symData ||
                     prog->symbol_table[i].symType == symEntryData) {
-                        prog->symbol_table[i].address += ic;
+                        prog->symbol_table[i].address += merge->ic;
                 }
 
                 /** Add all valid entry symbols to the entry list */
@@ -224,7 +573,6 @@ int firstPass(struct translation_unit *prog, const char* amFileName, FILE *amFil
                     {
                         if (!ensure_entries_capacity(prog)) 
                         {
-                                printf("Memory error: Could not expand entries array.\n");
                                 errorFlag = TRUE;
                                 break; 
                         }
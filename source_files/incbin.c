@@ -0,0 +1,114 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "../header_files/incbin.h"
+#include "../header_files/memory_image.h"
+#include "../header_files/translation_unit.h"
+
+
+/* Checks a range against the size of the file, returns its number of words or -1 */
+static long range_words(long size, long offset, long length, const char **error) {
+       long available;
+
+       if (offset > size) {
+              *error = "offset beyond the end of the file";
+              return -1;
+       }
+       available = size - offset;
+
+       if (length == INCBIN_TO_END) {
+              if (available % MEMORY_WORD_BYTES != 0) {
+                     *error = "file does not end on a whole word";
+                     return -1;
+              }
+              length = available / MEMORY_WORD_BYTES;
+       }
+       else if (length > available / MEMORY_WORD_BYTES) {
+              *error = "length beyond the end of the file";
+              return -1;
+       }
+
+       /* More words than addresses can never fit, and would not fit in an int */
+       if (length > MAX_ADDRESS + 1L) {
+              *error = "more words than the address space holds";
+              return -1;
+       }
+       return length;
+}
+
+
+int incbin_measure(const char *path, long offset, long length, int *words, const char **error) {
+       struct stat status;
+       long count;
+
+       if (stat(path, &status) != 0 || !S_ISREG(status.st_mode)) {
+              *error = "could not open file";
+              return 0;
+       }
+
+       count = range_words((long)status.st_size, offset, length, error);
+       if (count < 0)
+              return 0;
+       *words = (int)count;
+       return 1;
+}
+
+
+int incbin_open(struct incbin *blob, const char *path, long offset, long length, const char **error) {
+       struct stat status;
+       long count;
+       long page = sysconf(_SC_PAGESIZE);
+       long map_offset;
+       void *map;
+       int fd;
+
+       memset(blob, 0, sizeof(*blob));
+
+       fd = open(path, O_RDONLY);
+       if (fd < 0) {
+              *error = "could not open file";
+              return 0;
+       }
+       if (fstat(fd, &status) != 0 || !S_ISREG(status.st_mode)) {
+              close(fd);
+              *error = "could not open file";
+              return 0;
+       }
+
+       count = range_words((long)status.st_size, offset, length, error);
+       if (count <= 0) {
+              close(fd);
+              return count == 0;
+       }
+
+       /* The mapping has to start on a page boundary; only the pages of the range are mapped */
+       if (page <= 0)
+              page = 1;
+       map_offset = offset - offset % page;
+       blob->map_length = (size_t)(offset - map_offset) + (size_t)count * MEMORY_WORD_BYTES;
+       map = mmap(NULL, blob->map_length, PROT_READ, MAP_PRIVATE, fd, (off_t)map_offset);
+       close(fd);
+       if (map == MAP_FAILED) {
+              memset(blob, 0, sizeof(*blob));
+              *error = "could not map file";
+              return 0;
+       }
+
+       blob->map = map;
+       blob->bytes = (const unsigned char *)map + (offset - map_offset);
+       blob->words = (int)count;
+       return 1;
+}
+
+
+void incbin_close(struct incbin *blob) {
+       if (blob->map)
+              munmap(blob->map, blob->map_length);
+       memset(blob, 0, sizeof(*blob));
+}
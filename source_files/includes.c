@@ -0,0 +1,256 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "../header_files/includes.h"
+#include "../header_files/preprocessor.h"
+#include "../header_files/mem_alloc.h"
+#include "../header_files/diagnostics.h"
+
+#define INCLUDE_DIRECTIVE ".include"
+#define INCLUDE_DIRECTIVE_SIZE 8
+
+
+static include_observer observer = NULL;
+
+
+int is_include_directive(const char *trimmed_line) {
+       char next = trimmed_line[INCLUDE_DIRECTIVE_SIZE];
+
+       return strncmp(trimmed_line, INCLUDE_DIRECTIVE, INCLUDE_DIRECTIVE_SIZE) == STRCMP_TRUE &&
+              (next == '\0' || next == '"' || isspace((unsigned char)next));
+}
+
+
+/* Reports a problem with the directive on the current line, as "\"name\": problem" if a name is known */
+static void report_include(int line, const char *name, const char *problem) {
+       char *message = NULL;
+
+       if (name) {
+              message = mem_malloc(strlen(name) + strlen(problem) + 5);
+              if (message)
+                     sprintf(message, "\"%s\": %s", name, problem);
+       }
+       diag_report(DIAG_INCLUDE, line, message ? message : problem);
+       mem_free(message);
+}
+
+
+/* Adds a file to the list of files read; the path is taken over */
+static int add_file(struct include_state *state, char *path, const struct stat *status) {
+       if (!ensure_included_files_capacity(state))
+              return FALSE;
+
+       state->files[state->file_count].path = path;
+       state->files[state->file_count].device = (unsigned long)status->st_dev;
+       state->files[state->file_count].inode = (unsigned long)status->st_ino;
+       state->file_count++;
+       return TRUE;
+}
+
+
+int includes_begin(struct include_state *state, const char *as_file_name) {
+       struct stat status;
+       char *path = mem_malloc(strlen(as_file_name) + 1);
+
+       if (!path) {
+              diag_report(DIAG_NO_MEMORY, NO_LINE, "include list");
+              return FALSE;
+       }
+       strcpy(path, as_file_name);
+
+       /* A missing .as file is reported when it is opened; it just cannot be included again */
+       if (stat(as_file_name, &status) != 0)
+              memset(&status, 0, sizeof(status));
+
+       if (!add_file(state, path, &status)) {
+              mem_free(path);
+              return FALSE;
+       }
+       state->current = 0;
+       return TRUE;
+}
+
+
+/* Extracts the quoted file name of the directive into name, which holds LINE_MAX_LEN characters */
+static int directive_file_name(char *trimmed_line, char *name, int line) {
+       char *start = skip_leading_whitespace(trimmed_line + INCLUDE_DIRECTIVE_SIZE);
+       char *end;
+
+       if (*start != '"' || (end = strchr(start + 1, '"')) == NULL || end == start + 1) {
+              report_include(line, NULL, "expects a file name in double quotes");
+              return FALSE;
+       }
+
+       memcpy(name, start + 1, end - start - 1);
+       name[end - start - 1] = '\0';
+
+       if (*skip_leading_whitespace(end + 1) != '\0') {
+              report_include(line, name, "extra characters after the file name");
+              return FALSE;
+       }
+       return TRUE;
+}
+
+
+/* Names a file relative to the directory of the including file, unless the name is absolute */
+static char *resolve_path(const char *including_path, const char *name) {
+       const char *slash = strrchr(including_path, '/');
+       size_t directory = (name[0] != '/' && slash) ? (size_t)(slash - including_path + 1) : 0;
+       char *path = mem_malloc(directory + strlen(name) + 1);
+
+       if (!path)
+              return NULL;
+       memcpy(path, including_path, directory);
+       strcpy(path + directory, name);
+       return path;
+}
+
+
+int include_open(struct include_state *state, char *trimmed_line, FILE **input, int *line_counter) {
+       char name[LINE_MAX_LEN];
+       struct stat status;
+       char *path;
+       FILE *file;
+       int i;
+
+       if (!directive_file_name(trimmed_line, name, *line_counter))
+              return FALSE;
+
+       path = resolve_path(state->files[state->current].path, name);
+       if (!path) {
+              diag_report(DIAG_NO_MEMORY, *line_counter, "include list");
+              return FALSE;
+       }
+
+       if (stat(path, &status) != 0 || !S_ISREG(status.st_mode)) {
+              report_include(*line_counter, path, "could not open file");
+              mem_free(path);
+              return FALSE;
+       }
+
+       /* Once only: a file that was read before adds nothing */
+       for (i = 0; i < state->file_count; i++) {
+              if (state->files[i].device == (unsigned long)status.st_dev &&
+                  state->files[i].inode == (unsigned long)status.st_ino) {
+                     mem_free(path);
+                     return TRUE;
+              }
+       }
+
+       if (state->depth + 1 >= MAX_INCLUDE_DEPTH) {
+              report_include(*line_counter, path, "files are nested too deeply");
+              mem_free(path);
+              return FALSE;
+       }
+
+       file = fopen(path, "r");
+       if (!file) {
+              report_include(*line_counter, path, "could not open file");
+              mem_free(path);
+              return FALSE;
+       }
+
+       if (!ensure_include_frames_capacity(state) || !add_file(state, path, &status)) {
+              fclose(file);
+              mem_free(path);
+              return FALSE;
+       }
+
+       state->frames[state->depth].file = *input;
+       state->frames[state->depth].line = *line_counter;
+       state->frames[state->depth].current = state->current;
+       state->depth++;
+
+       state->current = state->file_count - 1;
+       diag_set_file(path);
+       *input = file;
+       *line_counter = 0;
+       return TRUE;
+}
+
+
+int include_close(struct include_state *state, FILE **input, int *line_counter) {
+       if (state->depth == 0)
+              return FALSE;
+
+       fclose(*input);
+       state->depth--;
+       *input = state->frames[state->depth].file;
+       *line_counter = state->frames[state->depth].line;
+       state->current = state->frames[state->depth].current;
+
+       diag_set_file(state->current == 0 ? NULL : state->files[state->current].path);
+       return TRUE;
+}
+
+
+/* Writes a file name as make reads it: spaces, '#' and '$' are escaped */
+static void print_make_name(FILE *f, const char *name) {
+       for (; *name != '\0'; name++) {
+              if (*name == ' ' || *name == '#')
+                     fputc('\\', f);
+              else if (*name == '$')
+                     fputc('$', f);
+              fputc(*name, f);
+       }
+}
+
+
+int write_dependency_file(const char *base_name, const struct include_state *state) {
+       char *d_file_name = build_filename(base_name, ".d");
+       char *targets[2];
+       FILE *f;
+       int i;
+
+       targets[0] = build_filename(base_name, ".am");
+       targets[1] = build_filename(base_name, ".ob");
+       if (!d_file_name || !targets[0] || !targets[1]) {
+              diag_report(DIAG_NO_MEMORY, NO_LINE, "file name");
+              f = NULL;
+       }
+       else if ((f = fopen(d_file_name, "w")) == NULL) {
+              diag_report(DIAG_OPEN_FAILED, NO_LINE, d_file_name);
+       }
+
+       if (f) {
+              /* The outputs depend on the .as file and everything it included */
+              print_make_name(f, targets[0]);
+              fputc(' ', f);
+              print_make_name(f, targets[1]);
+              fputc(':', f);
+              for (i = 0; i < state->file_count; i++) {
+                     fputs(" \\\n ", f);
+                     print_make_name(f, state->files[i].path);
+              }
+              fputc('\n', f);
+
+              /* An empty rule per included file, so deleting one does not break the build */
+              for (i = 1; i < state->file_count; i++) {
+                     fputc('\n', f);
+                     print_make_name(f, state->files[i].path);
+                     fputs(":\n", f);
+              }
+              fclose(f);
+       }
+
+       mem_free(d_file_name);
+       mem_free(targets[0]);
+       mem_free(targets[1]);
+       return f != NULL;
+}
+
+
+void includes_set_observer(include_observer new_observer) {
+       observer = new_observer;
+}
+
+
+void includes_end(const struct include_state *state) {
+       if (observer && state->file_count > 0)
+              observer(state);
+}
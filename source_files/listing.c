@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../header_files/listing.h"
+#include "../header_files/translation_unit.h"
+#include "../header_files/source_text.h"
+#include "../header_files/mem_alloc.h"
+#include "../header_files/diagnostics.h"
+#include "../header_files/output.h"
+#include "../header_files/first_pass.h"
+
+#define INDEX_HEADER_MAGIC "AIDX"
+#define LISTING_WORDS_PER_ROW 3
+
+
+int line_map_record(struct line_map *map, const char *text, size_t length, int line, int macro) {
+       size_t i;
+
+       for (i = 0; i < length; i++) {
+              /* The first character of a line opens a new .am line */
+              if (!map->open_line) {
+                     if (!ensure_line_map_capacity(map))
+                            return 0;
+                     map->lines[map->count].line = line;
+                     map->lines[map->count].macro = macro;
+                     map->lines[map->count].file = map->file;
+                     map->count++;
+                     map->open_line = TRUE;
+              }
+              if (text[i] == '\n')
+                     map->open_line = FALSE;
+       }
+       return 1;
+}
+
+
+int line_map_macro(struct line_map *map, const char *name) {
+       int i;
+
+       for (i = map->macro_count - 1; i >= 0; i--) {
+              if (strcmp(map->macros[i], name) == STRCMP_TRUE)
+                     return i;
+       }
+
+       if (!ensure_line_map_macros_capacity(map))
+              return NO_MACRO;
+       strcpy(map->macros[map->macro_count], name);
+       return map->macro_count++;
+}
+
+
+int line_map_file(struct line_map *map, const char *path) {
+       int i;
+
+       for (i = 0; i < map->file_count; i++) {
+              if (strcmp(map->files[i], path) == STRCMP_TRUE)
+                     return i + 1;
+       }
+
+       if (!ensure_line_map_files_capacity(map))
+              return 0;
+       map->files[map->file_count] = mem_malloc(strlen(path) + 1);
+       if (!map->files[map->file_count]) {
+              diag_report(DIAG_NO_MEMORY, NO_LINE, "line map");
+              return 0;
+       }
+       strcpy(map->files[map->file_count], path);
+       return ++map->file_count;
+}
+
+
+int listing_append(struct listing_entry **entries, int *count, int *capacity, int address, int words, int line) {
+       if (!ensure_listing_capacity(entries, *count, capacity))
+              return 0;
+
+       (*entries)[*count].address = address;
+       (*entries)[*count].words = words;
+       (*entries)[*count].line = line;
+       (*count)++;
+       return 1;
+}
+
+
+/* Writes an unsigned number as 4 (or 2) little-endian bytes */
+static void write_u32(FILE *f, unsigned long value) {
+       fputc((int)(value & 0xFF), f);
+       fputc((int)((value >> 8) & 0xFF), f);
+       fputc((int)((value >> 16) & 0xFF), f);
+       fputc((int)((value >> 24) & 0xFF), f);
+}
+
+static void write_u16(FILE *f, unsigned int value) {
+       fputc((int)(value & 0xFF), f);
+       fputc((int)((value >> 8) & 0xFF), f);
+}
+
+
+/* Moves a walk over the .am text forward to a line, returns FALSE past the end */
+static int seek_line(const struct source_text *source, size_t *position, int *line_number, int target, char *line) {
+       while (*line_number < target && *position < source->length) {
+              *position = next_source_line(source, *position, line);
+              (*line_number)++;
+       }
+       return *line_number == target;
+}
+
+
+/* Writes the entries of one section of the .lst file */
+static void print_listing_section(FILE *f, const struct listing_entry *entries, int count, int data_offset,
+                                  const struct memory_image *image, const struct source_text *source,
+                                  const struct line_map *map) {
+       char line[MAX_LINE_LEN + 1];
+       size_t position = 0;
+       int line_number = 0;
+       const struct line_origin *origin;
+       int i, w;
+
+       for (i = 0; i < count; i++) {
+              if (!seek_line(source, &position, &line_number, entries[i].line, line))
+                     line[0] = '\0';
+              remove_newline(line);
+
+              fprintf(f, "%07d ", entries[i].address);
+              for (w = 0; w < LISTING_WORDS_PER_ROW; w++) {
+                     if (w < entries[i].words) {
+                            print_24bit_as_hex(f, memory_read((struct memory_image *)image, entries[i].address - data_offset + w));
+                            fputc(' ', f);
+                     }
+                     else {
+                            fputs("       ", f);
+                     }
+              }
+
+              /* Source line, then where it came from */
+              fprintf(f, "%5d  %s", entries[i].line, line);
+              if (entries[i].line >= 1 && entries[i].line <= map->count) {
+                     origin = &map->lines[entries[i].line - 1];
+                     if (origin->file != 0)
+                            fprintf(f, "    ; %s line %d", map->files[origin->file - 1], origin->line);
+                     else if (origin->macro != NO_MACRO || origin->line != entries[i].line)
+                            fprintf(f, "    ; .as line %d", origin->line);
+                     if (origin->macro != NO_MACRO)
+                            fprintf(f, ", macro %s", map->macros[origin->macro]);
+              }
+              fputc('\n', f);
+
+              /* Long .data and .string directives continue on the next rows */
+              for (w = LISTING_WORDS_PER_ROW; w < entries[i].words; w++) {
+                     if (w % LISTING_WORDS_PER_ROW == 0)
+                            fprintf(f, "%07d ", entries[i].address + w);
+                     print_24bit_as_hex(f, memory_read((struct memory_image *)image, entries[i].address - data_offset + w));
+                     fputc(w % LISTING_WORDS_PER_ROW == LISTING_WORDS_PER_ROW - 1 || w == entries[i].words - 1 ? '\n' : ' ', f);
+              }
+       }
+}
+
+
+/* Writes the index records of one section */
+static void print_index_section(FILE *f, const struct listing_entry *entries, int count, const struct line_map *map) {
+       const struct line_origin *origin;
+       int i;
+
+       for (i = 0; i < count; i++) {
+              origin = (entries[i].line >= 1 && entries[i].line <= map->count) ? &map->lines[entries[i].line - 1] : NULL;
+              write_u32(f, entries[i].address);
+              write_u32(f, origin ? origin->line : entries[i].line);
+              write_u32(f, entries[i].line);
+              write_u16(f, origin ? (unsigned int)origin->file : 0);
+              write_u16(f, (origin && origin->macro != NO_MACRO) ? (unsigned int)origin->macro : INDEX_NO_MACRO);
+       }
+}
+
+
+void print_listing_files(const char *base_name, const struct translation_unit *prog,
+                         const struct source_text *source, const struct line_map *map) {
+       char *lst_file_name = build_filename(base_name, ".lst");
+       char *idx_file_name = build_filename(base_name, ".idx");
+       char *as_file_name = build_filename(base_name, ".as");
+       FILE *f;
+       int i;
+
+       if (!lst_file_name || !idx_file_name || !as_file_name) {
+              diag_report(DIAG_NO_MEMORY, NO_LINE, "file name");
+              mem_free(lst_file_name);
+              mem_free(idx_file_name);
+              mem_free(as_file_name);
+              return;
+       }
+
+       f = fopen(lst_file_name, "w");
+       if (f) {
+              fprintf(f, "; %s: address, words, .am line, source\n", as_file_name);
+              print_listing_section(f, prog->listing.code, prog->listing.code_count, 0, &prog->code_image, source, map);
+              print_listing_section(f, prog->listing.data, prog->listing.data_count, prog->ICF, &prog->data_image, source, map);
+              fclose(f);
+       }
+       else {
+              diag_report(DIAG_OPEN_FAILED, NO_LINE, lst_file_name);
+       }
+
+       f = fopen(idx_file_name, "wb");
+       if (f) {
+              fputs(INDEX_HEADER_MAGIC, f);
+              write_u32(f, INDEX_VERSION);
+              write_u32(f, prog->listing.code_count + prog->listing.data_count);
+              write_u32(f, 1 + map->file_count);
+              write_u32(f, map->macro_count);
+
+              /* Data follows the code, so the two sections together are sorted by address */
+              print_index_section(f, prog->listing.code, prog->listing.code_count, map);
+              print_index_section(f, prog->listing.data, prog->listing.data_count, map);
+
+              fwrite(as_file_name, 1, strlen(as_file_name) + 1, f);
+              for (i = 0; i < map->file_count; i++)
+                     fwrite(map->files[i], 1, strlen(map->files[i]) + 1, f);
+              for (i = 0; i < map->macro_count; i++)
+                     fwrite(map->macros[i], 1, strlen(map->macros[i]) + 1, f);
+              fclose(f);
+       }
+       else {
+              diag_report(DIAG_OPEN_FAILED, NO_LINE, idx_file_name);
+       }
+
+       mem_free(lst_file_name);
+       mem_free(idx_file_name);
+       mem_free(as_file_name);
+}
+
+
+void free_line_map(struct line_map *map) {
+       int i;
+
+       for (i = 0; i < map->file_count; i++)
+              mem_free(map->files[i]);
+       mem_free(map->files);
+       mem_free(map->lines);
+       mem_free(map->macros);
+       memset(map, 0, sizeof(*map));
+}
+
+
+void free_listing(struct listing *listing) {
+       mem_free(listing->code);
+       mem_free(listing->data);
+       memset(listing, 0, sizeof(*listing));
+}
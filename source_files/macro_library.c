@@ -0,0 +1,297 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "../header_files/macro_library.h"
+#include "../header_files/preprocessor.h"
+#include "../header_files/mem_alloc.h"
+#include "../header_files/diagnostics.h"
+
+#define FNV_OFFSET_BASIS 2166136261U
+#define FNV_PRIME 16777619U
+#define EMPTY_BUCKET 0U
+#define TEMPORARY_EXTENSION ".tmp"
+
+
+unsigned int macro_name_hash(const char *name) {
+       unsigned int hash = FNV_OFFSET_BASIS;
+
+       while (*name != '\0')
+              hash = (hash ^ (unsigned char)*name++) * FNV_PRIME;
+       return hash & 0xFFFFFFFFU;
+}
+
+
+/* Reads the macro definitions of one source into the table; anything else is an error */
+static int read_definitions(struct MacroTable *table, const char *base_name) {
+       char line_buffer[LINE_MAX_LEN] = {0};
+       char *as_file_name = build_filename(base_name, ".as");
+       struct Macro *macro_pointer = NULL;   /* Macro being defined, if any */
+       struct Macro *line_macro;
+       char *trimmed_line;
+       int error_flag = FALSE;
+       int line_counter = 0;
+       FILE *as_file;
+
+       as_file = as_file_name ? fopen(as_file_name, "r") : NULL;
+       if (!as_file) {
+              diag_report(DIAG_OPEN_FAILED, NO_LINE, as_file_name);
+              mem_free(as_file_name);
+              return TRUE;
+       }
+
+       while (fgets(line_buffer, sizeof(line_buffer), as_file) != NULL && !diag_limit_reached()) {
+              line_counter++;
+              trimmed_line = skip_leading_whitespace(line_buffer);
+              line_macro = macro_pointer;
+
+              if (is_macro_end_def(trimmed_line, macro_pointer, &error_flag, line_counter))
+                     macro_pointer = NULL;
+              else if (is_macro_def(trimmed_line, &line_macro, table, &error_flag, line_counter))
+                     macro_pointer = line_macro;
+              else if (macro_pointer != NULL)
+                     add_line_to_macro(macro_pointer, line_buffer, &error_flag);
+              else if (*trimmed_line != '\0' && *trimmed_line != ';') {
+                     diag_report(DIAG_MACRO_LIBRARY_LINE, line_counter, NULL);
+                     error_flag = TRUE;
+              }
+       }
+
+       fclose(as_file);
+       mem_free(as_file_name);
+       return error_flag;
+}
+
+
+/* Writes the flattened macros of the table as a library file */
+static int write_library(const struct MacroTable *table, const char *library_path) {
+       struct macro_library_header header;
+       struct macro_library_entry *entries;
+       unsigned int *buckets;
+       unsigned int bucket;
+       unsigned int hash;
+       unsigned int count = 0;
+       char *temporary_path;
+       FILE *file;
+       int error = FALSE;
+       unsigned int k;
+       int i;
+
+       memset(&header, 0, sizeof(header));
+       memcpy(header.magic, MACRO_LIBRARY_MAGIC, MACRO_LIBRARY_MAGIC_LEN);
+       header.version = MACRO_LIBRARY_VERSION;
+       header.byte_order = MACRO_LIBRARY_BYTE_ORDER;
+
+       /* At most half of the buckets are used, so a probe always reaches an empty one */
+       header.bucket_count = 1;
+       while (header.bucket_count < 2U * (unsigned int)table->count)
+              header.bucket_count *= 2;
+
+       buckets = mem_calloc(header.bucket_count, sizeof(unsigned int));
+       entries = mem_calloc(table->count > 0 ? table->count : 1, sizeof(struct macro_library_entry));
+       temporary_path = mem_malloc(strlen(library_path) + sizeof(TEMPORARY_EXTENSION));
+       if (!buckets || !entries || !temporary_path) {
+              diag_report(DIAG_NO_MEMORY, NO_LINE, "macro library");
+              mem_free(buckets);
+              mem_free(entries);
+              mem_free(temporary_path);
+              return TRUE;
+       }
+
+       for (i = 0; i < table->count; i++) {
+              hash = macro_name_hash(table->macros[i].mName);
+              bucket = hash & (header.bucket_count - 1);
+              while (buckets[bucket] != EMPTY_BUCKET && strcmp(entries[buckets[bucket] - 1].name, table->macros[i].mName) != STRCMP_TRUE)
+                     bucket = (bucket + 1) & (header.bucket_count - 1);
+
+              /* Like a call, a repeated name always finds the first definition */
+              if (buckets[bucket] != EMPTY_BUCKET)
+                     continue;
+
+              strcpy(entries[count].name, table->macros[i].mName);
+              entries[count].hash = hash;
+              entries[count].body_offset = header.body_bytes;
+              entries[count].body_length = (unsigned int)table->macros[i].flat_length;
+              header.body_bytes += entries[count].body_length;
+              buckets[bucket] = ++count;
+       }
+       header.macro_count = count;
+
+       /* Written beside the old library and renamed over it, so a mapped old library stays intact */
+       sprintf(temporary_path, "%s%s", library_path, TEMPORARY_EXTENSION);
+       file = fopen(temporary_path, "wb");
+       if (!file) {
+              diag_report(DIAG_OPEN_FAILED, NO_LINE, temporary_path);
+              error = TRUE;
+       }
+       else {
+              fwrite(&header, sizeof(header), 1, file);
+              fwrite(buckets, sizeof(unsigned int), header.bucket_count, file);
+              fwrite(entries, sizeof(struct macro_library_entry), count, file);
+              /* Entries follow the order of first definitions; repeated names have no body */
+              for (i = 0, k = 0; i < table->count && k < count; i++) {
+                     if (strcmp(entries[k].name, table->macros[i].mName) == STRCMP_TRUE) {
+                            fwrite(table->macros[i].flat_body, 1, table->macros[i].flat_length, file);
+                            k++;
+                     }
+              }
+              error = ferror(file);
+              if (fclose(file) != 0 || error || rename(temporary_path, library_path) != 0) {
+                     diag_report(DIAG_OPEN_FAILED, NO_LINE, library_path);
+                     remove(temporary_path);
+                     error = TRUE;
+              }
+              else {
+                     fprintf(stderr, "%s: %u macros, %u bytes of bodies\n", library_path, count, header.body_bytes);
+              }
+       }
+
+       mem_free(buckets);
+       mem_free(entries);
+       mem_free(temporary_path);
+       return error;
+}
+
+
+int macro_library_build(const char *library_path, char const *files[], int count) {
+       struct MacroTable table = {NULL, INITIAL_NUMBER_OF_LINES, INITIAL_LINES_CAPASITY};
+       int failed = FALSE;
+       int error;
+       int i, m;
+
+       for (i = 0; i < count; i++) {
+              diag_begin_file(files[i]);
+              error = read_definitions(&table, files[i]);
+
+              /* Bodies are expanded once every definition is known, as they would be at a call */
+              if (i == count - 1) {
+                     for (m = 0; m < table.count && !error; m++)
+                            flatten_macro(&table, &table.macros[m], &error, NO_LINE);
+                     if (!error && !failed)
+                            error = write_library(&table, library_path);
+              }
+
+              diag_flush();
+              failed |= error;
+       }
+
+       free_macro_table(&table);
+       return failed;
+}
+
+
+/* Checks that the file holds a whole library and that every index slot and body lies inside it */
+static int check_library(struct macro_library *library, const char **error) {
+       const struct macro_library_header *header = library->map;
+       size_t size = library->map_length;
+       unsigned int used = 0;
+       unsigned int i;
+
+       if (size < sizeof(*header) || memcmp(header->magic, MACRO_LIBRARY_MAGIC, MACRO_LIBRARY_MAGIC_LEN) != STRCMP_TRUE) {
+              *error = "not a macro library";
+              return FALSE;
+       }
+       if (header->byte_order != MACRO_LIBRARY_BYTE_ORDER || header->version != MACRO_LIBRARY_VERSION) {
+              *error = "built for another version or byte order, build it again";
+              return FALSE;
+       }
+       if (header->bucket_count == 0 || (header->bucket_count & (header->bucket_count - 1)) != 0 ||
+           header->macro_count > header->bucket_count / 2 ||
+           (size - sizeof(*header)) / sizeof(unsigned int) < header->bucket_count) {
+              *error = "damaged index";
+              return FALSE;
+       }
+
+       size -= sizeof(*header) + header->bucket_count * sizeof(unsigned int);
+       if (size / sizeof(struct macro_library_entry) < header->macro_count ||
+           size - header->macro_count * sizeof(struct macro_library_entry) != header->body_bytes) {
+              *error = "damaged index";
+              return FALSE;
+       }
+
+       library->header = header;
+       library->buckets = (const unsigned int *)(header + 1);
+       library->entries = (const struct macro_library_entry *)(library->buckets + header->bucket_count);
+       library->bodies = (const char *)(library->entries + header->macro_count);
+
+       /* Every entry has exactly one bucket, which leaves empty buckets to end each probe */
+       for (i = 0; i < header->bucket_count; i++) {
+              if (library->buckets[i] > header->macro_count) {
+                     *error = "damaged index";
+                     return FALSE;
+              }
+              used += (library->buckets[i] != EMPTY_BUCKET);
+       }
+       if (used != header->macro_count) {
+              *error = "damaged index";
+              return FALSE;
+       }
+       for (i = 0; i < header->macro_count; i++) {
+              if (memchr(library->entries[i].name, '\0', MACRO_LIBRARY_NAME_LEN) == NULL ||
+                  library->entries[i].body_offset > header->body_bytes ||
+                  library->entries[i].body_length > header->body_bytes - library->entries[i].body_offset) {
+                     *error = "damaged macro entry";
+                     return FALSE;
+              }
+       }
+       return TRUE;
+}
+
+
+int macro_library_open(struct macro_library *library, const char *path, const char **error) {
+       struct stat status;
+       int fd;
+
+       memset(library, 0, sizeof(*library));
+       fd = open(path, O_RDONLY);
+       if (fd < 0 || fstat(fd, &status) != 0 || !S_ISREG(status.st_mode) || status.st_size == 0) {
+              *error = "could not open file";
+              if (fd >= 0)
+                     close(fd);
+              return FALSE;
+       }
+
+       library->map = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+       close(fd);
+       if (library->map == MAP_FAILED) {
+              library->map = NULL;
+              *error = "could not map file";
+              return FALSE;
+       }
+       library->map_length = (size_t)status.st_size;
+
+       if (!check_library(library, error)) {
+              macro_library_close(library);
+              return FALSE;
+       }
+       return TRUE;
+}
+
+
+const struct macro_library_entry *macro_library_find(const struct macro_library *library, const char *name) {
+       unsigned int hash = macro_name_hash(name);
+       unsigned int mask = library->header->bucket_count - 1;
+       unsigned int bucket = hash & mask;
+       const struct macro_library_entry *entry;
+
+       while (library->buckets[bucket] != EMPTY_BUCKET) {
+              entry = &library->entries[library->buckets[bucket] - 1];
+              if (entry->hash == hash && strcmp(entry->name, name) == STRCMP_TRUE)
+                     return entry;
+              bucket = (bucket + 1) & mask;
+       }
+       return NULL;
+}
+
+
+void macro_library_close(struct macro_library *library) {
+       if (library->map)
+              munmap(library->map, library->map_length);
+       memset(library, 0, sizeof(*library));
+}
@@ -20,85 +20,327 @@
 #include "../header_files/second_pass.h"
 #include "../header_files/translation_unit.h"
 #include "../header_files/output.h"
+#include "../header_files/diagnostics.h"
+#include "../header_files/options.h"
+#include "../header_files/source_text.h"
+#include "../header_files/pipeline.h"
+#include "../header_files/listing.h"
+#include "../header_files/profile.h"
+#include "../header_files/peephole.h"
+#include "../header_files/watch.h"
+#include "../header_files/macro_library.h"
+#include "../header_files/out_of_core.h"
+#include "../header_files/trace.h"
+#include "../header_files/rebase.h"
 
 
 
 
+/* Expanded text of a file assembled with --check, which writes no .am file */
+struct expanded_text {
+    struct source_text *source;
+    int failed;                 /* TRUE if memory ran out */
+};
+
+
+/* Preprocessor output callback: keeps the text in memory for the first pass */
+static void keep_expanded_text(void *context, const char *text, size_t length) {
+    struct expanded_text *expanded = context;
+
+    if (!append_source_text(expanded->source, text, length))
+        expanded->failed = 1;
+}
+
+
+/* With --trace, records a phase that built the symbol table, with what it counted */
+static void trace_first_pass(const char *name, double started, const struct translation_unit *prog) {
+    struct trace_arg args[4];
+
+    args[0].name = "lines";
+    args[0].value = prog->line_count;
+    args[1].name = "symbols";
+    args[1].value = prog->symCount;
+    args[2].name = "code words";
+    args[2].value = prog->IC;
+    args[3].name = "data words";
+    args[3].value = prog->DC;
+    trace_event(name, "phase", started, args, 4);
+
+    trace_counter("lines", prog->line_count);
+    trace_counter("symbols", prog->symCount);
+}
+
+
 /**
- * @brief Main function to run the assembler on provided input files.
- * 
- * @param argc Argument count.
- * @param argv Argument vector containing input file base names (without extension).
- * @return int Returns 0 on successful completion.
+ * @brief Runs all assembler phases on one input file.
+ *
+ * Diagnostics are collected in the diagnostics sink; the caller flushes them.
+ *
+ * @param base_name Base name of the input file (without extension).
+ * @return 1 if any phase failed, 0 if the output files were written.
  */
-int main(int argc, char const *argv[]) {
+static int assemble_file(const char *base_name) {
+    int error = 0;
+    int pass_error = PIPELINE_UNAVAILABLE;
+    char *am_filename = NULL;
+    struct source_text source;
+    struct line_map map = {0};          /* Origins of the .am lines, kept only with --listing */
+    struct line_map *map_pointer = options.listing ? &map : NULL;
+    struct ob_stream stream = {0};      /* .ob file written during the second pass, with --stream */
+    struct expanded_text expanded;      /* With --check, the .am text stays in memory */
+    struct trace_arg args[2];           /* Counters of a traced phase */
+    double started;                     /* trace_clock() when the traced phase began */
     int i;
+    struct translation_unit prog = {0}; /* Holds state for processing this file */
 
-    /* Check for required input files */
-    if (argc < 2) {
-        printf("Usage: assembler file1 [file2 ...]\n");
-        return 1;
+    memset(&source, 0, sizeof(source));
+    expanded.source = &source;
+    expanded.failed = 0;
+
+    /* === Preprocessing and First Pass overlapped on separate threads === */
+    diag_set_phase(PHASE_PREPROCESSOR);
+    profile_phase(PHASE_PREPROCESSOR);
+    started = trace_clock();
+    if (options.pipeline && !options.memory_budget) {
+        pass_error = pipeline_first_pass(&prog, base_name, &source, map_pointer, &error);
+        if (pass_error != PIPELINE_UNAVAILABLE)
+            trace_first_pass("pipeline_first_pass", started, &prog);
     }
 
-    /* Process each input file */
-    for (i = 1; i < argc; i++) 
-    {
-        int error = 0;
-        char *am_filename = NULL;
-        FILE *am_file = NULL;
-        struct translation_unit prog = {0}; /* Holds state for processing this file */
+    /* === Preprocessing Phase === */
+    if (pass_error == PIPELINE_UNAVAILABLE) {
+        preprocess_to((char *)base_name, &error, options.check ? keep_expanded_text : NULL, &expanded, map_pointer);
+        trace_event("preprocessor", "phase", started, NULL, 0);
+    }
+    if (error) {
+        /* The failure line follows the errors that caused it */
+        if (!options.json) {
+            diag_flush();
+            printf("Preprocessor failed on file: %s\n", base_name);
+        }
+        free_source_text(&source);
+        free_line_map(&map);
+        return 1;
+    }
 
-        printf("Processing file: %s\n", argv[i]);
+    /* === Bounded memory: one streaming pass, with words and fixups spilled to temporary files === */
+    if (options.memory_budget && !options.check) {
+        started = trace_clock();
+        error = out_of_core_assemble(&prog, base_name, options.memory_budget * KIB);
+        trace_first_pass("out_of_core_assemble", started, &prog);
+        free_line_map(&map);
+        mem_free(prog.entries);
+        mem_free(prog.symbol_table);
+        return error;
+    }
 
-        /* === Preprocessing Phase === */
-        preprocessor((char *)argv[i], &error);
-        if (error) {
-            printf("Preprocessor failed on file: %s\n\n", argv[i]);
-            continue;
+    if (pass_error == PIPELINE_UNAVAILABLE) {
+        /* === Read the .am file once; both passes work on the text in memory === */
+        diag_set_phase(PHASE_FIRST_PASS);
+        profile_phase(PHASE_FIRST_PASS);
+        am_filename = build_filename(base_name, ".am");
+        if (expanded.failed) {
+            diag_report(DIAG_NO_MEMORY, NO_LINE, "source text");
+            free_source_text(&source);
+            mem_free(am_filename);
+            free_line_map(&map);
+            return 1;
         }
-
-        /* === Open .am file after preprocessing === */
-        am_filename = build_filename(argv[i], ".am");
-        am_file = fopen(am_filename, "r");
-        if (!am_file) {
-            printf("Error opening file %s\n", am_filename);
-            free(am_filename);
-            continue;
+        started = trace_clock();
+        if (!options.check && !load_source_text(&source, am_filename)) {
+            diag_report(DIAG_OPEN_FAILED, NO_LINE, am_filename);
+            mem_free(am_filename);
+            free_line_map(&map);
+            return 1;
         }
+        trace_event("load_source_text", "phase", started, NULL, 0);
 
         /* === First Pass === */
-        error = firstPass(&prog, am_filename, am_file);
-        fclose(am_file);  
-
-        /* === Re-open file for Second Pass === */
-        am_file = fopen(am_filename, "r");
-        if (!am_file) {
-            printf("Error reopening file %s for second pass.\n", am_filename);
-            free(am_filename);
-            continue; 
+        started = trace_clock();
+        pass_error = firstPass(&prog, am_filename, &source);
+        trace_first_pass("firstPass", started, &prog);
+    }
+    error = pass_error;
+
+    /* === What --pool-data saved, if it found duplicates or not === */
+    if (options.pool_data && !error && !options.check)
+        fprintf(stderr, "%s: pool-data saved %d data words in %d shared blocks\n",
+                base_name, prog.pooled_words, prog.pooled_blocks);
+
+    /* === Optional removal of instructions without effect, before anything is encoded === */
+    if (options.optimize && !error && !options.check) {
+        started = trace_clock();
+        error = peephole_optimize(&prog, &source, base_name);
+        trace_event("peephole_optimize", "phase", started, NULL, 0);
+    }
+
+    /* === Second Pass, writing the code words straight to the .ob file if streaming === */
+    diag_set_phase(PHASE_SECOND_PASS);
+    profile_phase(PHASE_SECOND_PASS);
+    started = trace_clock();
+    if (options.check) {
+        /* Only the label operands are resolved; nothing is encoded */
+        error |= check_references(&prog);
+    }
+    else {
+        if (options.stream && !error && !ob_stream_open(&stream, base_name, &prog))
+            error = 1;
+        error |= secondPass(&prog, &source, stream.path ? &stream : NULL);
+    }
+    args[0].name = "externals";
+    args[0].value = prog.extCount;
+    args[1].name = "entries";
+    args[1].value = prog.entries_count;
+    trace_event(options.check ? "check_references" : "secondPass", "phase", started, args, 2);
+
+    /* === Output Files, only if no error occurred, and never with --check === */
+    if (!error && !options.check) {
+        diag_set_phase(PHASE_OUTPUT);
+        profile_phase(PHASE_OUTPUT);
+        started = trace_clock();
+        if (stream.path) {
+            ob_stream_finish(&stream, &prog);
+            trace_event("ob_stream_finish", "output", started, NULL, 0);
+        }
+        else {
+            print_ob_file(base_name, &prog);
+            trace_event("print_ob_file", "output", started, NULL, 0);
+        }
+        started = trace_clock();
+        print_ent_file(base_name, &prog);
+        trace_event("print_ent_file", "output", started, NULL, 0);
+        started = trace_clock();
+        print_ext_file(base_name, &prog);
+        trace_event("print_ext_file", "output", started, NULL, 0);
+        if (options.relocations) {
+            started = trace_clock();
+            print_rel_file(base_name, &prog);
+            trace_event("print_rel_file", "output", started, NULL, 0);
         }
+        if (options.listing) {
+            started = trace_clock();
+            print_listing_files(base_name, &prog, &source, &map);
+            trace_event("print_listing_files", "output", started, NULL, 0);
+        }
+    }
+    else if (stream.path) {
+        /* No partial .ob file is left behind */
+        ob_stream_discard(&stream);
+    }
+
+    /* === Free resources === */
+    mem_free(am_filename);
+    free_source_text(&source);
+    mem_free(prog.chunks);
+    free_listing(&prog.listing);
+    mem_free(prog.removed_lines);
+    mem_free(prog.references);
+    mem_free(prog.relocations);
+    mem_free(prog.data_map);
+    free_line_map(&map);
+    for (i = 0; i < prog.extCount; i++)
+        mem_free(prog.externals[i].addresses);
+    mem_free(prog.externals);
+    mem_free(prog.entries);
+    mem_free(prog.symbol_table);
+    free_memory_image(&prog.code_image);
+    free_memory_image(&prog.data_image);
+    return error;
+}
+
+
+/**
+ * @brief Assembles one file and writes its diagnostics and per-file reports.
+ *
+ * @param base_name Base name of the input file (without extension).
+ * @return 1 if the file failed, 0 if the output files were written.
+ */
+static int process_file(const char *base_name) {
+    double started = trace_clock();
+    struct trace_arg diagnostics_count;
+    int error;
 
-        /* === Second Pass === */
-        error |= secondPass(&prog, am_file);  
-        fclose(am_file);
+    if (!options.json)
+        printf("Processing file: %s\n", base_name);
 
-        /* If any error occurred, skip file */
-        if (error) {
-            free(am_filename);
-            continue;
+    diag_begin_file(base_name);
+    error = assemble_file(base_name);
+
+    /* Diagnostics of the file are formatted and written once, here */
+    diagnostics_count.name = "diagnostics";
+    diagnostics_count.value = diag_flush();
+    trace_event(base_name, "file", started, &diagnostics_count, 1);
+    trace_flush();
+    profile_end_file(base_name);
+    alloc_report_file(base_name);
+    fflush(stdout);
+    return error;
+}
+
+
+/**
+ * @brief Main function to run the assembler on provided input files.
+ * 
+ * @param argc Argument count.
+ * @param argv Options followed by input file base names (without extension).
+ * @return int Returns 0 on successful completion.
+ */
+int main(int argc, char const *argv[]) {
+    int first_file;
+    int status = 0;
+    int i;
+
+    /* Check for options and required input files */
+    first_file = parse_options(argc, argv);
+    if (first_file == 0 || first_file >= argc) {
+        print_usage();
+        return 1;
+    }
+    if (options.alloc_stats)
+        alloc_accounting_start();
+    diag_configure(options.max_errors, options.json);
+
+    /* Compile the macro-only sources into a library instead of assembling them */
+    if (options.build_macro_library) {
+        status = macro_library_build(options.build_macro_library, &argv[first_file], argc - first_file);
+        alloc_report_total();
+        return status;
+    }
+
+    /* Move files assembled before to a new base instead of assembling them */
+    if (options.rebase) {
+        for (i = first_file; i < argc; i++) {
+            diag_begin_file(argv[i]);
+            diag_set_phase(PHASE_OUTPUT);
+            status |= rebase_object(argv[i], options.rebase_address);
+            diag_flush();
         }
+        alloc_report_total();
+        return status;
+    }
 
-        /* === Output Files === */
-        print_ob_file(argv[i], &prog);
-        print_ent_file(argv[i], &prog);
-        print_ext_file(argv[i], &prog);
+    if (options.profile)
+        profile_start();
+    if (options.trace && !trace_start(options.trace)) {
+        printf("Could not open trace file %s\n", options.trace);
+        return 1;
+    }
 
-        /* === Free resources === */
-        free(am_filename);
-        free(prog.externals);
-        free(prog.entries);
-        free(prog.symbol_table);
+    /* Assemble the files, then keep reassembling those whose sources change, until interrupted */
+    if (options.watch) {
+        status = watch_files(&argv[first_file], argc - first_file, process_file);
     }
+    else {
+        /* Process each input file; with --check the exit status tells whether all of them assemble */
+        for (i = first_file; i < argc; i++) {
+            if (process_file(argv[i]) && options.check)
+                status = 1;
+        }
+    }
+
+    profile_stop();
+    trace_stop();
+    alloc_report_total();
 
-    return 0;
-}
\ No newline at end of file
+    return status;
+}
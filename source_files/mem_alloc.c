@@ -4,6 +4,7 @@
 #include "../header_files/translation_unit.h"
 #include "../header_files/preprocessor.h"
 #include "../header_files/mem_alloc.h"
+#include "../header_files/diagnostics.h"
 
 int ensure_symbol_table_capacity(struct translation_unit *prog) {
        /* Check if symbol table is full */
@@ -12,10 +13,10 @@ int ensure_symbol_table_capacity(struct translation_unit *prog) {
               int new_capacity = (prog->symCapacity == 0) ? INITIAL_CAPASITY : prog->symCapacity * 2;
 
               /* Attempt to reallocate the symbol table with the new size */
-              struct symbol *new_table = realloc(prog->symbol_table, new_capacity * sizeof(struct symbol));
+              struct symbol *new_table = mem_realloc(prog->symbol_table, new_capacity * sizeof(struct symbol));
               if (!new_table) {
                      /* Allocation failed */
-                     printf("Failed to realloc symbol table\n");
+                     diag_report(DIAG_NO_MEMORY, NO_LINE, "symbol table");
                      return 0;
               }
 
@@ -36,10 +37,10 @@ int ensure_externals_capacity(struct translation_unit *prog) {
               int new_capacity = (prog->extCapacity == 0) ? INITIAL_CAPASITY : prog->extCapacity * 2;
 
               /* Attempt to reallocate the externals array */
-              struct ext *new_ext = realloc(prog->externals, new_capacity * sizeof(struct ext));
+              struct ext *new_ext = mem_realloc(prog->externals, new_capacity * sizeof(struct ext));
               if (!new_ext) {
                      /* Allocation failed */
-                     printf("Failed to realloc externals\n");
+                     diag_report(DIAG_NO_MEMORY, NO_LINE, "externals table");
                      return 0;
               }
 
@@ -61,10 +62,10 @@ int ensure_entries_capacity(struct translation_unit *prog) {
               int new_capacity = (prog->entries_capacity == 0) ? INITIAL_CAPASITY : prog->entries_capacity * 2;
 
               /* Attempt to reallocate the entries array */
-              struct symbol **new_entries = realloc(prog->entries, new_capacity * sizeof(struct symbol *));
+              struct symbol **new_entries = mem_realloc(prog->entries, new_capacity * sizeof(struct symbol *));
               if (!new_entries) {
                      /* Allocation failed */
-                     printf("Failed to realloc entries\n");
+                     diag_report(DIAG_NO_MEMORY, NO_LINE, "entries array");
                      return 0;
               }
 
@@ -77,6 +78,57 @@ int ensure_entries_capacity(struct translation_unit *prog) {
        return 1;
 }
 
+
+
+int ensure_references_capacity(struct translation_unit *prog, int count) {
+       int new_capacity;
+       struct symbol_reference *new_references;
+
+       /* Check if the references array can take count more */
+       if (prog->reference_count + count > prog->reference_capacity) {
+              new_capacity = (prog->reference_capacity == 0) ? INITIAL_CAPASITY : prog->reference_capacity;
+              while (new_capacity < prog->reference_count + count)
+                     new_capacity *= 2;
+
+              new_references = mem_realloc(prog->references, new_capacity * sizeof(struct symbol_reference));
+              if (!new_references) {
+                     diag_report(DIAG_NO_MEMORY, NO_LINE, "label operands");
+                     return 0;
+              }
+
+              prog->references = new_references;
+              prog->reference_capacity = new_capacity;
+       }
+
+       return 1;
+}
+
+
+int ensure_relocations_capacity(struct translation_unit *prog, int count) {
+       int new_capacity;
+       int *new_relocations;
+
+       /* Check if the relocation table can take count more */
+       if (prog->relocation_count + count > prog->relocation_capacity) {
+              new_capacity = (prog->relocation_capacity == 0) ? INITIAL_CAPASITY : prog->relocation_capacity;
+              while (new_capacity < prog->relocation_count + count)
+                     new_capacity *= 2;
+
+              new_relocations = mem_realloc(prog->relocations, new_capacity * sizeof(int));
+              if (!new_relocations) {
+                     diag_report(DIAG_NO_MEMORY, NO_LINE, "relocation table");
+                     return 0;
+              }
+
+              prog->relocations = new_relocations;
+              prog->relocation_capacity = new_capacity;
+       }
+
+       return 1;
+}
+
+
+
 char *build_filename(const char *base_name, const char *extension)
 {
        char *result;
@@ -86,7 +138,7 @@ char *build_filename(const char *base_name, const char *extension)
        size_t null_terminator_size = 1;
 
        /* Allocate memory for the full filename including null terminator */
-       result = (char *)malloc(total_len + null_terminator_size);
+       result = (char *)mem_malloc(total_len + null_terminator_size);
        if (result == NULL) {
               /* Allocation failed */
               return NULL;
@@ -114,10 +166,10 @@ int ensure_macro_table_capacity(struct MacroTable *table) {
                      new_capacity = table->capacity * 2;
 
               /* Attempt to reallocate the macro array */
-              new_macros = realloc(table->macros, new_capacity * sizeof(struct Macro));
+              new_macros = mem_realloc(table->macros, new_capacity * sizeof(struct Macro));
               if (!new_macros) {
                      /* Allocation failed */
-                     printf("Memory allocation failed while expanding macro table.\n");
+                     diag_report(DIAG_NO_MEMORY, NO_LINE, "macro table");
                      return 0;
               }
 
@@ -146,10 +198,10 @@ int ensure_macro_lines_capacity(struct Macro *macro) {
                      new_capacity = macro->capacity * 2;
 
               /* Attempt to reallocate the lines array */
-              new_lines = realloc(macro->lines, sizeof(char[LINE_MAX_LEN]) * new_capacity);
+              new_lines = mem_realloc(macro->lines, sizeof(char[LINE_MAX_LEN]) * new_capacity);
               if (!new_lines) {
-                     /* Allocation failed — abort program */
-                     printf("Error: Failed to allocate memory for macro lines.\n");
+                     /* Allocation failed */
+                     diag_report(DIAG_NO_MEMORY, NO_LINE, "macro lines");
                      return FALSE;
               }
 
@@ -161,6 +213,30 @@ int ensure_macro_lines_capacity(struct Macro *macro) {
 }
 
 
+int append_to_flat_body(struct Macro *macro, const char *text, size_t length) {
+       size_t new_capacity;
+       char *new_body;
+
+       /* Grow the body geometrically so flattening stays linear in the output size */
+       if (macro->flat_body == NULL || macro->flat_length + length > macro->flat_capacity) {
+              new_capacity = (macro->flat_capacity == 0) ? LINE_MAX_LEN : macro->flat_capacity;
+              while (new_capacity < macro->flat_length + length)
+                     new_capacity *= 2;
+
+              new_body = mem_realloc(macro->flat_body, new_capacity);
+              if (!new_body)
+                     return FALSE;
+
+              macro->flat_body = new_body;
+              macro->flat_capacity = new_capacity;
+       }
+
+       memcpy(macro->flat_body + macro->flat_length, text, length);
+       macro->flat_length += length;
+       return TRUE;
+}
+
+
  
 void free_macro_table(struct MacroTable *table) {
        int i;
@@ -168,11 +244,695 @@ void free_macro_table(struct MacroTable *table) {
        /* Check if table or its macros array is NULL */
        if (!table || !table->macros) return;
 
-       /* Free memory for each macro's lines */
+       /* Free memory for each macro's lines and flattened body */
        for (i = 0; i < table->count; i++) {
-              free(table->macros[i].lines);
+              mem_free(table->macros[i].lines);
+              mem_free(table->macros[i].flat_body);
        }
 
-       /* Free the macros array itself */
-       free(table->macros);
+       /* Free the macros array itself and the index of their names */
+       mem_free(table->macros);
+       mem_free(table->index);
+}
+
+
+
+int ensure_diagnostics_capacity(struct diagnostics_sink *sink) {
+       int new_capacity;
+       struct diagnostic *new_records;
+
+       /* Check if the records array is full */
+       if (sink->count >= sink->capacity) {
+              /* Calculate new capacity: start with 4 or double the current */
+              new_capacity = (sink->capacity == 0) ? INITIAL_CAPASITY : sink->capacity * 2;
+
+              /* Attempt to reallocate the records array; failures cannot be reported through the sink itself */
+              new_records = mem_realloc(sink->records, new_capacity * sizeof(struct diagnostic));
+              if (!new_records)
+                     return 0;
+
+              /* Update records array and capacity */
+              sink->records = new_records;
+              sink->capacity = new_capacity;
+       }
+
+       /* Records array has sufficient capacity */
+       return 1;
+}
+
+
+
+int ensure_memory_pages_capacity(struct memory_image *image) {
+       /* Check if the pages array is full */
+       if (image->page_count >= image->page_capacity) {
+              /* Calculate new capacity: start with 4 or double the current */
+              int new_capacity = (image->page_capacity == 0) ? INITIAL_CAPASITY : image->page_capacity * 2;
+
+              /* Attempt to reallocate the pages array */
+              struct memory_page **new_pages = mem_realloc(image->pages, new_capacity * sizeof(struct memory_page *));
+              if (!new_pages) {
+                     /* Allocation failed; images are filled on worker threads, so the caller reports it */
+                     return 0;
+              }
+
+              /* Update pages array and capacity */
+              image->pages = new_pages;
+              image->page_capacity = new_capacity;
+       }
+
+       /* Pages array has sufficient capacity */
+       return 1;
+}
+
+
+
+int ensure_chunk_events_capacity(struct first_pass_chunk *chunk) {
+       int new_capacity;
+       struct first_pass_event *new_events;
+
+       /* Check if the event array is full */
+       if (chunk->event_count >= chunk->event_capacity) {
+              new_capacity = (chunk->event_capacity == 0) ? INITIAL_CAPASITY : chunk->event_capacity * 2;
+
+              new_events = mem_realloc(chunk->events, new_capacity * sizeof(struct first_pass_event));
+              if (!new_events)
+                     return 0;
+
+              chunk->events = new_events;
+              chunk->event_capacity = new_capacity;
+       }
+
+       return 1;
+}
+
+
+
+int ensure_chunk_data_capacity(struct first_pass_chunk *chunk, int count) {
+       int new_capacity;
+       int *new_data;
+
+       /* Grow geometrically until the new words fit */
+       if (chunk->data_count + count > chunk->data_capacity) {
+              new_capacity = (chunk->data_capacity == 0) ? INITIAL_CAPASITY : chunk->data_capacity;
+              while (new_capacity < chunk->data_count + count)
+                     new_capacity *= 2;
+
+              new_data = mem_realloc(chunk->data, new_capacity * sizeof(int));
+              if (!new_data)
+                     return 0;
+
+              chunk->data = new_data;
+              chunk->data_capacity = new_capacity;
+       }
+
+       return 1;
+}
+
+
+
+int ensure_chunk_references_capacity(struct first_pass_chunk *chunk) {
+       int new_capacity;
+       struct symbol_reference *new_references;
+
+       /* Check if the references array is full */
+       if (chunk->reference_count >= chunk->reference_capacity) {
+              new_capacity = (chunk->reference_capacity == 0) ? INITIAL_CAPASITY : chunk->reference_capacity * 2;
+
+              new_references = mem_realloc(chunk->references, new_capacity * sizeof(struct symbol_reference));
+              if (!new_references)
+                     return 0;
+
+              chunk->references = new_references;
+              chunk->reference_capacity = new_capacity;
+       }
+
+       return 1;
+}
+
+
+
+int ensure_ext_addresses_capacity(struct ext *external) {
+       int new_capacity;
+       int *new_addresses;
+
+       /* Check if the address list is full */
+       if (external->address_count >= external->address_capacity) {
+              new_capacity = (external->address_capacity == 0) ? INITIAL_CAPASITY : external->address_capacity * 2;
+
+              new_addresses = mem_realloc(external->addresses, new_capacity * sizeof(int));
+              if (!new_addresses) {
+                     diag_report(DIAG_NO_MEMORY, NO_LINE, "extern addresses");
+                     return 0;
+              }
+
+              external->addresses = new_addresses;
+              external->address_capacity = new_capacity;
+       }
+
+       return 1;
+}
+
+
+
+int ensure_chunk_uses_capacity(struct second_pass_chunk *chunk) {
+       int new_capacity;
+       struct extern_use *new_uses;
+
+       /* Check if the extern use list is full */
+       if (chunk->use_count >= chunk->use_capacity) {
+              new_capacity = (chunk->use_capacity == 0) ? INITIAL_CAPASITY : chunk->use_capacity * 2;
+
+              new_uses = mem_realloc(chunk->uses, new_capacity * sizeof(struct extern_use));
+              if (!new_uses)
+                     return 0;
+
+              chunk->uses = new_uses;
+              chunk->use_capacity = new_capacity;
+       }
+
+       return 1;
+}
+
+
+int ensure_chunk_relocations_capacity(struct second_pass_chunk *chunk) {
+       int new_capacity;
+       int *new_relocations;
+
+       /* Check if the relocation list is full */
+       if (chunk->relocation_count >= chunk->relocation_capacity) {
+              new_capacity = (chunk->relocation_capacity == 0) ? INITIAL_CAPASITY : chunk->relocation_capacity * 2;
+
+              new_relocations = mem_realloc(chunk->relocations, new_capacity * sizeof(int));
+              if (!new_relocations)
+                     return 0;
+
+              chunk->relocations = new_relocations;
+              chunk->relocation_capacity = new_capacity;
+       }
+
+       return 1;
+}
+
+
+
+int ensure_chunk_reports_capacity(struct second_pass_chunk *chunk) {
+       int new_capacity;
+       struct second_pass_report *new_reports;
+
+       /* Check if the report list is full */
+       if (chunk->report_count >= chunk->report_capacity) {
+              new_capacity = (chunk->report_capacity == 0) ? INITIAL_CAPASITY : chunk->report_capacity * 2;
+
+              new_reports = mem_realloc(chunk->reports, new_capacity * sizeof(struct second_pass_report));
+              if (!new_reports)
+                     return 0;
+
+              chunk->reports = new_reports;
+              chunk->report_capacity = new_capacity;
+       }
+
+       return 1;
+}
+
+
+
+int ensure_preprocess_runs_capacity(struct preprocess_scan *scan) {
+       int new_capacity;
+       struct preprocess_run *new_runs;
+
+       /* Check if the run list is full */
+       if (scan->run_count >= scan->run_capacity) {
+              new_capacity = (scan->run_capacity == 0) ? INITIAL_CAPASITY : scan->run_capacity * 2;
+
+              new_runs = mem_realloc(scan->runs, new_capacity * sizeof(struct preprocess_run));
+              if (!new_runs) {
+                     diag_report(DIAG_NO_MEMORY, NO_LINE, "preprocessor runs");
+                     return 0;
+              }
+
+              scan->runs = new_runs;
+              scan->run_capacity = new_capacity;
+       }
+
+       return 1;
+}
+
+
+
+int ensure_chunk_pieces_capacity(struct preprocess_chunk *chunk) {
+       int new_capacity;
+       struct expansion_piece *new_pieces;
+
+       /* Check if the piece list is full */
+       if (chunk->piece_count >= chunk->piece_capacity) {
+              new_capacity = (chunk->piece_capacity == 0) ? INITIAL_CAPASITY : chunk->piece_capacity * 2;
+
+              new_pieces = mem_realloc(chunk->pieces, new_capacity * sizeof(struct expansion_piece));
+              if (!new_pieces)
+                     return 0;
+
+              chunk->pieces = new_pieces;
+              chunk->piece_capacity = new_capacity;
+       }
+
+       return 1;
+}
+
+
+
+int ensure_included_files_capacity(struct include_state *state) {
+       int new_capacity;
+       struct included_file *new_files;
+
+       /* Check if the file list is full */
+       if (state->file_count >= state->file_capacity) {
+              new_capacity = (state->file_capacity == 0) ? INITIAL_CAPASITY : state->file_capacity * 2;
+
+              new_files = mem_realloc(state->files, new_capacity * sizeof(struct included_file));
+              if (!new_files) {
+                     diag_report(DIAG_NO_MEMORY, NO_LINE, "include list");
+                     return 0;
+              }
+
+              state->files = new_files;
+              state->file_capacity = new_capacity;
+       }
+
+       return 1;
+}
+
+
+
+int ensure_include_frames_capacity(struct include_state *state) {
+       int new_capacity;
+       struct include_frame *new_frames;
+
+       /* Check if the stack is full */
+       if (state->depth >= state->frame_capacity) {
+              new_capacity = (state->frame_capacity == 0) ? INITIAL_CAPASITY : state->frame_capacity * 2;
+
+              new_frames = mem_realloc(state->frames, new_capacity * sizeof(struct include_frame));
+              if (!new_frames) {
+                     diag_report(DIAG_NO_MEMORY, NO_LINE, "include list");
+                     return 0;
+              }
+
+              state->frames = new_frames;
+              state->frame_capacity = new_capacity;
+       }
+
+       return 1;
+}
+
+
+
+void free_include_state(struct include_state *state) {
+       int i;
+
+       /* Files still suspended when preprocessing stopped early */
+       for (i = 0; i < state->depth; i++)
+              fclose(state->frames[i].file);
+
+       for (i = 0; i < state->file_count; i++)
+              mem_free(state->files[i].path);
+       mem_free(state->files);
+       mem_free(state->frames);
+       memset(state, 0, sizeof(*state));
+}
+
+
+
+void reset_first_pass_chunk(struct first_pass_chunk *chunk) {
+       int i;
+
+       /* Syntax error messages and .incbin mappings are owned by their events */
+       for (i = 0; i < chunk->event_count; i++) {
+              mem_free(chunk->events[i].message);
+              incbin_close(&chunk->events[i].blob);
+       }
+       chunk->event_count = 0;
+       chunk->reference_count = 0;
+       chunk->data_count = 0;
+       chunk->blob_words = 0;
+       chunk->line_count = 0;
+       chunk->code_words = 0;
+       chunk->failed = FALSE;
+}
+
+
+void free_first_pass_chunk(struct first_pass_chunk *chunk) {
+       reset_first_pass_chunk(chunk);
+       mem_free(chunk->events);
+       mem_free(chunk->data);
+       mem_free(chunk->references);
+       chunk->events = NULL;
+       chunk->data = NULL;
+       chunk->references = NULL;
+       chunk->event_capacity = 0;
+       chunk->data_capacity = 0;
+       chunk->reference_capacity = 0;
+}
+
+
+
+int ensure_source_text_capacity(struct source_text *source, size_t length) {
+       size_t new_capacity;
+       char *new_text;
+
+       /* Room for the new characters and the terminator */
+       if (source->length + length + 1 > source->capacity) {
+              new_capacity = (source->capacity == 0) ? LINE_MAX_LEN : source->capacity;
+              while (new_capacity < source->length + length + 1)
+                     new_capacity *= 2;
+
+              new_text = mem_realloc(source->text, new_capacity);
+              if (!new_text)
+                     return 0;
+
+              source->text = new_text;
+              source->capacity = new_capacity;
+       }
+
+       return 1;
+}
+
+
+int ensure_line_map_capacity(struct line_map *map) {
+       int new_capacity;
+       struct line_origin *new_lines;
+
+       if (map->count >= map->capacity) {
+              new_capacity = (map->capacity == 0) ? INITIAL_CAPASITY : map->capacity * 2;
+
+              new_lines = mem_realloc(map->lines, new_capacity * sizeof(struct line_origin));
+              if (!new_lines) {
+                     diag_report(DIAG_NO_MEMORY, NO_LINE, "line map");
+                     return 0;
+              }
+
+              map->lines = new_lines;
+              map->capacity = new_capacity;
+       }
+
+       return 1;
+}
+
+
+int ensure_line_map_macros_capacity(struct line_map *map) {
+       int new_capacity;
+       char (*new_macros)[MAX_MACRO_LEN + 1];
+
+       if (map->macro_count >= map->macro_capacity) {
+              new_capacity = (map->macro_capacity == 0) ? INITIAL_CAPASITY : map->macro_capacity * 2;
+
+              new_macros = mem_realloc(map->macros, new_capacity * sizeof(*new_macros));
+              if (!new_macros) {
+                     diag_report(DIAG_NO_MEMORY, NO_LINE, "line map");
+                     return 0;
+              }
+
+              map->macros = new_macros;
+              map->macro_capacity = new_capacity;
+       }
+
+       return 1;
+}
+
+
+int ensure_line_map_files_capacity(struct line_map *map) {
+       int new_capacity;
+       char **new_files;
+
+       if (map->file_count >= map->file_capacity) {
+              new_capacity = (map->file_capacity == 0) ? INITIAL_CAPASITY : map->file_capacity * 2;
+
+              new_files = mem_realloc(map->files, new_capacity * sizeof(char *));
+              if (!new_files) {
+                     diag_report(DIAG_NO_MEMORY, NO_LINE, "line map");
+                     return 0;
+              }
+
+              map->files = new_files;
+              map->file_capacity = new_capacity;
+       }
+
+       return 1;
+}
+
+
+int ensure_listing_capacity(struct listing_entry **entries, int count, int *capacity) {
+       int new_capacity;
+       struct listing_entry *new_entries;
+
+       if (count >= *capacity) {
+              new_capacity = (*capacity == 0) ? INITIAL_CAPASITY : *capacity * 2;
+
+              new_entries = mem_realloc(*entries, new_capacity * sizeof(struct listing_entry));
+              if (!new_entries)
+                     return 0;
+
+              *entries = new_entries;
+              *capacity = new_capacity;
+       }
+
+       return 1;
+}
+
+
+int ensure_peephole_capacity(struct peephole_program *program) {
+       int new_capacity;
+       struct peephole_entry *new_entries;
+
+       if (program->count >= program->capacity) {
+              new_capacity = (program->capacity == 0) ? INITIAL_CAPASITY : program->capacity * 2;
+
+              new_entries = mem_realloc(program->entries, new_capacity * sizeof(struct peephole_entry));
+              if (!new_entries) {
+                     diag_report(DIAG_NO_MEMORY, NO_LINE, "optimizer lines");
+                     return 0;
+              }
+
+              program->entries = new_entries;
+              program->capacity = new_capacity;
+       }
+
+       return 1;
+}
+
+
+/* Size header in front of every accounted block; the union keeps the block aligned */
+union alloc_header {
+       size_t size;
+       long double align_float;
+       void *align_pointer;
+       long align_integer;
+};
+
+/* Counters of one phase, or of a whole file */
+struct alloc_counters {
+       unsigned long allocations;     /* mem_malloc() and mem_calloc() calls */
+       unsigned long reallocations;   /* mem_realloc() calls */
+       unsigned long frees;           /* mem_free() calls with a block */
+       unsigned long bytes;           /* Bytes requested */
+       unsigned long copied;          /* Bytes realloc moved to a new block */
+       unsigned long peak;            /* Highest number of live bytes */
+};
+
+static struct {
+       int enabled;
+       unsigned long live;                                   /* Bytes currently allocated */
+       struct alloc_counters phases[NUMBER_OF_PHASES];       /* Current file */
+       struct alloc_counters file_peak;                      /* Only .peak is used */
+       struct alloc_counters total[NUMBER_OF_PHASES];        /* All files */
+       unsigned long total_peak;
+       int files;
+} accounting = {0};
+
+static const char *alloc_phase_names[NUMBER_OF_PHASES] = {
+       "preprocessor", "first pass", "second pass", "output"
+};
+
+
+static void add_count(unsigned long *counter, unsigned long amount) {
+       __atomic_fetch_add(counter, amount, __ATOMIC_RELAXED);
+}
+
+static void raise_peak(unsigned long *peak, unsigned long live) {
+       unsigned long seen = __atomic_load_n(peak, __ATOMIC_RELAXED);
+
+       while (live > seen && !__atomic_compare_exchange_n(peak, &seen, live, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+              ;
+}
+
+/* Adds a new block of size bytes to the live total of the current phase */
+static void count_live(struct alloc_counters *phase, size_t size) {
+       unsigned long live = __atomic_add_fetch(&accounting.live, size, __ATOMIC_RELAXED);
+
+       raise_peak(&phase->peak, live);
+       raise_peak(&accounting.file_peak.peak, live);
+       raise_peak(&accounting.total_peak, live);
+}
+
+/* Phases only change on the main thread while no worker runs */
+static struct alloc_counters *current_phase(void) {
+       return &accounting.phases[diagnostics.phase];
+}
+
+
+void alloc_accounting_start(void) {
+       accounting.enabled = TRUE;
+}
+
+
+void *mem_malloc(size_t size) {
+       union alloc_header *header;
+       struct alloc_counters *phase;
+
+       if (!accounting.enabled)
+              return malloc(size);
+
+       header = malloc(sizeof(union alloc_header) + size);
+       if (!header)
+              return NULL;
+       header->size = size;
+
+       phase = current_phase();
+       add_count(&phase->allocations, 1);
+       add_count(&phase->bytes, size);
+       count_live(phase, size);
+       return header + 1;
+}
+
+
+void *mem_calloc(size_t count, size_t size) {
+       void *block;
+
+       if (!accounting.enabled)
+              return calloc(count, size);
+
+       if (size != 0 && count > (size_t)-1 / size)
+              return NULL;
+       block = mem_malloc(count * size);
+       if (block)
+              memset(block, 0, count * size);
+       return block;
+}
+
+
+void *mem_realloc(void *block, size_t size) {
+       union alloc_header *header;
+       union alloc_header *old_header;
+       size_t old_size;
+       struct alloc_counters *phase;
+
+       if (!accounting.enabled)
+              return realloc(block, size);
+
+       old_header = block ? (union alloc_header *)block - 1 : NULL;
+       old_size = old_header ? old_header->size : 0;
+
+       header = realloc(old_header, sizeof(union alloc_header) + size);
+       if (!header)
+              return NULL;
+       header->size = size;
+
+       phase = current_phase();
+       add_count(&phase->reallocations, 1);
+       add_count(&phase->bytes, size);
+
+       /* A block that moved had its contents copied */
+       if (old_header && header != old_header)
+              add_count(&phase->copied, old_size < size ? old_size : size);
+
+       __atomic_sub_fetch(&accounting.live, old_size, __ATOMIC_RELAXED);
+       count_live(phase, size);
+       return header + 1;
+}
+
+
+void mem_free(void *block) {
+       union alloc_header *header;
+
+       if (!accounting.enabled || !block) {
+              free(block);
+              return;
+       }
+
+       header = (union alloc_header *)block - 1;
+       add_count(&current_phase()->frees, 1);
+       __atomic_sub_fetch(&accounting.live, header->size, __ATOMIC_RELAXED);
+       free(header);
+}
+
+
+/* Writes one row per phase that allocated, then their sum */
+static void print_alloc_table(const char *title, const struct alloc_counters *phases, unsigned long peak) {
+       struct alloc_counters sum;
+       const struct alloc_counters *row;
+       int p;
+
+       memset(&sum, 0, sizeof(sum));
+       sum.peak = peak;
+       fprintf(stderr, "%s:\n  %-14s %12s %12s %12s %14s %14s %14s\n", title,
+               "phase", "allocations", "reallocs", "frees", "bytes", "realloc copy", "peak live");
+
+       for (p = 0; p <= NUMBER_OF_PHASES; p++) {
+              row = (p < NUMBER_OF_PHASES) ? &phases[p] : &sum;
+              if (p < NUMBER_OF_PHASES && row->allocations + row->reallocations + row->frees == 0)
+                     continue;
+
+              fprintf(stderr, "  %-14s %12lu %12lu %12lu %14lu %14lu %14lu\n",
+                      p < NUMBER_OF_PHASES ? alloc_phase_names[p] : "all",
+                      row->allocations, row->reallocations, row->frees, row->bytes, row->copied, row->peak);
+
+              if (p < NUMBER_OF_PHASES) {
+                     sum.allocations += row->allocations;
+                     sum.reallocations += row->reallocations;
+                     sum.frees += row->frees;
+                     sum.bytes += row->bytes;
+                     sum.copied += row->copied;
+              }
+       }
+       fprintf(stderr, "  live bytes now: %lu\n", accounting.live);
+}
+
+
+void alloc_report_file(const char *base_name) {
+       char title[FILENAME_MAX + 32];
+       struct alloc_counters *total;
+       struct alloc_counters *phase;
+       int p;
+
+       if (!accounting.enabled)
+              return;
+
+       sprintf(title, "%.*s: allocations", FILENAME_MAX, base_name);
+       print_alloc_table(title, accounting.phases, accounting.file_peak.peak);
+
+       /* Fold the file into the totals and start the next one from the current live bytes */
+       for (p = 0; p < NUMBER_OF_PHASES; p++) {
+              phase = &accounting.phases[p];
+              total = &accounting.total[p];
+              total->allocations += phase->allocations;
+              total->reallocations += phase->reallocations;
+              total->frees += phase->frees;
+              total->bytes += phase->bytes;
+              total->copied += phase->copied;
+              if (phase->peak > total->peak)
+                     total->peak = phase->peak;
+       }
+       memset(accounting.phases, 0, sizeof(accounting.phases));
+       accounting.file_peak.peak = accounting.live;
+       accounting.files++;
+}
+
+
+void alloc_report_total(void) {
+       char title[64];
+
+       if (!accounting.enabled || accounting.files == 0)
+              return;
+
+       sprintf(title, "total of %d files", accounting.files);
+       print_alloc_table(title, accounting.total, accounting.total_peak);
 }
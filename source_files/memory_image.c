@@ -0,0 +1,227 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "../header_files/memory_image.h"
+#include "../header_files/mem_alloc.h"
+
+#define PAGE_NOT_FOUND -1
+
+
+/* Stores the low MEMORY_WORD_BITS bits of a word at an offset of a page */
+static void pack_word(struct memory_page *page, int offset, int word) {
+       unsigned char *bytes = &page->words[offset * MEMORY_WORD_BYTES];
+       unsigned long value = (unsigned long)word & MEMORY_WORD_MASK;
+
+       bytes[0] = (unsigned char)(value & 0xFF);
+       bytes[1] = (unsigned char)((value >> 8) & 0xFF);
+       bytes[2] = (unsigned char)((value >> 16) & 0xFF);
+}
+
+
+/* Reads the word at an offset of a page, sign-extended from MEMORY_WORD_BITS bits */
+static int unpack_word(const struct memory_page *page, int offset) {
+       const unsigned char *bytes = &page->words[offset * MEMORY_WORD_BYTES];
+       long value = (long)bytes[0] | ((long)bytes[1] << 8) | ((long)bytes[2] << 16);
+
+       return (int)((value ^ MEMORY_WORD_SIGN_BIT) - MEMORY_WORD_SIGN_BIT);
+}
+
+
+/*
+ * Returns the index of the page holding page_number, or PAGE_NOT_FOUND. When not
+ * found, *insert_at receives the index that keeps the pages sorted.
+ */
+static int find_page(const struct memory_image *image, int page_number, int *insert_at) {
+       int low = 0, high = image->page_count - 1, middle;
+
+       /* Sequential access almost always hits the last used page or the one after it */
+       if (image->page_count > 0) {
+              if (image->pages[image->last_page]->page_number == page_number)
+                     return image->last_page;
+              if (image->pages[image->page_count - 1]->page_number < page_number) {
+                     *insert_at = image->page_count;
+                     return PAGE_NOT_FOUND;
+              }
+       }
+
+       /* Binary search over the sorted pages */
+       while (low <= high) {
+              middle = (low + high) / 2;
+              if (image->pages[middle]->page_number == page_number)
+                     return middle;
+              if (image->pages[middle]->page_number < page_number)
+                     low = middle + 1;
+              else
+                     high = middle - 1;
+       }
+
+       *insert_at = low;
+       return PAGE_NOT_FOUND;
+}
+
+
+/* Returns the page holding page_number, allocating it on first use, or NULL if memory ran out */
+static struct memory_page *get_page(struct memory_image *image, int page_number) {
+       int insert_at = 0;
+       int index;
+       struct memory_page *page;
+
+       index = find_page(image, page_number, &insert_at);
+       if (index == PAGE_NOT_FOUND) {
+              if (!ensure_memory_pages_capacity(image))
+                     return NULL;
+
+              page = mem_calloc(1, sizeof(struct memory_page));
+              if (!page)
+                     return NULL;
+              page->page_number = page_number;
+
+              /* Shift later pages up to keep the array sorted */
+              memmove(&image->pages[insert_at + 1], &image->pages[insert_at],
+                      (image->page_count - insert_at) * sizeof(struct memory_page *));
+              image->pages[insert_at] = page;
+              image->page_count++;
+              index = insert_at;
+       }
+
+       image->last_page = index;
+       return image->pages[index];
+}
+
+
+/* Marks a word of a page as written; each address is counted once, however many times it is written */
+static void mark_used(struct memory_image *image, struct memory_page *page, int offset) {
+       if (!(page->used[offset / CHAR_BIT] & (1 << (offset % CHAR_BIT)))) {
+              page->used[offset / CHAR_BIT] |= (1 << (offset % CHAR_BIT));
+              image->word_count++;
+       }
+}
+
+
+int memory_write(struct memory_image *image, int address, int word) {
+       int offset = address & MEMORY_PAGE_MASK;
+       struct memory_page *page = get_page(image, address >> MEMORY_PAGE_BITS);
+
+       if (!page)
+              return 0;
+
+       mark_used(image, page, offset);
+       pack_word(page, offset, word);
+       return 1;
+}
+
+
+int memory_write_bytes(struct memory_image *image, int address, const unsigned char *bytes, int count) {
+       struct memory_page *page;
+       int offset;
+       int run;
+       int i;
+
+       while (count > 0) {
+              page = get_page(image, address >> MEMORY_PAGE_BITS);
+              if (!page)
+                     return 0;
+
+              /* Copy the part of the range that falls in this page at once */
+              offset = address & MEMORY_PAGE_MASK;
+              run = MEMORY_PAGE_SIZE - offset;
+              if (run > count)
+                     run = count;
+              memcpy(&page->words[offset * MEMORY_WORD_BYTES], bytes, (size_t)run * MEMORY_WORD_BYTES);
+              for (i = offset; i < offset + run; i++)
+                     mark_used(image, page, i);
+
+              address += run;
+              bytes += (size_t)run * MEMORY_WORD_BYTES;
+              count -= run;
+       }
+       return 1;
+}
+
+
+int memory_read(struct memory_image *image, int address) {
+       int insert_at;
+       int index = find_page(image, address >> MEMORY_PAGE_BITS, &insert_at);
+
+       if (index == PAGE_NOT_FOUND)
+              return 0;
+
+       image->last_page = index;
+       return unpack_word(image->pages[index], address & MEMORY_PAGE_MASK);
+}
+
+
+void memory_cursor_start(struct memory_cursor *cursor) {
+       cursor->page = 0;
+       cursor->offset = 0;
+}
+
+
+int memory_next(const struct memory_image *image, struct memory_cursor *cursor, int *address, int *word) {
+       const struct memory_page *page;
+
+       for (; cursor->page < image->page_count; cursor->page++, cursor->offset = 0) {
+              page = image->pages[cursor->page];
+
+              /* Skip the unwritten words of the page */
+              for (; cursor->offset < MEMORY_PAGE_SIZE; cursor->offset++) {
+                     if (page->used[cursor->offset / CHAR_BIT] & (1 << (cursor->offset % CHAR_BIT))) {
+                            *address = (page->page_number << MEMORY_PAGE_BITS) | cursor->offset;
+                            *word = unpack_word(page, cursor->offset);
+                            cursor->offset++;
+                            return 1;
+                     }
+              }
+       }
+       return 0;
+}
+
+
+int memory_append(struct memory_image *image, struct memory_image *tail) {
+       struct memory_page *last;
+       struct memory_page *first;
+       int moved_words = tail->word_count;
+       int i = 0;
+       int offset;
+
+       /* A page shared by both images is merged word by word */
+       if (image->page_count > 0 && tail->page_count > 0 &&
+           image->pages[image->page_count - 1]->page_number == tail->pages[0]->page_number) {
+              last = image->pages[image->page_count - 1];
+              first = tail->pages[0];
+              for (offset = 0; offset < MEMORY_PAGE_SIZE; offset++) {
+                     if (first->used[offset / CHAR_BIT] & (1 << (offset % CHAR_BIT))) {
+                            moved_words--;
+                            if (!(last->used[offset / CHAR_BIT] & (1 << (offset % CHAR_BIT)))) {
+                                   last->used[offset / CHAR_BIT] |= (1 << (offset % CHAR_BIT));
+                                   image->word_count++;
+                            }
+                            memcpy(&last->words[offset * MEMORY_WORD_BYTES], &first->words[offset * MEMORY_WORD_BYTES], MEMORY_WORD_BYTES);
+                     }
+              }
+              i = 1;
+       }
+
+       /* The remaining pages are moved, not copied */
+       for (; i < tail->page_count; i++) {
+              if (!ensure_memory_pages_capacity(image))
+                     return 0;
+              image->pages[image->page_count++] = tail->pages[i];
+              tail->pages[i] = NULL;
+       }
+       image->word_count += moved_words;
+
+       free_memory_image(tail);
+       return 1;
+}
+
+
+void free_memory_image(struct memory_image *image) {
+       int i;
+
+       for (i = 0; i < image->page_count; i++) {
+              mem_free(image->pages[i]);
+       }
+       mem_free(image->pages);
+       memset(image, 0, sizeof(*image));
+}
@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "../header_files/options.h"
+#include "../header_files/preprocessor.h"
+#include "../header_files/out_of_core.h"
+#include "../header_files/translation_unit.h"
+
+#define DECIMAL_BASE 10
+
+
+struct assembler_options options = {0};
+
+
+/* Reads an integer option value from 0 to INT_MAX, returns FALSE if it is missing, malformed or out of range */
+static int option_number(const char *str, int *value) {
+       char *end;
+       long number;
+
+       if (str == NULL)
+              return FALSE;
+
+       errno = 0;
+       number = strtol(str, &end, DECIMAL_BASE);
+       if (*str == '\0' || *end != '\0' || errno == ERANGE || number < 0 || number > INT_MAX)
+              return FALSE;
+
+       *value = (int)number;
+       return TRUE;
+}
+
+
+int parse_options(int argc, char const *argv[]) {
+       int i;
+
+       for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+              if (strcmp(argv[i], "--max-errors") == STRCMP_TRUE) {
+                     if (!option_number(i + 1 < argc ? argv[i + 1] : NULL, &options.max_errors)) {
+                            printf("Option --max-errors expects a number from 0 to %d\n", INT_MAX);
+                            return 0;
+                     }
+                     i++;
+              }
+              else if (strcmp(argv[i], "--jobs") == STRCMP_TRUE) {
+                     if (!option_number(i + 1 < argc ? argv[i + 1] : NULL, &options.jobs) || options.jobs > MAX_JOBS) {
+                            printf("Option --jobs expects a number from 0 to %d\n", MAX_JOBS);
+                            return 0;
+                     }
+                     i++;
+              }
+              else if (strcmp(argv[i], "--pipeline") == STRCMP_TRUE) {
+                     options.pipeline = TRUE;
+              }
+              else if (strcmp(argv[i], "--listing") == STRCMP_TRUE) {
+                     options.listing = TRUE;
+              }
+              else if (strcmp(argv[i], "--stream") == STRCMP_TRUE) {
+                     options.stream = TRUE;
+              }
+              else if (strcmp(argv[i], "--profile") == STRCMP_TRUE) {
+                     options.profile = TRUE;
+              }
+              else if (strcmp(argv[i], "--alloc-stats") == STRCMP_TRUE) {
+                     options.alloc_stats = TRUE;
+              }
+              else if (strcmp(argv[i], "--optimize") == STRCMP_TRUE) {
+                     options.optimize = TRUE;
+              }
+              else if (strcmp(argv[i], "--watch") == STRCMP_TRUE) {
+                     options.watch = TRUE;
+              }
+              else if (strcmp(argv[i], "--check") == STRCMP_TRUE) {
+                     options.check = TRUE;
+              }
+              else if (strcmp(argv[i], "-MD") == STRCMP_TRUE) {
+                     options.dependencies = TRUE;
+              }
+              else if (strcmp(argv[i], "--pool-data") == STRCMP_TRUE) {
+                     options.pool_data = TRUE;
+              }
+              else if (strcmp(argv[i], "--relocations") == STRCMP_TRUE) {
+                     options.relocations = TRUE;
+              }
+              else if (strcmp(argv[i], "--rebase") == STRCMP_TRUE) {
+                     if (!option_number(i + 1 < argc ? argv[i + 1] : NULL, &options.rebase_address) ||
+                         options.rebase_address > MAX_ADDRESS) {
+                            printf("Option --rebase expects an address from 0 to %d\n", MAX_ADDRESS);
+                            return 0;
+                     }
+                     options.rebase = TRUE;
+                     i++;
+              }
+              else if (strcmp(argv[i], "--memory-budget") == STRCMP_TRUE) {
+                     if (!option_number(i + 1 < argc ? argv[i + 1] : NULL, &options.memory_budget) ||
+                         options.memory_budget < MIN_MEMORY_BUDGET) {
+                            printf("Option --memory-budget expects a size in KiB from %d to %d\n", MIN_MEMORY_BUDGET, INT_MAX);
+                            return 0;
+                     }
+                     i++;
+              }
+              else if (strcmp(argv[i], "--macro-lib") == STRCMP_TRUE) {
+                     if (i + 1 >= argc) {
+                            printf("Option --macro-lib expects a file name\n");
+                            return 0;
+                     }
+                     options.macro_library = argv[++i];
+              }
+              else if (strcmp(argv[i], "--build-macro-lib") == STRCMP_TRUE) {
+                     if (i + 1 >= argc) {
+                            printf("Option --build-macro-lib expects a file name\n");
+                            return 0;
+                     }
+                     options.build_macro_library = argv[++i];
+              }
+              else if (strcmp(argv[i], "--trace") == STRCMP_TRUE) {
+                     if (i + 1 >= argc) {
+                            printf("Option --trace expects a file name\n");
+                            return 0;
+                     }
+                     options.trace = argv[++i];
+              }
+              else if (strcmp(argv[i], "--json") == STRCMP_TRUE) {
+                     options.json = TRUE;
+              }
+              else {
+                     printf("Unknown option: %s\n", argv[i]);
+                     return 0;
+              }
+       }
+
+       return i;
+}
+
+
+void print_usage(void) {
+       printf("Usage: assembler [--max-errors N] [--json] [--jobs N] [--pipeline] [--listing] [--stream] [--profile] [--alloc-stats] [--optimize] [--pool-data] [--watch] [--check] [-MD] [--relocations] [--rebase BASE] [--memory-budget KIB] [--macro-lib LIB] [--build-macro-lib LIB] [--trace FILE] file1 [file2 ...]\n");
+}
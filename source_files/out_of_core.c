@@ -0,0 +1,645 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../header_files/out_of_core.h"
+#include "../header_files/first_pass.h"
+#include "../header_files/second_pass.h"
+#include "../header_files/encoding.h"
+#include "../header_files/mem_alloc.h"
+#include "../header_files/diagnostics.h"
+#include "../header_files/output.h"
+#include "../header_files/profile.h"
+#include "../header_files/options.h"
+
+#define NO_RANK (-1)
+#define NO_REPORT (-1)
+
+
+/* A temporary file and the buffer stdio uses for it */
+struct spill {
+       FILE *file;
+       char *buffer;
+       const char *name;   /* What it holds, for diagnostics */
+       long count;         /* Records written */
+};
+
+/* A sorted stretch of the extern references file */
+struct sorted_run {
+       long offset;   /* First record */
+       long count;    /* Number of records */
+};
+
+/* Reads one sorted run a block at a time */
+struct run_reader {
+       long next;                       /* Next record of the run still in the file */
+       long left;                       /* Records of the run still in the file */
+       struct spilled_extern *block;    /* Records read, a slice of the sort memory */
+       long block_count;                /* Records in block */
+       long position;                   /* Current record in block */
+};
+
+/* State of assembling one file */
+struct out_of_core {
+       struct translation_unit *prog;
+       const char *base_name;
+       long budget;                 /* Bytes */
+       struct spill code;           /* struct spilled_word, in address order */
+       struct spill fixups;         /* struct fixup, in line order */
+       struct spill data;           /* int, in data address order */
+       struct spill externs;        /* struct spilled_extern, in address order */
+       int runs;                    /* Sorted runs of the extern references */
+       int failed;                  /* TRUE if a spill file could not be written or read */
+       int over_budget;             /* TRUE if the symbol table outgrew its share */
+};
+
+
+/* Creates a temporary file with a buffer of the given size */
+static int open_spill(struct spill *spill, const char *name, long size) {
+       spill->name = name;
+       spill->count = 0;
+       spill->file = tmpfile();
+       spill->buffer = mem_malloc((size_t)size);
+       if (!spill->file || !spill->buffer || setvbuf(spill->file, spill->buffer, _IOFBF, (size_t)size) != 0) {
+              diag_report(DIAG_SPILL_FAILED, NO_LINE, name);
+              return FALSE;
+       }
+       return TRUE;
+}
+
+
+static void close_spill(struct spill *spill) {
+       if (spill->file)
+              fclose(spill->file);
+       mem_free(spill->buffer);
+       spill->file = NULL;
+       spill->buffer = NULL;
+}
+
+
+/* Appends one record; a failure is reported once, when the spill is read back */
+static void spill_write(struct out_of_core *state, struct spill *spill, const void *record, size_t size) {
+       if (fwrite(record, size, 1, spill->file) != 1)
+              state->failed = TRUE;
+       spill->count++;
+}
+
+
+/* Prepares a spill for reading from its start */
+static int spill_rewind(struct out_of_core *state, struct spill *spill) {
+       if (fflush(spill->file) != 0 || ferror(spill->file) || state->failed) {
+              diag_report(DIAG_SPILL_FAILED, NO_LINE, spill->name);
+              state->failed = TRUE;
+              return FALSE;
+       }
+       rewind(spill->file);
+       return TRUE;
+}
+
+
+/* Encodes an instruction: known words go to the code spill, label operands become fixups */
+static void spill_instruction(struct out_of_core *state, const struct ast *line_struct, int address, int line) {
+       struct spilled_word word;
+       struct fixup fixup;
+       int ic = address;
+       int type;
+       int i;
+
+       if (address != NO_FIXUP_ADDRESS) {
+              word.address = ic++;
+              word.word = instruction_first_word(line_struct);
+              spill_write(state, &state->code, &word, sizeof(word));
+       }
+
+       for (i = 0; i < line_struct->ast_options.ast_instruction.number_of_operands; i++) {
+              type = line_struct->ast_options.ast_instruction.oprand[i].oprand_type;
+
+              /* A line with a syntax error only keeps its fixups, so undefined labels are still reported */
+              if (type == ast_direct || type == ast_relative) {
+                     memset(&fixup, 0, sizeof(fixup));
+                     fixup.address = (address == NO_FIXUP_ADDRESS) ? NO_FIXUP_ADDRESS : ic;
+                     fixup.instruction_address = address;
+                     fixup.line = line;
+                     fixup.kind = (type == ast_direct) ? FIXUP_DIRECT : FIXUP_RELATIVE;
+                     strncpy(fixup.label, line_struct->ast_options.ast_instruction.oprand[i].oprand_options.label, MAX_LABEL_LEN);
+                     spill_write(state, &state->fixups, &fixup, sizeof(fixup));
+                     word.word = 0;
+              }
+              else if (type == ast_instant) {
+                     word.word = (line_struct->ast_options.ast_instruction.oprand[i].oprand_options.number << ARE_SHIFT) | A;
+              }
+              else {
+                     continue;
+              }
+
+              if (address != NO_FIXUP_ADDRESS) {
+                     word.address = ic++;
+                     spill_write(state, &state->code, &word, sizeof(word));
+              }
+       }
+}
+
+
+/* Moves the data words of a one-line chunk to the data spill */
+static void spill_data(struct out_of_core *state, const struct first_pass_chunk *chunk) {
+       const unsigned char *bytes;
+       int word;
+       int i, e;
+
+       for (i = 0; i < chunk->data_count; i++)
+              spill_write(state, &state->data, &chunk->data[i], sizeof(int));
+
+       for (e = 0; e < chunk->event_count; e++) {
+              if (chunk->events[e].type != EVENT_INCBIN)
+                     continue;
+              bytes = chunk->events[e].blob.bytes;
+              for (i = 0; i < chunk->events[e].blob.words; i++, bytes += MEMORY_WORD_BYTES) {
+                     word = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16);
+                     spill_write(state, &state->data, &word, sizeof(int));
+              }
+       }
+}
+
+
+/* TRUE if the symbol table, with the two per-symbol arrays of the merge pass, still fits its share */
+static int symbols_fit(const struct out_of_core *state) {
+       return (long)state->prog->symCapacity * (long)(sizeof(struct symbol) + sizeof(struct symbol *) + 2 * sizeof(int))
+              <= state->budget / SYMBOL_SHARE;
+}
+
+
+/*
+ * First pass: reads the .am file a line at a time, merging each line into the symbol
+ * table and spilling its code words, fixups and data words.
+ */
+static int read_source(struct out_of_core *state) {
+       char line[MAX_LINE_LEN + 1];
+       char share[MAX_LINE_LEN + 1];
+       struct first_pass_chunk chunk = {0};
+       struct first_pass_merge merge;
+       struct ast line_struct;
+       char *am_file_name = build_filename(state->base_name, ".am");
+       FILE *am_file = am_file_name ? fopen(am_file_name, "r") : NULL;
+       int syntax_error;
+       int error = FALSE;
+
+       if (!am_file) {
+              diag_report(DIAG_OPEN_FAILED, NO_LINE, am_file_name);
+              mem_free(am_file_name);
+              return TRUE;
+       }
+
+       first_pass_merge_start(&merge);
+       while (fgets(line, sizeof(line), am_file) != NULL) {
+              remove_newline(line);
+              line_struct = line_ast(line);
+              syntax_error = line_struct.error != NULL && line_struct.error[0] != '\0';
+
+              /* Encoded before merging, while merge.ic is still the line's own address */
+              if (line_struct.ast_type == instruction)
+                     spill_instruction(state, &line_struct, syntax_error ? NO_FIXUP_ADDRESS : merge.ic, merge.line);
+
+              first_pass_record_line(&chunk, &line_struct);
+              error |= merge_first_pass_chunk(state->prog, &chunk, &merge);
+              spill_data(state, &chunk);
+              reset_first_pass_chunk(&chunk);
+
+              if (!symbols_fit(state)) {
+                     sprintf(share, "%ld KiB", state->budget / SYMBOL_SHARE / KIB);
+                     diag_report(DIAG_MEMORY_BUDGET, merge.line - 1, share);
+                     state->over_budget = TRUE;
+                     error = TRUE;
+                     break;
+              }
+       }
+
+       free_first_pass_chunk(&chunk);
+       fclose(am_file);
+       mem_free(am_file_name);
+       return finish_first_pass(state->prog, &merge) | error;
+}
+
+
+/* Computes the word of a fixup; returns the diagnostic it needs, or NO_REPORT */
+static int resolve_fixup(struct out_of_core *state, const struct fixup *fixup, int *rank_of_symbol, int *next_rank, int *word) {
+       struct translation_unit *prog = state->prog;
+       struct spilled_extern use;
+       struct symbol *symbol = symbolLookUp(prog->symbol_table, prog->symCount, fixup->label);
+
+       *word = 0;
+       if (!symbol)
+              return DIAG_UNDEFINED_LABEL;
+
+       if (fixup->kind == FIXUP_RELATIVE) {
+              *word = ((symbol->address - fixup->instruction_address) << ARE_SHIFT) | A;
+              return symbol->symType == symExtern ? DIAG_RELATIVE_EXTERN : NO_REPORT;
+       }
+
+       *word = symbol->address << ARE_SHIFT;
+       if (symbol->symType != symExtern) {
+              *word |= R;
+              return NO_REPORT;
+       }
+
+       /* Symbols are ranked by first use, the order of the .ext file */
+       *word |= E;
+       if (fixup->address != NO_FIXUP_ADDRESS) {
+              use.symbol = symbol - prog->symbol_table;
+              if (rank_of_symbol[use.symbol] == NO_RANK)
+                     rank_of_symbol[use.symbol] = (*next_rank)++;
+              use.rank = rank_of_symbol[use.symbol];
+              use.address = fixup->address;
+              spill_write(state, &state->externs, &use, sizeof(use));
+       }
+       return NO_REPORT;
+}
+
+
+/* Copies code words to the .ob file up to (not including) an address; returns FALSE at the end of the spill */
+static int copy_code(struct out_of_core *state, FILE *ob, struct spilled_word *word, int *have_word, int address) {
+       while (*have_word && word->address < address) {
+              print_ob_line(ob, word->address, word->word);
+              *have_word = (fread(word, sizeof(*word), 1, state->code.file) == 1);
+       }
+       return *have_word;
+}
+
+
+/*
+ * Merge pass: patches the spilled code words with the resolved fixups and writes the
+ * .ob file (only if no error was found). Reports the operand errors in line order.
+ */
+static int write_object(struct out_of_core *state, int error) {
+       struct translation_unit *prog = state->prog;
+       struct spilled_word word;
+       struct fixup fixup;
+       char *ob_path = NULL;
+       char *final_path = NULL;
+       char *rel_path = NULL;
+       char *rel_final_path = NULL;
+       FILE *ob = NULL;
+       FILE *rel = NULL;
+       int *rank_of_symbol;
+       int next_rank = 0;
+       int have_word = FALSE;
+       int last_line = NO_LINE;
+       int report;
+       int data;
+       long i;
+
+       rank_of_symbol = mem_malloc((prog->symCount > 0 ? prog->symCount : 1) * sizeof(int));
+       if (!rank_of_symbol) {
+              diag_report(DIAG_NO_MEMORY, NO_LINE, "extern ranks");
+              return TRUE;
+       }
+       for (i = 0; i < prog->symCount; i++)
+              rank_of_symbol[i] = NO_RANK;
+
+       if (!spill_rewind(state, &state->code) || !spill_rewind(state, &state->fixups) || !spill_rewind(state, &state->data)) {
+              mem_free(rank_of_symbol);
+              return TRUE;
+       }
+
+       /* Written under a temporary name, like a streamed .ob file, and renamed when complete */
+       if (!error) {
+              ob_path = build_filename(state->base_name, OB_STREAM_EXTENSION);
+              final_path = build_filename(state->base_name, ".ob");
+              ob = (ob_path && final_path) ? fopen(ob_path, "w") : NULL;
+              if (!ob) {
+                     diag_report(DIAG_OPEN_FAILED, NO_LINE, ob_path ? ob_path : state->base_name);
+                     error = TRUE;
+              }
+              else {
+                     fprintf(ob, "%d %d\n", prog->IC, prog->DC);
+                     have_word = (fread(&word, sizeof(word), 1, state->code.file) == 1);
+              }
+       }
+
+       /* Fixups arrive in address order, so the relocation table is written as they resolve */
+       if (ob && options.relocations) {
+              rel_path = build_filename(state->base_name, ".rel.part");
+              rel_final_path = build_filename(state->base_name, ".rel");
+              rel = (rel_path && rel_final_path) ? fopen(rel_path, "w") : NULL;
+              if (!rel) {
+                     diag_report(DIAG_OPEN_FAILED, NO_LINE, rel_path ? rel_path : state->base_name);
+                     error = TRUE;
+              }
+              else {
+                     fprintf(rel, "%d\n", STARTING_ADDRESS);
+              }
+       }
+
+       while (fread(&fixup, sizeof(fixup), 1, state->fixups.file) == 1) {
+              report = resolve_fixup(state, &fixup, rank_of_symbol, &next_rank, &data);
+              if (report != NO_REPORT) {
+                     /* Like the normal second pass, stop before a new line once the limit is reached */
+                     if (fixup.line != last_line && diag_limit_reached())
+                            break;
+                     diag_report(report, fixup.line, fixup.label);
+                     last_line = fixup.line;
+                     error = TRUE;
+              }
+
+              if (ob && !error && fixup.address != NO_FIXUP_ADDRESS && copy_code(state, ob, &word, &have_word, fixup.address))
+                     word.word = data;
+              if (rel && !error && report == NO_REPORT && fixup.address != NO_FIXUP_ADDRESS && (data & R))
+                     fprintf(rel, "%07d\n", fixup.address);
+       }
+
+       if (ob && !error) {
+              copy_code(state, ob, &word, &have_word, MAX_ADDRESS + 1);
+
+              /* The data section follows the last instruction */
+              for (i = 0; fread(&data, sizeof(int), 1, state->data.file) == 1; i++)
+                     print_ob_line(ob, prog->ICF + (int)i, data);
+              if (ferror(state->code.file) || ferror(state->data.file)) {
+                     diag_report(DIAG_SPILL_FAILED, NO_LINE, state->code.name);
+                     error = TRUE;
+              }
+       }
+
+       if (ob) {
+              if (fclose(ob) != 0 && !error) {
+                     diag_report(DIAG_OPEN_FAILED, NO_LINE, ob_path);
+                     error = TRUE;
+              }
+              if (error || rename(ob_path, final_path) != 0) {
+                     if (!error)
+                            diag_report(DIAG_OPEN_FAILED, NO_LINE, final_path);
+                     remove(ob_path);
+                     error = TRUE;
+              }
+       }
+
+       if (rel) {
+              if (fclose(rel) != 0 && !error) {
+                     diag_report(DIAG_OPEN_FAILED, NO_LINE, rel_path);
+                     error = TRUE;
+              }
+              if (error || rename(rel_path, rel_final_path) != 0) {
+                     if (!error)
+                            diag_report(DIAG_OPEN_FAILED, NO_LINE, rel_final_path);
+                     remove(rel_path);
+                     error = TRUE;
+              }
+       }
+
+       mem_free(ob_path);
+       mem_free(final_path);
+       mem_free(rel_path);
+       mem_free(rel_final_path);
+       mem_free(rank_of_symbol);
+       return error;
+}
+
+
+/* Orders extern references by the first use of their symbol, then by address */
+static int compare_externs(const void *a, const void *b) {
+       const struct spilled_extern *first = a;
+       const struct spilled_extern *second = b;
+
+       if (first->rank != second->rank)
+              return first->rank < second->rank ? -1 : 1;
+       return (first->address > second->address) - (first->address < second->address);
+}
+
+
+/* Makes the current record of a run available; returns FALSE once the run is exhausted */
+static int fill_reader(struct run_reader *reader, FILE *input, long slice) {
+       long count;
+
+       if (reader->position < reader->block_count)
+              return TRUE;
+       if (reader->left == 0)
+              return FALSE;
+
+       count = reader->left < slice ? reader->left : slice;
+       if (fseek(input, reader->next * (long)sizeof(struct spilled_extern), SEEK_SET) != 0 ||
+           fread(reader->block, sizeof(struct spilled_extern), (size_t)count, input) != (size_t)count)
+              return FALSE;
+       reader->next += count;
+       reader->left -= count;
+       reader->block_count = count;
+       reader->position = 0;
+       return TRUE;
+}
+
+
+static void print_extern(FILE *ext, const struct translation_unit *prog, const struct spilled_extern *use) {
+       fprintf(ext, "%s\t%07d\n", prog->symbol_table[use->symbol].symName, use->address);
+}
+
+
+/*
+ * Merges up to MERGE_FAN_IN sorted runs of input, either into one run appended to
+ * output or, if output is NULL, into the .ext file. memory holds MERGE_FAN_IN + 1
+ * slices: one block per run and one for the output.
+ */
+static int merge_runs(struct out_of_core *state, FILE *input, const struct sorted_run *runs, int count,
+                      FILE *output, FILE *ext, struct spilled_extern *memory, long slice) {
+       struct run_reader readers[MERGE_FAN_IN];
+       struct spilled_extern *out_block = memory + MERGE_FAN_IN * slice;
+       long out_count = 0;
+       long total = 0;
+       int best;
+       int r;
+
+       for (r = 0; r < count; r++) {
+              readers[r].next = runs[r].offset;
+              readers[r].left = runs[r].count;
+              readers[r].block = memory + r * slice;
+              readers[r].block_count = 0;
+              readers[r].position = 0;
+              total += runs[r].count;
+       }
+
+       for (; total > 0; total--) {
+              best = -1;
+              for (r = 0; r < count; r++) {
+                     if (fill_reader(&readers[r], input, slice) &&
+                         (best < 0 || compare_externs(&readers[r].block[readers[r].position],
+                                                      &readers[best].block[readers[best].position]) < 0))
+                            best = r;
+              }
+              if (best < 0)
+                     return FALSE;   /* A run could not be read back */
+
+              if (output) {
+                     out_block[out_count++] = readers[best].block[readers[best].position];
+                     if (out_count == slice) {
+                            if (fwrite(out_block, sizeof(struct spilled_extern), (size_t)out_count, output) != (size_t)out_count)
+                                   return FALSE;
+                            out_count = 0;
+                     }
+              }
+              else {
+                     print_extern(ext, state->prog, &readers[best].block[readers[best].position]);
+              }
+              readers[best].position++;
+       }
+
+       return out_count == 0 || fwrite(out_block, sizeof(struct spilled_extern), (size_t)out_count, output) == (size_t)out_count;
+}
+
+
+/* Opens an unbuffered temporary file; all buffering of the sort uses its own share of the budget */
+static FILE *open_run_file(void) {
+       FILE *file = tmpfile();
+
+       if (file && setvbuf(file, NULL, _IONBF, 0) != 0) {
+              fclose(file);
+              return NULL;
+       }
+       return file;
+}
+
+
+/*
+ * Sorts the extern references with an external merge sort and writes the .ext file:
+ * runs that fit the sort share are sorted in memory, then merged MERGE_FAN_IN at a time.
+ */
+static int write_externals(struct out_of_core *state, FILE *ext) {
+       long run_capacity = state->budget / SORT_SHARE / (long)sizeof(struct spilled_extern);
+       long slice = run_capacity / (MERGE_FAN_IN + 1);
+       struct spilled_extern *memory;
+       struct sorted_run *runs;
+       struct sorted_run group;
+       FILE *input = NULL;
+       FILE *output;
+       long written;
+       long count;
+       int run_count;
+       int ok = TRUE;
+       int g, r;
+
+       if (slice < 1) {
+              slice = 1;
+              run_capacity = MERGE_FAN_IN + 1;
+       }
+       run_count = (int)((state->externs.count + run_capacity - 1) / run_capacity);
+       memory = mem_malloc((size_t)run_capacity * sizeof(struct spilled_extern));
+       runs = mem_malloc((size_t)run_count * sizeof(struct sorted_run));
+       if (!memory || !runs) {
+              diag_report(DIAG_NO_MEMORY, NO_LINE, "extern sort");
+              mem_free(memory);
+              mem_free(runs);
+              return FALSE;
+       }
+       state->runs = run_count;
+
+       /* Sorted runs, back to back in one file; a single run is written out directly */
+       if (run_count > 1 && !(input = open_run_file()))
+              ok = FALSE;
+       for (r = 0; r < run_count && ok; r++) {
+              count = (long)fread(memory, sizeof(struct spilled_extern), (size_t)run_capacity, state->externs.file);
+              qsort(memory, (size_t)count, sizeof(struct spilled_extern), compare_externs);
+              if (run_count == 1) {
+                     for (g = 0; g < count; g++)
+                            print_extern(ext, state->prog, &memory[g]);
+                     break;
+              }
+              runs[r].offset = (long)r * run_capacity;
+              runs[r].count = count;
+              ok = fwrite(memory, sizeof(struct spilled_extern), (size_t)count, input) == (size_t)count;
+       }
+
+       /* Merge rounds until one final merge can write the file */
+       while (ok && run_count > MERGE_FAN_IN) {
+              output = open_run_file();
+              written = 0;
+              for (g = 0; ok && g * MERGE_FAN_IN < run_count; g++) {
+                     count = (run_count - g * MERGE_FAN_IN < MERGE_FAN_IN) ? run_count - g * MERGE_FAN_IN : MERGE_FAN_IN;
+                     group.offset = written;
+                     group.count = 0;
+                     for (r = 0; r < count; r++)
+                            group.count += runs[g * MERGE_FAN_IN + r].count;
+                     ok = output && merge_runs(state, input, &runs[g * MERGE_FAN_IN], (int)count, output, NULL, memory, slice);
+
+                     /* Runs before g * MERGE_FAN_IN are merged already, so the array is reused */
+                     runs[g] = group;
+                     written += group.count;
+              }
+              fclose(input);
+              input = output;
+              run_count = g;
+       }
+       if (ok && run_count > 1)
+              ok = merge_runs(state, input, runs, run_count, NULL, ext, memory, slice);
+
+       if (input)
+              fclose(input);
+       mem_free(memory);
+       mem_free(runs);
+       return ok;
+}
+
+
+/* Writes the .ext file from the spilled extern references */
+static int print_externals(struct out_of_core *state) {
+       char *ext_file_name;
+       FILE *ext;
+       int ok;
+
+       if (state->externs.count == 0)
+              return FALSE;
+       if (!spill_rewind(state, &state->externs))
+              return TRUE;
+
+       ext_file_name = build_filename(state->base_name, ".ext");
+       ext = ext_file_name ? fopen(ext_file_name, "w") : NULL;
+       if (!ext) {
+              diag_report(DIAG_OPEN_FAILED, NO_LINE, ext_file_name);
+              mem_free(ext_file_name);
+              return TRUE;
+       }
+
+       ok = write_externals(state, ext);
+       if (fclose(ext) != 0 || !ok) {
+              diag_report(DIAG_SPILL_FAILED, NO_LINE, state->externs.name);
+              remove(ext_file_name);
+              ok = FALSE;
+       }
+       mem_free(ext_file_name);
+       return !ok;
+}
+
+
+int out_of_core_assemble(struct translation_unit *prog, const char *base_name, long budget) {
+       struct out_of_core state;
+       long buffer = budget / SPILL_BUFFER_SHARE;
+       int opened;
+       int error;
+
+       memset(&state, 0, sizeof(state));
+       state.prog = prog;
+       state.base_name = base_name;
+       state.budget = budget;
+
+       diag_set_phase(PHASE_FIRST_PASS);
+       profile_phase(PHASE_FIRST_PASS);
+       opened = open_spill(&state.code, "code", buffer) && open_spill(&state.fixups, "fixup", buffer) &&
+                open_spill(&state.data, "data", buffer) && open_spill(&state.externs, "extern", buffer);
+       error = !opened || read_source(&state);
+
+       /* As in the normal passes, operand errors are reported even after a failed first pass */
+       diag_set_phase(PHASE_SECOND_PASS);
+       profile_phase(PHASE_SECOND_PASS);
+       if (opened && !state.over_budget)
+              error |= write_object(&state, error);
+
+       if (!error) {
+              diag_set_phase(PHASE_OUTPUT);
+              profile_phase(PHASE_OUTPUT);
+              print_ent_file(base_name, prog);
+              error |= print_externals(&state);
+              fprintf(stderr, "%s: out of core in %ld KiB, spilled %ld code words, %ld fixups, %ld data words, "
+                      "%ld extern references in %d run%s\n", base_name, budget / KIB, state.code.count,
+                      state.fixups.count, state.data.count, state.externs.count, state.runs, state.runs == 1 ? "" : "s");
+       }
+
+       close_spill(&state.code);
+       close_spill(&state.fixups);
+       close_spill(&state.data);
+       close_spill(&state.externs);
+       return error;
+}
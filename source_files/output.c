@@ -4,6 +4,7 @@
 #include "../header_files/translation_unit.h"
 #include "../header_files/mem_alloc.h"
 #include "../header_files/output.h"
+#include "../header_files/diagnostics.h"
 
 void print_24bit_as_hex(FILE *f, int value) {
        const char hexTable[] = {
@@ -28,52 +29,139 @@ void print_24bit_as_hex(FILE *f, int value) {
 }
 
 
+void print_ob_line(FILE *f, int address, int word) {
+       fprintf(f, "%07d ", address);
+       print_24bit_as_hex(f, word);
+       fputc('\n', f);
+}
+
+
 void print_ob_file(const char *bname, const struct translation_unit *program) {
        char *obFileName;
        FILE *obFile;
-       int i, word;
+       int word;
        int address;
-       const int start_address = STARTING_ADDRESS;
+       struct memory_cursor cursor;
 
        /* Build output filename with .ob extension */
        obFileName = build_filename(bname, ".ob");
        if (!obFileName) {
-              fprintf(stderr, "Memory allocation failed.\n");
+              diag_report(DIAG_NO_MEMORY, NO_LINE, "file name");
               return;
        }
 
        /* Open the .ob file for writing */
        obFile = fopen(obFileName, "w");
        if (!obFile) {
-              fprintf(stderr, "Could not open file: %s\n", obFileName);
-              free(obFileName);
+              diag_report(DIAG_OPEN_FAILED, NO_LINE, obFileName);
+              mem_free(obFileName);
               return;
        }
 
        /* Write the IC and DC values as a header line */
        fprintf(obFile, "%d %d\n", program->IC, program->DC);
 
-       address = start_address;
-
-       /* Write code section: each instruction word */
-       for (i = 0; i < program->IC; i++, address++) {
-              word = program->code_image[i];
-              fprintf(obFile, "%07d ", address);
-              print_24bit_as_hex(obFile, word);
-              fputc('\n', obFile);
+       /* Write code section: only the addresses that hold instruction words */
+       memory_cursor_start(&cursor);
+       while (memory_next(&program->code_image, &cursor, &address, &word)) {
+              print_ob_line(obFile, address, word);
        }
 
-       /* Write data section: each data word */
-       for (i = 0; i < program->DC; i++, address++) {
-              word = program->data_image[i];
-              fprintf(obFile, "%07d ", address);
-              print_24bit_as_hex(obFile, word);
-              fputc('\n', obFile);
+       /* Write data section: each data word, placed after the last instruction */
+       memory_cursor_start(&cursor);
+       while (memory_next(&program->data_image, &cursor, &address, &word)) {
+              print_ob_line(obFile, program->ICF + address, word);
        }
 
        /* Close file and free filename memory */
        fclose(obFile);
-       free(obFileName);
+       mem_free(obFileName);
+}
+
+
+static void free_ob_stream(struct ob_stream *stream) {
+       mem_free(stream->path);
+       mem_free(stream->final_path);
+       stream->path = NULL;
+       stream->final_path = NULL;
+}
+
+
+int ob_stream_open(struct ob_stream *stream, const char *bname, const struct translation_unit *program) {
+       FILE *obFile;
+       int length;
+
+       stream->path = build_filename(bname, OB_STREAM_EXTENSION);
+       stream->final_path = build_filename(bname, ".ob");
+       if (!stream->path || !stream->final_path) {
+              diag_report(DIAG_NO_MEMORY, NO_LINE, "file name");
+              free_ob_stream(stream);
+              return 0;
+       }
+
+       /* The header is final already: the first pass counted IC and DC */
+       obFile = fopen(stream->path, "wb");
+       if (!obFile) {
+              diag_report(DIAG_OPEN_FAILED, NO_LINE, stream->path);
+              free_ob_stream(stream);
+              return 0;
+       }
+       length = fprintf(obFile, "%d %d\n", program->IC, program->DC);
+       if (fclose(obFile) != 0 || length < 0) {
+              diag_report(DIAG_OPEN_FAILED, NO_LINE, stream->path);
+              remove(stream->path);
+              free_ob_stream(stream);
+              return 0;
+       }
+
+       stream->code_offset = length;
+       return 1;
+}
+
+
+FILE *ob_stream_seek(const struct ob_stream *stream, int first_word) {
+       FILE *obFile = fopen(stream->path, "r+b");
+
+       if (obFile && fseek(obFile, stream->code_offset + (long)first_word * OB_LINE_LENGTH, SEEK_SET) != 0) {
+              fclose(obFile);
+              return NULL;
+       }
+       return obFile;
+}
+
+
+void ob_stream_finish(struct ob_stream *stream, const struct translation_unit *program) {
+       FILE *obFile;
+       int word;
+       int address;
+       struct memory_cursor cursor;
+
+       /* The data section follows the last code line */
+       obFile = ob_stream_seek(stream, program->IC);
+       if (!obFile) {
+              diag_report(DIAG_OPEN_FAILED, NO_LINE, stream->path);
+              ob_stream_discard(stream);
+              return;
+       }
+
+       memory_cursor_start(&cursor);
+       while (memory_next(&program->data_image, &cursor, &address, &word)) {
+              print_ob_line(obFile, program->ICF + address, word);
+       }
+
+       if (fclose(obFile) != 0 || rename(stream->path, stream->final_path) != 0) {
+              diag_report(DIAG_OPEN_FAILED, NO_LINE, stream->final_path);
+              ob_stream_discard(stream);
+              return;
+       }
+       free_ob_stream(stream);
+}
+
+
+void ob_stream_discard(struct ob_stream *stream) {
+       if (stream->path)
+              remove(stream->path);
+       free_ob_stream(stream);
 }
 
 
@@ -92,8 +180,8 @@ void print_ent_file(const char *bname, const struct translation_unit *program) {
 
        /* Check if file was opened successfully */
        if (!entFile) {
-              printf("Error: Could not create file %s\n", entFileName);
-              free(entFileName);
+              diag_report(DIAG_OPEN_FAILED, NO_LINE, entFileName);
+              mem_free(entFileName);
               return;
        }
 
@@ -106,7 +194,7 @@ void print_ent_file(const char *bname, const struct translation_unit *program) {
 
        /* Close the file and free memory */
        fclose(entFile);
-       free(entFileName);
+       mem_free(entFileName);
 }
 
 
@@ -145,9 +233,37 @@ void print_ext_file(const char *bname, const struct translation_unit *program) {
 
        else
        {
-              printf("Error: Could not create file %s\n", extFileName);
+              diag_report(DIAG_OPEN_FAILED, NO_LINE, extFileName);
        }
 
     /* Free the allocated memory for the filename */
-    free(extFileName);
+    mem_free(extFileName);
+}
+
+
+void print_rel_file(const char *bname, const struct translation_unit *program) {
+       char *relFileName;
+       FILE *relFile;
+       int i;
+
+       relFileName = build_filename(bname, ".rel");
+       if (!relFileName) {
+              diag_report(DIAG_NO_MEMORY, NO_LINE, "file name");
+              return;
+       }
+
+       relFile = fopen(relFileName, "w");
+       if (!relFile) {
+              diag_report(DIAG_OPEN_FAILED, NO_LINE, relFileName);
+              mem_free(relFileName);
+              return;
+       }
+
+       /* The base the addresses are relative to, then one relocated word per line */
+       fprintf(relFile, "%d\n", STARTING_ADDRESS);
+       for (i = 0; i < program->relocation_count; i++)
+              fprintf(relFile, "%07d\n", program->relocations[i]);
+
+       fclose(relFile);
+       mem_free(relFileName);
 }
@@ -0,0 +1,158 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "../header_files/parallel.h"
+#include "../header_files/mem_alloc.h"
+#include "../header_files/trace.h"
+
+#define TRUE 1
+#define FALSE 0
+
+
+/* Start barrier shared by the threads of parallel_run_together() */
+struct start_barrier {
+       pthread_mutex_t lock;
+       pthread_cond_t changed;
+       int state;   /* BARRIER_WAIT, BARRIER_GO or BARRIER_CANCEL */
+};
+
+#define BARRIER_WAIT 0
+#define BARRIER_GO 1
+#define BARRIER_CANCEL 2
+
+/* Argument of a worker thread */
+struct worker {
+       pthread_t thread;
+       parallel_task run;
+       void *task;
+       int index;                       /* Position of the task in its array */
+       int started;
+       struct start_barrier *barrier;   /* NULL to start right away */
+};
+
+
+/* Runs one task, and with --trace records it on the thread that ran it */
+static void run_task(parallel_task run, void *task, int index) {
+       struct trace_arg arg;
+       double started = trace_clock();
+
+       run(task);
+
+       arg.name = "task";
+       arg.value = index;
+       trace_event("task", "task", started, &arg, 1);
+}
+
+
+static void *worker_main(void *arg) {
+       struct worker *worker = arg;
+       int state = BARRIER_GO;
+
+       if (worker->barrier) {
+              pthread_mutex_lock(&worker->barrier->lock);
+              while (worker->barrier->state == BARRIER_WAIT)
+                     pthread_cond_wait(&worker->barrier->changed, &worker->barrier->lock);
+              state = worker->barrier->state;
+              pthread_mutex_unlock(&worker->barrier->lock);
+       }
+
+       if (state == BARRIER_GO)
+              run_task(worker->run, worker->task, worker->index);
+       return NULL;
+}
+
+
+/* Releases the threads waiting at a barrier */
+static void release_barrier(struct start_barrier *barrier, int state) {
+       pthread_mutex_lock(&barrier->lock);
+       barrier->state = state;
+       pthread_cond_broadcast(&barrier->changed);
+       pthread_mutex_unlock(&barrier->lock);
+}
+
+
+void parallel_run(parallel_task run, void *tasks, size_t task_size, int count) {
+       struct worker *workers;
+       int i;
+
+       if (count <= 0)
+              return;
+
+       workers = (count > 1) ? mem_calloc(count, sizeof(struct worker)) : NULL;
+
+       /* Without worker bookkeeping everything runs on the calling thread */
+       if (!workers) {
+              for (i = 0; i < count; i++)
+                     run_task(run, (char *)tasks + i * task_size, i);
+              return;
+       }
+
+       for (i = 1; i < count; i++) {
+              workers[i].run = run;
+              workers[i].task = (char *)tasks + i * task_size;
+              workers[i].index = i;
+              workers[i].started = (pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) == 0);
+       }
+
+       run_task(run, tasks, 0);
+
+       for (i = 1; i < count; i++) {
+              if (workers[i].started)
+                     pthread_join(workers[i].thread, NULL);
+              else
+                     run_task(run, workers[i].task, i);
+       }
+
+       mem_free(workers);
+}
+
+
+int parallel_run_together(parallel_task run, void *tasks, size_t task_size, int count) {
+       struct start_barrier barrier;
+       struct worker *workers;
+       int all_started = TRUE;
+       int i;
+
+       if (count <= 0)
+              return TRUE;
+
+       workers = mem_calloc(count, sizeof(struct worker));
+       if (!workers)
+              return FALSE;
+
+       pthread_mutex_init(&barrier.lock, NULL);
+       pthread_cond_init(&barrier.changed, NULL);
+       barrier.state = BARRIER_WAIT;
+
+       for (i = 0; i < count && all_started; i++) {
+              workers[i].run = run;
+              workers[i].task = (char *)tasks + i * task_size;
+              workers[i].index = i;
+              workers[i].barrier = &barrier;
+              workers[i].started = (pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) == 0);
+              all_started = workers[i].started;
+       }
+
+       release_barrier(&barrier, all_started ? BARRIER_GO : BARRIER_CANCEL);
+
+       for (i = 0; i < count; i++) {
+              if (workers[i].started)
+                     pthread_join(workers[i].thread, NULL);
+       }
+
+       pthread_cond_destroy(&barrier.changed);
+       pthread_mutex_destroy(&barrier.lock);
+       mem_free(workers);
+       return all_started;
+}
+
+
+double monotonic_seconds(void) {
+       struct timespec now;
+
+       clock_gettime(CLOCK_MONOTONIC, &now);
+       return now.tv_sec + now.tv_nsec / 1e9;
+}
@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "../header_files/parallel_preprocessor.h"
+#include "../header_files/parallel.h"
+#include "../header_files/mem_alloc.h"
+#include "../header_files/diagnostics.h"
+#include "../header_files/listing.h"
+#include "../header_files/includes.h"
+
+
+/* Copies the line at position like fgets() with a LINE_MAX_LEN buffer; returns the offset after it */
+static size_t next_fragment(const struct source_text *source, size_t position, char *line) {
+       size_t length = 0;
+
+       while (position < source->length && length < LINE_MAX_LEN - 1) {
+              line[length++] = source->text[position++];
+              if (line[length - 1] == '\n')
+                     break;
+       }
+       line[length] = '\0';
+       return position;
+}
+
+
+/* Phase 1: builds the macro table and collects the remaining lines into runs of at most run_limit characters */
+static int scan_definitions(const struct source_text *source, struct preprocess_scan *scan, size_t run_limit) {
+       char line_buffer[LINE_MAX_LEN];
+       struct Macro *macro_pointer = NULL;   /* Macro being defined, if any */
+       struct Macro *line_macro;
+       struct preprocess_run *run = NULL;    /* Run the previous line went to */
+       char *trimmed_line;
+       size_t position = 0;
+       size_t next;
+       int error_flag = FALSE;
+       int line_counter = 0;
+
+       while (position < source->length) {
+              next = next_fragment(source, position, line_buffer);
+              line_counter++;
+              trimmed_line = skip_leading_whitespace(line_buffer);
+              line_macro = macro_pointer;
+
+              /* Checked in the order of determine_line_type() */
+              if (is_macro_end_def(trimmed_line, line_macro, &error_flag, line_counter)) {
+                     macro_pointer = NULL;
+              }
+              else if (is_macro_def(trimmed_line, &line_macro, &scan->table, &error_flag, line_counter)) {
+                     macro_pointer = line_macro;
+              }
+              else if (is_include_directive(trimmed_line)) {
+                     /* Included files are read by the serial preprocessor */
+                     error_flag = TRUE;
+                     break;
+              }
+              else if (macro_pointer != NULL) {
+                     add_line_to_macro(macro_pointer, line_buffer, &error_flag);
+              }
+              else {
+                     /* Whether the line is a call is left to the workers; it only needs the macros above it */
+                     if (run == NULL || run->end != position || run->macro_count != scan->table.count ||
+                         run->end - run->begin >= run_limit) {
+                            if (!ensure_preprocess_runs_capacity(scan)) {
+                                   error_flag = TRUE;
+                                   break;
+                            }
+                            run = &scan->runs[scan->run_count++];
+                            run->begin = position;
+                            run->first_line = line_counter;
+                            run->macro_count = scan->table.count;
+                     }
+                     run->end = next;
+              }
+              position = next;
+       }
+
+       return error_flag;
+}
+
+
+/* Notes where a piece of output came from */
+static int record_piece(struct preprocess_chunk *chunk, int line, size_t length, const char *macro) {
+       struct expansion_piece *piece;
+
+       if (!ensure_chunk_pieces_capacity(chunk))
+              return FALSE;
+
+       piece = &chunk->pieces[chunk->piece_count++];
+       piece->line = line;
+       piece->length = (int)length;
+       strcpy(piece->macro, macro);
+       return TRUE;
+}
+
+
+/* Phase 2, on a worker thread: expands the runs of one chunk into its own buffer */
+static void expand_chunk(void *task) {
+       struct preprocess_chunk *chunk = task;
+       const struct preprocess_run *run;
+       char line_buffer[LINE_MAX_LEN];
+       struct MacroTable table = {NULL, INITIAL_NUMBER_OF_LINES, INITIAL_LINES_CAPASITY};
+       int definitions = chunk->definitions->count;
+       struct Macro *line_macro;
+       const struct Macro *recursive;
+       const char *text;
+       size_t length;
+       size_t position;
+       int line;
+       int r, m;
+
+       /* Flattened bodies are memoized in the macros, so each worker flattens into a copy of its own */
+       table.macros = mem_malloc((definitions > 0 ? definitions : 1) * sizeof(struct Macro));
+       if (!table.macros) {
+              chunk->failed = TRUE;
+              return;
+       }
+       if (definitions > 0)
+              memcpy(table.macros, chunk->definitions->macros, definitions * sizeof(struct Macro));
+       table.capacity = definitions;
+       table.library = chunk->definitions->library;
+       table.index = chunk->definitions->index;   /* Shared: the index is only read here */
+       table.index_size = chunk->definitions->index_size;
+
+       for (r = 0; r < chunk->run_count && !chunk->failed; r++) {
+              run = &chunk->runs[r];
+              table.count = run->macro_count;
+
+              for (position = run->begin, line = run->first_line; position < run->end && !chunk->failed; line++) {
+                     position = next_fragment(chunk->source, position, line_buffer);
+
+                     if (is_macro_call(skip_leading_whitespace(line_buffer), &line_macro, &table)) {
+                            if (build_flat_body(&table, line_macro, &recursive) != FLATTEN_DONE) {
+                                   chunk->failed = TRUE;
+                                   break;
+                            }
+                            text = line_macro->flat_body;
+                            length = line_macro->flat_length;
+                     }
+                     else {
+                            line_macro = NULL;
+                            text = line_buffer;
+                            length = strlen(line_buffer);
+                     }
+
+                     if (!append_source_text(&chunk->output, text, length) ||
+                         (chunk->record_pieces && !record_piece(chunk, line, length, line_macro ? line_macro->mName : "")))
+                            chunk->failed = TRUE;
+              }
+       }
+
+       /* The lines still belong to the scan's table */
+       for (m = 0; m < definitions; m++)
+              mem_free(table.macros[m].flat_body);
+       mem_free(table.macros);
+}
+
+
+/* Writes the chunks to the .am file in order, and their pieces to the line map */
+static int write_chunks(const char *am_file_name, const struct preprocess_chunk *chunks, int count,
+                        struct line_map *map, int *error) {
+       FILE *am_file = fopen(am_file_name, "w");
+       const struct expansion_piece *piece;
+       size_t offset;
+       int c, p;
+
+       if (!am_file)
+              return FALSE;
+
+       for (c = 0; c < count; c++) {
+              if (chunks[c].output.length > 0)
+                     fwrite(chunks[c].output.text, 1, chunks[c].output.length, am_file);
+
+              for (p = 0, offset = 0; map && p < chunks[c].piece_count; p++) {
+                     piece = &chunks[c].pieces[p];
+                     if (!line_map_record(map, chunks[c].output.text + offset, piece->length, piece->line,
+                                          piece->macro[0] != '\0' ? line_map_macro(map, piece->macro) : NO_MACRO))
+                            *error = TRUE;
+                     offset += piece->length;
+              }
+       }
+
+       fclose(am_file);
+       return TRUE;
+}
+
+
+int preprocess_in_parallel(const char *basename, const struct macro_library *library, struct line_map *map,
+                           int jobs, int *error) {
+       struct preprocess_scan scan = {{NULL, INITIAL_NUMBER_OF_LINES, INITIAL_LINES_CAPASITY}};
+       struct diag_position start = diag_tell();
+       struct preprocess_chunk *chunks = NULL;
+       struct source_text source = {0};
+       char *as_file_name = build_filename(basename, ".as");
+       char *am_file_name = build_filename(basename, ".am");
+       int written = FALSE;
+       int count = jobs;
+       int failed = FALSE;
+       int c, r;
+
+       /* Anything unusual (a missing file, a null character) is left to the serial preprocessor */
+       if (!as_file_name || !am_file_name || !load_source_text(&source, as_file_name) ||
+           memchr(source.text, '\0', source.length) != NULL) {
+              free_source_text(&source);
+              mem_free(as_file_name);
+              mem_free(am_file_name);
+              return FALSE;
+       }
+
+       if ((size_t)count > source.length / MIN_PREPROCESS_CHUNK_SIZE)
+              count = (int)(source.length / MIN_PREPROCESS_CHUNK_SIZE);
+
+       scan.table.library = library;
+       if (count > 1 && !scan_definitions(&source, &scan, source.length / count) && scan.run_count > 0)
+              chunks = mem_calloc(count, sizeof(struct preprocess_chunk));
+
+       if (chunks) {
+              /* Runs are at most 1/count of the text, so cutting at run starts balances the chunks */
+              for (c = 0, r = 0; c < count; c++) {
+                     chunks[c].source = &source;
+                     chunks[c].runs = &scan.runs[r];
+                     chunks[c].definitions = &scan.table;
+                     chunks[c].record_pieces = (map != NULL);
+                     while (r < scan.run_count && (c == count - 1 || scan.runs[r].begin < source.length / count * (c + 1)))
+                            r++;
+                     chunks[c].run_count = (int)(&scan.runs[r] - chunks[c].runs);
+              }
+
+              parallel_run(expand_chunk, chunks, sizeof(struct preprocess_chunk), count);
+
+              for (c = 0; c < count; c++)
+                     failed |= chunks[c].failed;
+              written = !failed && write_chunks(am_file_name, chunks, count, map, error);
+
+              for (c = 0; c < count; c++) {
+                     free_source_text(&chunks[c].output);
+                     mem_free(chunks[c].pieces);
+              }
+              mem_free(chunks);
+       }
+
+       /* The serial preprocessor reports the same problems again, in its own order */
+       if (!written)
+              diag_rewind(start);
+
+       free_macro_table(&scan.table);
+       mem_free(scan.runs);
+       free_source_text(&source);
+       mem_free(as_file_name);
+       mem_free(am_file_name);
+       return written;
+}
@@ -0,0 +1,411 @@
+/**
+ * @file parser_bench.c
+ * @brief Microbenchmarks of the text parser primitives.
+ *
+ * Every benchmark runs one parser function over a fixed mix of inputs: whole
+ * lines (instructions, .data lists, strings, comments, lines with errors) for
+ * seperate_string() and line_ast(), and typical tokens for the smaller checks.
+ * After a warm-up, each benchmark is timed over several repetitions, each
+ * repeating the mix until a minimum time has passed. The median and the best
+ * repetition are reported in ns per input and inputs per second.
+ *
+ * Functions that tokenize in place get a fresh copy of the line each time; the
+ * "copy" row measures that copy alone so it can be subtracted.
+ *
+ * Usage: parser_bench [--repetitions N] [--min-time SECONDS] [benchmark ...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../header_files/ast.h"
+#include "../header_files/text_parser.h"
+#include "../header_files/mem_alloc.h"
+#include "../header_files/parallel.h"
+
+#define DEFAULT_REPETITIONS 7
+#define DEFAULT_MIN_TIME 0.05       /* Seconds per repetition */
+#define WARM_UP_ROUNDS 1000
+#define MAX_REPETITIONS 101
+#define NANOSECONDS 1e9
+
+#define COUNT_OF(array) ((int)(sizeof(array) / sizeof((array)[0])))
+
+
+/* === Input mixes === */
+
+static const char *instruction_lines[] = {
+    "MAIN: mov r3, LENGTH",
+    "add #-5, r1",
+    "LOOP: jmp &END",
+    "prn #48",
+    "lea STR, r6",
+    "inc r6",
+    "cmp r1, #-6",
+    "bne &LOOP",
+    "sub r1, r4",
+    "red r2",
+    "END: stop",
+    "rts"
+};
+
+static const char *data_lines[] = {
+    "LIST: .data 6, -9, 15, 22",
+    ".data 1,2,3,4,5,6,7,8,9,10",
+    ".data -100",
+    "K: .data 31, +8, -8388608, 8388607"
+};
+
+static const char *string_lines[] = {
+    "STR: .string \"abcdef\"",
+    ".string \"hello, world\"",
+    "MSG: .string \"a longer string with spaces, and commas\""
+};
+
+static const char *comment_lines[] = {
+    "; comment",
+    "      ; an indented comment with several words",
+    "",
+    "        "
+};
+
+static const char *error_lines[] = {
+    "mov r1",
+    "MAIN mov r1, r2",
+    "1LABEL: inc r1",
+    "add #99999999, r1",
+    ".data 1,,2",
+    "jmp r1",
+    "foo r1",
+    ".string abc",
+    "prn #",
+    "mov r1, r2, r3"
+};
+
+static const char *label_definitions[] = {
+    "MAIN:", "LOOP1:", "x:", "AVeryLongLabelNameOf31Character:", "1bad:", "mov:", "r3:", "NoColon"
+};
+
+static const char *labels[] = {
+    "MAIN", "LOOP1", "x", "AVeryLongLabelNameOf31Character", "r3", "mov", "data", "bad_label"
+};
+
+static const char *numbers[] = {
+    "42", "-17", "+8388607", "0", "12a", "99999999", "-", "1048575"
+};
+
+static const char *mnemonics[] = {
+    "mov", "stop", "jmp", "prn", "rts", "red", "foo", "MOV"
+};
+
+static const char *directives[] = {
+    ".data", ".string", ".entry", ".extern", ".org", ".foo", "mov", ".dat"
+};
+
+static const char *registers[] = {
+    "r0", "r7", "r3", "r8", "R1", "r", "r10", "LABEL"
+};
+
+
+/* === Benchmarks === */
+
+struct bench_case;
+
+/* Runs a function once over every input of a case, returns a value that depends on the results */
+typedef unsigned long (*bench_run)(const struct bench_case *bench);
+
+struct bench_case {
+    const char *name;         /* Parser function */
+    const char *mix;          /* Kind of inputs */
+    const char **inputs;
+    int count;
+    bench_run run;
+};
+
+/* An instruction line split once, so only the operand parsing is timed */
+struct prepared_operands {
+    char line[MAX_LINE_LEN + 1];
+    struct string_seperation_result tokens;
+    struct instruction *inst;
+    int first;                /* Index of the first operand token */
+};
+
+static struct prepared_operands prepared[COUNT_OF(instruction_lines)];
+
+
+static unsigned long run_copy(const struct bench_case *bench) {
+    char line[MAX_LINE_LEN + 1];
+    unsigned long sum = 0;
+    int i;
+
+    for (i = 0; i < bench->count; i++) {
+        strcpy(line, bench->inputs[i]);
+        sum += (unsigned char)line[0];
+    }
+    return sum;
+}
+
+static unsigned long run_seperate_string(const struct bench_case *bench) {
+    char line[MAX_LINE_LEN + 1];
+    unsigned long sum = 0;
+    int i;
+
+    for (i = 0; i < bench->count; i++) {
+        strcpy(line, bench->inputs[i]);
+        sum += seperate_string(line).strings_count;
+    }
+    return sum;
+}
+
+static unsigned long run_line_ast(const struct bench_case *bench) {
+    char line[MAX_LINE_LEN + 1];
+    struct ast ast;
+    unsigned long sum = 0;
+    int i;
+
+    for (i = 0; i < bench->count; i++) {
+        strcpy(line, bench->inputs[i]);
+        ast = line_ast(line);
+        sum += ast.ast_type + (ast.error != NULL);
+        mem_free(ast.error);
+    }
+    return sum;
+}
+
+static unsigned long run_legal_label_def(const struct bench_case *bench) {
+    char label[MAX_LABEL_LEN + 1];
+    unsigned long sum = 0;
+    int i;
+
+    for (i = 0; i < bench->count; i++)
+        sum += legal_label_def((char *)bench->inputs[i], label);
+    return sum;
+}
+
+static unsigned long run_legal_label(const struct bench_case *bench) {
+    unsigned long sum = 0;
+    int i;
+
+    for (i = 0; i < bench->count; i++)
+        sum += legal_label((char *)bench->inputs[i]);
+    return sum;
+}
+
+static unsigned long run_legal_number(const struct bench_case *bench) {
+    unsigned long sum = 0;
+    int value = 0;
+    int i;
+
+    for (i = 0; i < bench->count; i++)
+        sum += legal_number((char *)bench->inputs[i], MIN_SIGNED_DATA, MAX_SIGNED_DATA, &value, TRUE) + value;
+    return sum;
+}
+
+static unsigned long run_check_instruction(const struct bench_case *bench) {
+    unsigned long sum = 0;
+    int i;
+
+    for (i = 0; i < bench->count; i++)
+        sum += check_instruction((char *)bench->inputs[i]) != NULL;
+    return sum;
+}
+
+static unsigned long run_check_directive(const struct bench_case *bench) {
+    unsigned long sum = 0;
+    int i;
+
+    for (i = 0; i < bench->count; i++)
+        sum += check_directive((char *)bench->inputs[i]);
+    return sum;
+}
+
+static unsigned long run_register_operand(const struct bench_case *bench) {
+    unsigned long sum = 0;
+    int number = 0;
+    int i;
+
+    for (i = 0; i < bench->count; i++)
+        sum += register_operand((char *)bench->inputs[i], &number) + number;
+    return sum;
+}
+
+static unsigned long run_parse_instruction_operands(const struct bench_case *bench) {
+    struct ast ast;
+    unsigned long sum = 0;
+    int i;
+
+    for (i = 0; i < bench->count; i++) {
+        memset(&ast, 0, sizeof(ast));
+        parse_instruction_operands(&prepared[i].tokens.strings[prepared[i].first],
+                                   prepared[i].tokens.strings_count - prepared[i].first,
+                                   prepared[i].inst, &ast);
+        sum += ast.ast_options.ast_instruction.number_of_operands + (ast.error != NULL);
+        mem_free(ast.error);
+    }
+    return sum;
+}
+
+
+/* Splits the instruction lines once for run_parse_instruction_operands() */
+static void prepare_operands(void) {
+    int i;
+
+    for (i = 0; i < COUNT_OF(instruction_lines); i++) {
+        strcpy(prepared[i].line, instruction_lines[i]);
+        prepared[i].tokens = seperate_string(prepared[i].line);
+        prepared[i].first = (prepared[i].tokens.strings[0][strlen(prepared[i].tokens.strings[0]) - 1] == ':') ? 1 : 0;
+        prepared[i].inst = check_instruction(prepared[i].tokens.strings[prepared[i].first]);
+        prepared[i].first++;
+    }
+}
+
+
+static const char **mixed_lines;
+static int mixed_count;
+
+/* Builds the "mixed" input: every line kind, interleaved */
+static int prepare_mixed(void) {
+    const char **kinds[5];
+    int counts[5];
+    int k, i, taken;
+
+    kinds[0] = instruction_lines;  counts[0] = COUNT_OF(instruction_lines);
+    kinds[1] = data_lines;         counts[1] = COUNT_OF(data_lines);
+    kinds[2] = string_lines;       counts[2] = COUNT_OF(string_lines);
+    kinds[3] = comment_lines;      counts[3] = COUNT_OF(comment_lines);
+    kinds[4] = error_lines;        counts[4] = COUNT_OF(error_lines);
+
+    mixed_count = 0;
+    for (k = 0; k < 5; k++)
+        mixed_count += counts[k];
+    mixed_lines = mem_malloc(mixed_count * sizeof(const char *));
+    if (!mixed_lines)
+        return FALSE;
+
+    /* Round robin over the kinds, so consecutive lines differ like in a real file */
+    for (taken = 0, i = 0; taken < mixed_count; i++) {
+        for (k = 0; k < 5; k++) {
+            if (i < counts[k])
+                mixed_lines[taken++] = kinds[k][i];
+        }
+    }
+    return TRUE;
+}
+
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+
+/* Volatile, so the compiler keeps every call */
+static volatile unsigned long bench_sink;
+
+/* Times one case and prints its row */
+static void run_case(const struct bench_case *bench, int repetitions, double min_time) {
+    double times[MAX_REPETITIONS];
+    unsigned long rounds;
+    double start, elapsed;
+    int r;
+
+    for (r = 0; r < WARM_UP_ROUNDS; r++)
+        bench_sink += bench->run(bench);
+
+    for (r = 0; r < repetitions; r++) {
+        rounds = 0;
+        start = monotonic_seconds();
+        do {
+            bench_sink += bench->run(bench);
+            rounds++;
+            elapsed = monotonic_seconds() - start;
+        } while (elapsed < min_time);
+        times[r] = elapsed * NANOSECONDS / ((double)rounds * bench->count);
+    }
+
+    qsort(times, repetitions, sizeof(double), compare_doubles);
+    printf("%-28s %-13s %10.1f %10.1f %14.0f\n", bench->name, bench->mix,
+           times[repetitions / 2], times[0], NANOSECONDS / times[repetitions / 2]);
+}
+
+
+/* Tells whether a case was selected on the command line (all are when none is named) */
+static int selected(const struct bench_case *bench, int argc, char const *argv[], int first) {
+    int i;
+
+    if (first >= argc)
+        return TRUE;
+    for (i = first; i < argc; i++) {
+        if (strcmp(argv[i], bench->name) == STRCMP_TRUE)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+
+int main(int argc, char const *argv[]) {
+    int repetitions = DEFAULT_REPETITIONS;
+    double min_time = DEFAULT_MIN_TIME;
+    int i, c;
+
+    struct bench_case cases[] = {
+        {"copy",                       "mixed",        NULL, 0, run_copy},
+        {"seperate_string",            "instructions", instruction_lines, COUNT_OF(instruction_lines), run_seperate_string},
+        {"seperate_string",            "data",         data_lines, COUNT_OF(data_lines), run_seperate_string},
+        {"seperate_string",            "strings",      string_lines, COUNT_OF(string_lines), run_seperate_string},
+        {"seperate_string",            "comments",     comment_lines, COUNT_OF(comment_lines), run_seperate_string},
+        {"seperate_string",            "errors",       error_lines, COUNT_OF(error_lines), run_seperate_string},
+        {"seperate_string",            "mixed",        NULL, 0, run_seperate_string},
+        {"legal_label_def",            "tokens",       label_definitions, COUNT_OF(label_definitions), run_legal_label_def},
+        {"legal_label",                "tokens",       labels, COUNT_OF(labels), run_legal_label},
+        {"legal_number",               "tokens",       numbers, COUNT_OF(numbers), run_legal_number},
+        {"check_instruction",          "tokens",       mnemonics, COUNT_OF(mnemonics), run_check_instruction},
+        {"check_directive",            "tokens",       directives, COUNT_OF(directives), run_check_directive},
+        {"register_operand",           "tokens",       registers, COUNT_OF(registers), run_register_operand},
+        {"parse_instruction_operands", "instructions", instruction_lines, COUNT_OF(instruction_lines), run_parse_instruction_operands},
+        {"line_ast",                   "instructions", instruction_lines, COUNT_OF(instruction_lines), run_line_ast},
+        {"line_ast",                   "data",         data_lines, COUNT_OF(data_lines), run_line_ast},
+        {"line_ast",                   "strings",      string_lines, COUNT_OF(string_lines), run_line_ast},
+        {"line_ast",                   "comments",     comment_lines, COUNT_OF(comment_lines), run_line_ast},
+        {"line_ast",                   "errors",       error_lines, COUNT_OF(error_lines), run_line_ast},
+        {"line_ast",                   "mixed",        NULL, 0, run_line_ast}
+    };
+
+    /* Parse options that precede the benchmark names */
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "--repetitions") == STRCMP_TRUE && i + 1 < argc) {
+            repetitions = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--min-time") == STRCMP_TRUE && i + 1 < argc) {
+            min_time = atof(argv[++i]);
+        }
+        else {
+            printf("Usage: parser_bench [--repetitions N] [--min-time SECONDS] [benchmark ...]\n");
+            return 1;
+        }
+    }
+    if (repetitions < 1 || repetitions > MAX_REPETITIONS) {
+        printf("--repetitions expects a number from 1 to %d\n", MAX_REPETITIONS);
+        return 1;
+    }
+
+    if (!prepare_mixed()) {
+        fprintf(stderr, "Memory allocation failed.\n");
+        return 1;
+    }
+    prepare_operands();
+
+    printf("%-28s %-13s %10s %10s %14s\n", "benchmark", "inputs", "ns/input", "best ns", "inputs/s");
+    for (c = 0; c < COUNT_OF(cases); c++) {
+        if (cases[c].inputs == NULL) {
+            cases[c].inputs = mixed_lines;
+            cases[c].count = mixed_count;
+        }
+        if (selected(&cases[c], argc, argv, i))
+            run_case(&cases[c], repetitions, min_time);
+    }
+
+    mem_free(mixed_lines);
+    return 0;
+}
@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "../header_files/peephole.h"
+#include "../header_files/first_pass.h"
+#include "../header_files/ast.h"
+#include "../header_files/encoding.h"
+#include "../header_files/mem_alloc.h"
+
+#define NO_RULE (-1)
+#define NO_TARGET (-1)
+
+static const char *rule_names[NUMBER_OF_PEEPHOLE_RULES] = {
+       "mov rX, rX", "jmp next", "clr + mov #0", "add/sub #0"
+};
+
+
+/* Writes an operand as text ("r3" or the label), or an empty string for other modes */
+static void operand_text(const struct ast *ast, int operand, char *text) {
+       if (ast->ast_options.ast_instruction.oprand[operand].oprand_type == ast_register) {
+              sprintf(text, "r%d", ast->ast_options.ast_instruction.oprand[operand].oprand_options.register_number);
+       }
+       else if (ast->ast_options.ast_instruction.oprand[operand].oprand_type == ast_direct) {
+              strncpy(text, ast->ast_options.ast_instruction.oprand[operand].oprand_options.label, MAX_LABEL_LEN);
+              text[MAX_LABEL_LEN] = '\0';
+       }
+       else {
+              text[0] = '\0';
+       }
+}
+
+
+/* Tells whether an operand is the immediate #0 */
+static int is_zero(const struct ast *ast, int operand) {
+       return ast->ast_options.ast_instruction.oprand[operand].oprand_type == ast_instant &&
+              ast->ast_options.ast_instruction.oprand[operand].oprand_options.number == 0;
+}
+
+
+/* Finds the rule that removes an instruction on its own, or NO_RULE */
+static int static_rule(const struct ast *ast, const char *clr_operand) {
+       char operand[MAX_LABEL_LEN + 1];
+       int opcode = ast->ast_options.ast_instruction.opCode;
+       int funct = ast->ast_options.ast_instruction.funct;
+
+       if (opcode == OP_MOV && ast->ast_options.ast_instruction.oprand[0].oprand_type == ast_register &&
+           ast->ast_options.ast_instruction.oprand[1].oprand_type == ast_register &&
+           ast->ast_options.ast_instruction.oprand[0].oprand_options.register_number ==
+           ast->ast_options.ast_instruction.oprand[1].oprand_options.register_number)
+              return RULE_MOV_SELF;
+
+       if (opcode == OP_ADD && (funct == FUNCT_ADD || funct == FUNCT_SUB) && is_zero(ast, 0))
+              return RULE_ADD_ZERO;
+
+       /* A labeled mov may be reached by a jump that skips the clr */
+       if (opcode == OP_MOV && is_zero(ast, 0) && ast->label_name[0] == '\0' && clr_operand[0] != '\0') {
+              operand_text(ast, 1, operand);
+              if (strcmp(operand, clr_operand) == STRCMP_TRUE)
+                     return RULE_CLR_MOV_ZERO;
+       }
+
+       return NO_RULE;
+}
+
+
+/* Returns the address a jmp goes to if its label is an instruction of this file, or NO_TARGET */
+static int jump_target(const struct ast *ast, const struct translation_unit *prog) {
+       struct symbol *symbol;
+
+       if (ast->ast_options.ast_instruction.oprand[0].oprand_type != ast_direct &&
+           ast->ast_options.ast_instruction.oprand[0].oprand_type != ast_relative)
+              return NO_TARGET;
+
+       symbol = symbolLookUp(prog->symbol_table, prog->symCount,
+                             ast->ast_options.ast_instruction.oprand[0].oprand_options.label);
+       if (!symbol || (symbol->symType != symCode && symbol->symType != symEntryCode))
+              return NO_TARGET;
+       return symbol->address;
+}
+
+
+/* Reads the instructions and .org lines of the source, applying the rules that need no other line */
+static int scan_source(struct peephole_program *program, const struct translation_unit *prog,
+                       const struct source_text *source) {
+       char line[MAX_LINE_LEN + 1];
+       char clr_operand[MAX_LABEL_LEN + 1] = "";   /* Destination of a clr right before the line */
+       size_t position = 0;
+       int ic = STARTING_ADDRESS;
+       struct peephole_entry *entry;
+       struct ast ast;
+
+       while (position < source->length) {
+              position = next_source_line(source, position, line);
+              remove_newline(line);
+              ast = line_ast(line);
+              mem_free(ast.error);   /* The first pass found no errors */
+              program->line_count++;
+
+              if (ast.ast_type == directive && ast.ast_options.ast_directive.directive_type == ast_org) {
+                     if (!ensure_peephole_capacity(program))
+                            return FALSE;
+                     entry = &program->entries[program->count++];
+                     memset(entry, 0, sizeof(*entry));
+                     entry->line = program->line_count;
+                     entry->address = ast.ast_options.ast_directive.directive_options.address;
+                     entry->rule = NO_RULE;
+                     entry->target = NO_TARGET;
+                     ic = entry->address;
+                     clr_operand[0] = '\0';
+              }
+              else if (ast.ast_type == instruction) {
+                     if (!ensure_peephole_capacity(program))
+                            return FALSE;
+                     entry = &program->entries[program->count++];
+                     memset(entry, 0, sizeof(*entry));
+                     entry->line = program->line_count;
+                     entry->address = ic;
+                     entry->words = 1 + instruction_template(&ast)->extra_words;
+                     entry->target = NO_TARGET;
+                     entry->rule = static_rule(&ast, clr_operand);
+                     entry->removed = (entry->rule != NO_RULE);
+
+                     /* Whether a jmp can go depends on the lines after it, see remove_jumps_to_next() */
+                     if (entry->rule == NO_RULE && ast.ast_options.ast_instruction.opCode == OP_JMP &&
+                         ast.ast_options.ast_instruction.funct == FUNCT_JMP) {
+                            entry->rule = RULE_JMP_NEXT;
+                            entry->target = jump_target(&ast, prog);
+                     }
+
+                     if (ast.ast_options.ast_instruction.opCode == OP_CLR && ast.ast_options.ast_instruction.funct == FUNCT_CLR)
+                            operand_text(&ast, 0, clr_operand);
+                     else
+                            clr_operand[0] = '\0';
+                     ic += entry->words;
+              }
+       }
+       return TRUE;
+}
+
+
+/*
+ * Removes every jmp whose target follows it directly, once the instructions between
+ * them are removed and no .org gap separates them. Walks backwards, so the lines after
+ * a jmp are already decided. Returns the number of jmps removed.
+ */
+static int remove_jumps_to_next(struct peephole_program *program) {
+       struct peephole_entry *entries = program->entries;
+       int kept_after = program->count;   /* First kept instruction after the current one */
+       int removed = 0;
+       int end;
+       int i, k;
+
+       for (i = program->count - 1; i >= 0; i--) {
+              if (entries[i].rule == RULE_JMP_NEXT && !entries[i].removed && entries[i].target != NO_TARGET) {
+                     end = entries[i].address + entries[i].words;
+                     for (k = i + 1; k < program->count && k <= kept_after; k++) {
+                            if (entries[k].words == 0)
+                                   continue;
+                            if (entries[k].address != end)
+                                   break;   /* An .org gap: execution would not fall through */
+                            if (entries[k].address == entries[i].target) {
+                                   entries[i].removed = TRUE;
+                                   removed++;
+                                   break;
+                            }
+                            end += entries[k].words;
+                     }
+              }
+              if (entries[i].words > 0 && !entries[i].removed)
+                     kept_after = i;
+       }
+       return removed;
+}
+
+
+/* Gives every line its address after the removals; .org addresses stay as they are */
+static void assign_addresses(struct peephole_program *program, int *final_ic, int *kept_words) {
+       struct peephole_entry *entry;
+       int ic = STARTING_ADDRESS;
+       int words = 0;
+       int i;
+
+       for (i = 0; i < program->count; i++) {
+              entry = &program->entries[i];
+              entry->new_address = ic;
+              entry->words_before = words;
+              if (entry->words == 0) {
+                     ic = entry->address;
+              }
+              else if (!entry->removed) {
+                     ic += entry->words;
+                     words += entry->words;
+              }
+       }
+       *final_ic = ic;
+       *kept_words = words;
+}
+
+
+/* Returns the new address of the instruction the first pass placed at an address */
+static int new_code_address(const struct peephole_program *program, int address) {
+       int low = 0, high = program->count, middle;
+
+       /* First entry at or above the address; a .org to it comes before the instruction */
+       while (low < high) {
+              middle = (low + high) / 2;
+              if (program->entries[middle].address < address)
+                     low = middle + 1;
+              else
+                     high = middle;
+       }
+       while (low < program->count && program->entries[low].words == 0)
+              low++;
+
+       if (low < program->count && program->entries[low].address == address)
+              return program->entries[low].new_address;
+       return address;
+}
+
+
+/* Moves the symbols and the chunk starts of the first pass to the new addresses */
+static void update_addresses(struct translation_unit *prog, const struct peephole_program *program,
+                             int final_ic, int kept_words) {
+       int shift = final_ic - prog->ICF;   /* Data follows the last instruction */
+       int c, i, k = 0;
+
+       for (i = 0; i < prog->symCount; i++) {
+              if (prog->symbol_table[i].symType == symCode || prog->symbol_table[i].symType == symEntryCode)
+                     prog->symbol_table[i].address = new_code_address(program, prog->symbol_table[i].address);
+              else if (prog->symbol_table[i].symType == symData || prog->symbol_table[i].symType == symEntryData)
+                     prog->symbol_table[i].address += shift;
+       }
+
+       /* A chunk starts where its first instruction or .org line does */
+       for (c = 0; c < prog->chunk_count; c++) {
+              while (k < program->count && program->entries[k].line < prog->chunks[c].first_line)
+                     k++;
+              prog->chunks[c].first_address = (k < program->count) ? program->entries[k].new_address : final_ic;
+              prog->chunks[c].first_word = (k < program->count) ? program->entries[k].words_before : kept_words;
+       }
+
+       prog->ICF = final_ic;
+       prog->IC = kept_words;
+}
+
+
+int peephole_optimize(struct translation_unit *prog, const struct source_text *source, const char *base_name) {
+       struct peephole_program program = {0};
+       int removed[NUMBER_OF_PEEPHOLE_RULES] = {0};
+       int saved = 0;
+       int final_ic, kept_words;
+       int i;
+
+       if (!scan_source(&program, prog, source)) {
+              mem_free(program.entries);
+              return TRUE;
+       }
+
+       /* Each removal can bring a jmp next to its target */
+       while (remove_jumps_to_next(&program) > 0)
+              ;
+
+       for (i = 0; i < program.count; i++) {
+              if (program.entries[i].removed) {
+                     removed[program.entries[i].rule]++;
+                     saved += program.entries[i].words;
+              }
+       }
+
+       if (saved > 0) {
+              prog->removed_lines = mem_calloc(program.line_count + 1, sizeof(char));
+              if (!prog->removed_lines) {
+                     diag_report(DIAG_NO_MEMORY, NO_LINE, "removed lines");
+                     mem_free(program.entries);
+                     return TRUE;
+              }
+              for (i = 0; i < program.count; i++) {
+                     if (program.entries[i].removed)
+                            prog->removed_lines[program.entries[i].line] = TRUE;
+              }
+
+              assign_addresses(&program, &final_ic, &kept_words);
+              update_addresses(prog, &program, final_ic, kept_words);
+       }
+
+       fprintf(stderr, "%s: optimize saved %d words:", base_name, saved);
+       for (i = 0; i < NUMBER_OF_PEEPHOLE_RULES; i++)
+              fprintf(stderr, "%s %s %d", i == 0 ? "" : ",", rule_names[i], removed[i]);
+       fprintf(stderr, "\n");
+
+       mem_free(program.entries);
+       return FALSE;
+}
@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../header_files/pipeline.h"
+#include "../header_files/ring_buffer.h"
+#include "../header_files/parallel.h"
+#include "../header_files/preprocessor.h"
+#include "../header_files/first_pass.h"
+#include "../header_files/mem_alloc.h"
+#include "../header_files/diagnostics.h"
+#include "../header_files/ast.h"
+
+
+enum pipeline_stage_id {
+       STAGE_PREPROCESS,
+       STAGE_PARSE,
+       STAGE_FIRST_PASS,
+       NUMBER_OF_STAGES
+};
+
+static const char *stage_names[NUMBER_OF_STAGES] = {
+       "preprocess", "parse", "first pass"
+};
+
+/* Record passed from the preprocessor to the parser: one line as fgets() would read it */
+struct line_record {
+       char text[MAX_LINE_LEN + 1];
+};
+
+/* Record passed from the parser to the first pass; the AST points into text */
+struct parsed_line {
+       char text[MAX_LINE_LEN + 1];
+       struct ast ast;
+};
+
+/* State shared by the stages; each field is written by one stage only */
+struct pipeline {
+       const char *base_name;
+       struct line_map *map;                   /* Origins of the .am lines, may be NULL */
+       struct ring_buffer lines;               /* preprocess -> parse */
+       struct ring_buffer parsed;              /* parse -> first pass */
+       char pending[MAX_LINE_LEN + 1];         /* Preprocessor output not yet pushed */
+       size_t pending_length;
+       int preprocessor_error;
+       struct source_text *source;             /* .am text, built by the parser */
+       int source_failed;
+       struct first_pass_chunk *chunk;         /* Built by the first pass stage */
+       double started;                         /* When the stage threads were started, the same for all */
+       double finished[NUMBER_OF_STAGES];      /* When each stage returned */
+       double waited[NUMBER_OF_STAGES];        /* Seconds each stage waited on a ring */
+};
+
+/* Task of one stage thread */
+struct pipeline_stage {
+       enum pipeline_stage_id id;
+       struct pipeline *pipeline;
+};
+
+
+/* Pushes the pending piece of preprocessor output as one line record */
+static void push_pending(struct pipeline *pipeline) {
+       struct line_record *record = ring_push_slot(&pipeline->lines, &pipeline->waited[STAGE_PREPROCESS]);
+
+       memcpy(record->text, pipeline->pending, pipeline->pending_length);
+       record->text[pipeline->pending_length] = '\0';
+       ring_push(&pipeline->lines);
+       pipeline->pending_length = 0;
+}
+
+
+/* Preprocessor output callback: splits the text exactly like fgets() splits the .am file */
+static void emit_text(void *context, const char *text, size_t length) {
+       struct pipeline *pipeline = context;
+       size_t i;
+
+       for (i = 0; i < length; i++) {
+              pipeline->pending[pipeline->pending_length++] = text[i];
+              if (text[i] == '\n' || pipeline->pending_length == MAX_LINE_LEN)
+                     push_pending(pipeline);
+       }
+}
+
+
+static void run_preprocess(struct pipeline *pipeline) {
+       preprocess_to((char *)pipeline->base_name, &pipeline->preprocessor_error, emit_text, pipeline, pipeline->map);
+
+       /* A last line without a newline */
+       if (pipeline->pending_length > 0)
+              push_pending(pipeline);
+       ring_close(&pipeline->lines);
+}
+
+
+static void run_parse(struct pipeline *pipeline) {
+       struct line_record *record;
+       struct parsed_line *parsed;
+
+       while ((record = ring_pop_slot(&pipeline->lines, &pipeline->waited[STAGE_PARSE])) != NULL) {
+              /* Keep the raw text for the second pass before the parser splits it in place */
+              if (!append_source_text(pipeline->source, record->text, strlen(record->text)))
+                     pipeline->source_failed = TRUE;
+
+              parsed = ring_push_slot(&pipeline->parsed, &pipeline->waited[STAGE_PARSE]);
+              strcpy(parsed->text, record->text);
+              ring_pop(&pipeline->lines);
+
+              remove_newline(parsed->text);
+              parsed->ast = line_ast(parsed->text);
+              ring_push(&pipeline->parsed);
+       }
+       ring_close(&pipeline->parsed);
+}
+
+
+static void run_first_pass(struct pipeline *pipeline) {
+       struct parsed_line *parsed;
+
+       while ((parsed = ring_pop_slot(&pipeline->parsed, &pipeline->waited[STAGE_FIRST_PASS])) != NULL) {
+              first_pass_record_line(pipeline->chunk, &parsed->ast);
+              ring_pop(&pipeline->parsed);
+       }
+}
+
+
+static void run_stage(void *task) {
+       struct pipeline_stage *stage = task;
+
+       switch (stage->id) {
+              case STAGE_PREPROCESS:
+                     run_preprocess(stage->pipeline);
+                     break;
+              case STAGE_PARSE:
+                     run_parse(stage->pipeline);
+                     break;
+              case STAGE_FIRST_PASS:
+                     run_first_pass(stage->pipeline);
+                     break;
+              default:
+                     break;
+       }
+
+       stage->pipeline->finished[stage->id] = monotonic_seconds();
+}
+
+
+/* Writes the share of the wall time each stage spent working */
+static void report_utilization(const struct pipeline *pipeline) {
+       double total = pipeline->finished[STAGE_FIRST_PASS] - pipeline->started;
+       double busy;
+       int i;
+
+       fprintf(stderr, "%s: pipeline %.3f s, busy:", pipeline->base_name, total);
+       for (i = 0; i < NUMBER_OF_STAGES; i++) {
+              busy = pipeline->finished[i] - pipeline->started - pipeline->waited[i];
+              fprintf(stderr, "%s %s %.0f%%", i == 0 ? "" : ",", stage_names[i],
+                      total > 0 ? 100.0 * busy / total : 100.0);
+       }
+       fprintf(stderr, "\n");
+}
+
+
+int pipeline_first_pass(struct translation_unit *prog, const char *base_name,
+                        struct source_text *source, struct line_map *map, int *preprocessor_error) {
+       struct pipeline pipeline;
+       struct pipeline_stage stages[NUMBER_OF_STAGES];
+       int i;
+
+       memset(&pipeline, 0, sizeof(pipeline));
+       memset(source, 0, sizeof(*source));
+       pipeline.base_name = base_name;
+       pipeline.map = map;
+       pipeline.source = source;
+       pipeline.chunk = mem_calloc(1, sizeof(struct first_pass_chunk));
+
+       if (!pipeline.chunk ||
+           !ring_init(&pipeline.lines, sizeof(struct line_record), PIPELINE_RING_SIZE) ||
+           !ring_init(&pipeline.parsed, sizeof(struct parsed_line), PIPELINE_RING_SIZE)) {
+              mem_free(pipeline.chunk);
+              ring_free(&pipeline.lines);
+              ring_free(&pipeline.parsed);
+              return PIPELINE_UNAVAILABLE;
+       }
+
+       for (i = 0; i < NUMBER_OF_STAGES; i++) {
+              stages[i].id = i;
+              stages[i].pipeline = &pipeline;
+       }
+
+       /* The stages wait on each other, so they must all run at once; every busy share is measured from here */
+       pipeline.started = monotonic_seconds();
+       if (!parallel_run_together(run_stage, stages, sizeof(struct pipeline_stage), NUMBER_OF_STAGES)) {
+              mem_free(pipeline.chunk);
+              ring_free(&pipeline.lines);
+              ring_free(&pipeline.parsed);
+              return PIPELINE_UNAVAILABLE;
+       }
+       ring_free(&pipeline.lines);
+       ring_free(&pipeline.parsed);
+       report_utilization(&pipeline);
+
+       /* Like the serial path, nothing of the first pass is kept if preprocessing failed */
+       *preprocessor_error = pipeline.preprocessor_error;
+       if (pipeline.preprocessor_error) {
+              free_first_pass_chunk(pipeline.chunk);
+              mem_free(pipeline.chunk);
+              free_source_text(source);
+              return TRUE;
+       }
+
+       diag_set_phase(PHASE_FIRST_PASS);
+       if (pipeline.source_failed) {
+              diag_report(DIAG_NO_MEMORY, NO_LINE, "source text");
+              free_first_pass_chunk(pipeline.chunk);
+              mem_free(pipeline.chunk);
+              return TRUE;
+       }
+
+       /* The whole file was recorded as one chunk; merging assigns addresses and symbols */
+       pipeline.chunk->source = source;
+       pipeline.chunk->begin = 0;
+       pipeline.chunk->end = source->length;
+       return merge_first_pass_chunks(prog, pipeline.chunk, 1);
+}
@@ -4,6 +4,11 @@
 #include <ctype.h>
 #include "../header_files/preprocessor.h"
 #include "../header_files/mem_alloc.h"
+#include "../header_files/diagnostics.h"
+#include "../header_files/listing.h"
+#include "../header_files/options.h"
+#include "../header_files/parallel_preprocessor.h"
+#include "../header_files/includes.h"
 
 
 
@@ -38,6 +43,10 @@ int determine_line_type(char *trimmed_line, struct Macro **macro_pointer, struct
 	else if (is_macro_def(trimmed_line, macro_pointer, macro_table, error_flag, line_counter)) {
 		return macro_def;
 	}
+	/*If it's an .include directive, return include_line*/
+	else if (is_include_directive(trimmed_line)) {
+		return include_line;
+	}
 	/*If it's a call to a macro, return macro_call*/
 	else if (is_macro_call(trimmed_line, macro_pointer, macro_table)) {
 		return macro_call;
@@ -60,41 +69,122 @@ char * skip_leading_whitespace(char *str) {
 
 
 void preprocessor(char *basename, int * error) {
+       preprocess_to(basename, error, NULL, NULL, NULL);
+}
+
+
+
+/* Makes the line map attribute the following lines to the file being read */
+static void set_map_file(struct line_map *map, const struct include_state *includes, int *error_flag) {
+       if (includes->current == 0) {
+              map->file = 0;
+       }
+       else {
+              map->file = line_map_file(map, includes->files[includes->current].path);
+              if (map->file == 0)
+                     *error_flag = TRUE;
+       }
+}
+
+
+
+void preprocess_to(char *basename, int * error, preprocessor_output output, void *context, struct line_map *map) {
        int error_flag = FALSE;
        FILE *am_file;
        FILE *as_file;
+       FILE *input;                            /* File being read: the .as file or one it included */
+       struct include_state includes = {0};
        char line_buffer[LINE_MAX_LEN] = {0};  /* Buffer to store each line read from the input file */
        struct MacroTable macro_table = {NULL, INITIAL_NUMBER_OF_LINES, INITIAL_LINES_CAPASITY}; /* Struct to manage the dynamic macro array */
-       struct Macro *macro_pointer = NULL;     /* Pointer to the current macro (if any) */
+       struct Macro *macro_pointer = NULL;     /* Pointer to the macro being defined (if any) */
+       struct Macro *line_macro;               /* Macro defined or called by the current line */
        char *am_file_name = build_filename(basename, ".am");
        char *as_file_name = build_filename(basename, ".as");
-       int i;
        int line_type;
        char * trimmed_line;
        int line_counter = 0;
+       struct macro_library library;
+       const char *library_error;
+       char *library_message;
 
 	
 
-	/*Open the output file (.am) for writing and the input file (.as) for reading*/
-	am_file = fopen(am_file_name, "w");  /*Write mode*/
-	as_file = fopen(as_file_name, "r");  /*Read mode*/
+	/*Map the precompiled macros, which count as defined before the first line*/
+	if (options.macro_library) {
+              if (!macro_library_open(&library, options.macro_library, &library_error)) {
+                     library_message = mem_malloc(strlen(options.macro_library) + strlen(library_error) + 5);
+                     if (library_message)
+                            sprintf(library_message, "\"%s\": %s", options.macro_library, library_error);
+                     diag_report(DIAG_MACRO_LIBRARY, NO_LINE, library_message ? library_message : options.macro_library);
+                     mem_free(library_message);
+                     mem_free(as_file_name);
+                     mem_free(am_file_name);
+                     *error = TRUE;
+                     return;
+              }
+              macro_table.library = &library;
+	}
 
-	if (as_file == NULL) {
-              printf("Error: Could not open input file %s\n", as_file_name);
+	/*The .as file is the first file of the unit: it cannot be included, and it is the first dependency*/
+	if (!as_file_name || !includes_begin(&includes, as_file_name))
               error_flag = TRUE;
+
+	/*With --jobs, expand on several threads; a file that is too small, has errors or includes files comes back here*/
+	if (options.jobs > 1 && output == NULL && preprocess_in_parallel(basename, macro_table.library, map, options.jobs, &error_flag)) {
+              if (options.dependencies && !error_flag && !write_dependency_file(basename, &includes))
+                     error_flag = TRUE;
+              if (macro_table.library) macro_library_close(&library);
+              includes_end(&includes);
+              free_include_state(&includes);
+              mem_free(as_file_name);
+              mem_free(am_file_name);
+              *error = error_flag;
               return;
 	}
-	/*Loop through each line of the input file*/
 
-	while (fgets(line_buffer, sizeof(line_buffer), as_file) != NULL) {
+	/*Open the output file (.am) for writing and the input file (.as) for reading; --check only keeps the text in memory*/
+	am_file = options.check ? NULL : fopen(am_file_name, "w");  /*Write mode*/
+	as_file = fopen(as_file_name, "r");  /*Read mode*/
+
+	if (as_file == NULL || (am_file == NULL && !options.check)) {
+              diag_report(DIAG_OPEN_FAILED, NO_LINE, as_file == NULL ? as_file_name : am_file_name);
+              if (as_file) fclose(as_file);
+              if (am_file) fclose(am_file);
+              if (macro_table.library) macro_library_close(&library);
+              includes_end(&includes);
+              free_include_state(&includes);
+              mem_free(as_file_name);
+              mem_free(am_file_name);
+              *error = TRUE;
+              return;
+	}
+	/*Loop through each line of the input file and the files it includes*/
+
+	input = as_file;
+	while (!diag_limit_reached()) {
+              if (fgets(line_buffer, sizeof(line_buffer), input) == NULL) {
+                     /*The end of an included file: go on after its .include line*/
+                     if (!include_close(&includes, &input, &line_counter))
+                            break;
+                     if (map)
+                            set_map_file(map, &includes, &error_flag);
+                     continue;
+              }
+              /*The last line of an included file ends its line even without a newline*/
+              if (includes.depth > 0 && feof(input) && strchr(line_buffer, '\n') == NULL &&
+                  strlen(line_buffer) < sizeof(line_buffer) - 1)
+                     strcat(line_buffer, "\n");
               line_counter++;
 		trimmed_line = skip_leading_whitespace(line_buffer);
 		/*Determine the line type (macro definition, macro call, etc.)*/
-		line_type = determine_line_type(trimmed_line, &macro_pointer, &macro_table, &error_flag, line_counter);
+		line_macro = macro_pointer;
+		line_type = determine_line_type(trimmed_line, &line_macro, &macro_table, &error_flag, line_counter);
 
 		switch (line_type) { /*Process the line based on its type*/
 			case macro_def:
-				break; /*Nothing to do here, macro_pointer is set by macro definition*/
+				/*Following lines belong to the new macro*/
+				macro_pointer = line_macro;
+				break;
 				    
 			case macro_end_def:
 				/*End of macro definition, clear the macro_pointer*/
@@ -102,12 +192,33 @@ void preprocessor(char *basename, int * error) {
 				break;
 				    
 			case macro_call:
-				/*Write the macro's lines to the output file*/
-				for (i = 0; i < macro_pointer->line_count; i++) {
-					fputs(macro_pointer->lines[i], am_file);  /*Write each line of the macro*/
+				/*A call inside a definition stays in the body and is expanded when the outer macro is used*/
+				if (macro_pointer != NULL) {
+					add_line_to_macro(macro_pointer, line_buffer, &error_flag);
+				}
+				/*Write the macro's fully expanded body to the output file*/
+				else if (flatten_macro(&macro_table, line_macro, &error_flag, line_counter)) {
+					if (am_file)
+						fwrite(line_macro->flat_body, 1, line_macro->flat_length, am_file);
+					if (output)
+						output(context, line_macro->flat_body, line_macro->flat_length);
+					if (map && !line_map_record(map, line_macro->flat_body, line_macro->flat_length, line_counter, line_map_macro(map, line_macro->mName)))
+						error_flag = TRUE;
+				}
+				break;
+
+			case include_line:
+				/*Macro bodies are copied as they are, so a file cannot be read into one*/
+				if (macro_pointer != NULL) {
+					diag_report(DIAG_INCLUDE, line_counter, "inside a macro definition");
+					error_flag = TRUE;
+				}
+				else if (!include_open(&includes, trimmed_line, &input, &line_counter)) {
+					error_flag = TRUE;
+				}
+				else if (map) {
+					set_map_file(map, &includes, &error_flag);
 				}
-				/*After calling the macro, reset the macro_pointer*/
-				macro_pointer = NULL;
 				break;
 
 			case any_other_line_type:
@@ -115,18 +226,39 @@ void preprocessor(char *basename, int * error) {
 				if (macro_pointer != NULL) {
 					add_line_to_macro(macro_pointer, line_buffer, &error_flag);
 				}
-				else
-					fputs(line_buffer, am_file);
+				else {
+					if (am_file)
+						fputs(line_buffer, am_file);
+					if (output)
+						output(context, line_buffer, strlen(line_buffer));
+					if (map && !line_map_record(map, line_buffer, strlen(line_buffer), line_counter, NO_MACRO))
+						error_flag = TRUE;
+				}
 				break;
 			
 		}
 	}
 	
 
-	/*Close the files after processing*/
-	fclose(am_file);
-	fclose(as_file);
+	/*Close the files after processing; suspended ones are closed with the include state*/
+	if (am_file) fclose(am_file);
+	fclose(input);
+	diag_set_file(NULL);
+	if (map)
+		map->file = 0;
+
+	/*With -MD, list the files read for make, once they are all known*/
+	if (options.dependencies && !options.check && !error_flag && !write_dependency_file(basename, &includes))
+		error_flag = TRUE;
+
+	/*Let --watch know every file the unit depends on*/
+	includes_end(&includes);
+	free_include_state(&includes);
 	free_macro_table(&macro_table);
+	if (macro_table.library)
+		macro_library_close(&library);
+	mem_free(as_file_name);
+	mem_free(am_file_name);
 	*error =  error_flag;
 }
 
@@ -149,30 +281,61 @@ void add_line_to_macro(struct Macro *macro_pointer, const char *trimmed_line, in
 }
 
 
+/* Puts macro i in the index, unless an earlier macro has the same name */
+static void insert_macro_name(struct MacroTable *macro_table, int i) {
+       unsigned int mask = (unsigned int)macro_table->index_size - 1;
+       unsigned int bucket = macro_name_hash(macro_table->macros[i].mName) & mask;
+
+       while (macro_table->index[bucket] != 0) {
+              if (strcmp(macro_table->macros[macro_table->index[bucket] - 1].mName, macro_table->macros[i].mName) == STRCMP_TRUE)
+                     return;   /* Calls keep going to the first definition */
+              bucket = (bucket + 1) & mask;
+       }
+       macro_table->index[bucket] = i + 1;
+}
+
+
+/* Adds macro i to the hash index, doubling it first if it would become more than half full */
+static int index_macro(struct MacroTable *macro_table, int i) {
+       int new_size = macro_table->index_size > 0 ? macro_table->index_size : INITIAL_MACRO_INDEX_SIZE;
+       int *new_index;
+       int j;
+
+       while ((i + 1) * 2 > new_size)
+              new_size *= 2;
+
+       if (new_size != macro_table->index_size) {
+              new_index = mem_calloc(new_size, sizeof(int));
+              if (!new_index) {
+                     diag_report(DIAG_NO_MEMORY, NO_LINE, "macro index");
+                     return FALSE;
+              }
+              mem_free(macro_table->index);
+              macro_table->index = new_index;
+              macro_table->index_size = new_size;
+              for (j = 0; j < i; j++)
+                     insert_macro_name(macro_table, j);
+       }
+
+       insert_macro_name(macro_table, i);
+       return TRUE;
+}
+
+
 int is_macro_def(char *trimmed_line, struct Macro **macro_pointer, struct MacroTable *macro_table, int * error_flag, int line_count) 
 {
        /* Declare all variables at the top of the block */
-       char *macro_name;
+       char macro_name[MAX_MACRO_LEN + 1];   /* Called for every line, so kept off the heap */
        char *after_macro_name;
        struct Macro *new_macro;
 
-       /* Allocate memory for the macro name */
-       macro_name = (char *)malloc((MAX_MACRO_LEN + 1) * sizeof(char));
-       if (macro_name == NULL) 
-       {
-              printf("line %d: Memory allocation failed for macro_name.\n", line_count);
-              *error_flag = TRUE;
-              return FALSE;
-       }
-
        /* Check if the line starts with "mcro" and is not "mcroend" */
        if (strncmp(trimmed_line, "mcro", MACRO_DEF_SIZE) == STRCMP_TRUE && strncmp(trimmed_line, "mcroend", MACRO_END_DEF_SIZE) != STRCMP_TRUE) 
        {
               /* Extract macro name after "mcro" */
               if (sscanf(trimmed_line + MACRO_DEF_SIZE, "%31s", macro_name) != TRUE) {
-                     printf("line %d: Error: Missing macro name after 'mcro'.\n", line_count);
+                     diag_report(DIAG_MACRO_MISSING_NAME, line_count, NULL);
                      *error_flag = TRUE;
-                     free(macro_name);
                      return FALSE;
               } 
 
@@ -189,12 +352,11 @@ int is_macro_def(char *trimmed_line, struct Macro **macro_pointer, struct MacroT
               if (*after_macro_name != '\0') 
               {
                      *error_flag = TRUE;
-                     printf("line %d: Error: Extra characters after macro name '%s'.\n", line_count, macro_name);
+                     diag_report(DIAG_MACRO_EXTRA_CHARACTERS, line_count, macro_name);
               }
 
               /* Ensure there is space in the macro table */
               if (!ensure_macro_table_capacity(macro_table)) {
-                     free(macro_name);
                      *error_flag = TRUE;
                      return FALSE;  
               }
@@ -203,16 +365,22 @@ int is_macro_def(char *trimmed_line, struct Macro **macro_pointer, struct MacroT
               new_macro = &macro_table->macros[macro_table->count];
               strcpy(new_macro->mName, macro_name);
               new_macro->line_count = 0;
+              new_macro->capacity = 0;
               new_macro->lines = NULL;
+              new_macro->flat_body = NULL;
+              new_macro->flat_length = 0;
+              new_macro->flat_capacity = 0;
+              new_macro->flat_macro_count = 0;
+              new_macro->expanding = FALSE;
 
               *macro_pointer = new_macro;
               macro_table->count++;
-              free(macro_name);
+              if (!index_macro(macro_table, macro_table->count - 1))
+                     *error_flag = TRUE;
               return TRUE;
        }
 
        /* Line does not define a macro */
-       free(macro_name);
        return FALSE;
 }
 
@@ -231,7 +399,7 @@ int is_valid_macro_name(char *macro_name, int line_count) {
        /* Check if macro name matches any reserved word */
        for (i = 0; i < NUMBER_OF_INVALID_NAMES; i++) {
               if (strcmp(macro_name, invalid_names[i]) == STRCMP_TRUE) {
-                     printf("line %d: Error: macro name conflicts with an instraction '%s'.\n", line_count, macro_name);
+                     diag_report(DIAG_MACRO_RESERVED_NAME, line_count, macro_name);
                      return FALSE;  /* Invalid macro name (conflicts with an instruction) */
               }
        }
@@ -239,14 +407,14 @@ int is_valid_macro_name(char *macro_name, int line_count) {
 
        if (!isalpha(macro_name[0]) && macro_name[0] != '_') 
        {
-              printf("line %d: Error: Invalid macro name '%s'.\n", line_count, macro_name);
+              diag_report(DIAG_MACRO_INVALID_NAME, line_count, macro_name);
               return FALSE; /* the first character is not '_' or a letter*/
        }
 
        for (i = 1; macro_name[i] != '\0'; i++) {
               if (!isalnum(macro_name[i]) && macro_name[i] != '_') 
               {
-                     printf("line %d: Error: Invalid macro name '%s'.\n", line_count, macro_name);
+                     diag_report(DIAG_MACRO_INVALID_NAME, line_count, macro_name);
                      return FALSE; /*there is an illigal character*/
               }
        }
@@ -263,7 +431,7 @@ int is_macro_end_def(char *trimmed_line,struct Macro *macro_pointer, int *error_
 		after_macro_end_def = &trimmed_line[7];
 		after_macro_end_def = skip_leading_whitespace(after_macro_end_def);
 		if (*after_macro_end_def != '\0') {
-			printf("line %d: Error: Extra characters after 'mcroend' in macro definition.\n", line_count);
+			diag_report(DIAG_MACROEND_EXTRA_CHARACTERS, line_count, NULL);
 			*error_flag = TRUE;
 		}
 		return TRUE;  /*It's the end of a macro definition*/
@@ -273,21 +441,130 @@ int is_macro_end_def(char *trimmed_line,struct Macro *macro_pointer, int *error_
 
 
 
+/* Finds the first of the first count macros named name through the index */
+static struct Macro *find_macro(struct MacroTable *macro_table, const char *name, unsigned int hash) {
+       unsigned int mask = (unsigned int)macro_table->index_size - 1;
+       unsigned int bucket = hash & mask;
+       int i;
+
+       if (macro_table->index_size == 0)
+              return NULL;
+
+       while ((i = macro_table->index[bucket]) != 0) {
+              if (strcmp(macro_table->macros[i - 1].mName, name) == STRCMP_TRUE)
+                     /* Macros defined below the line being expanded do not count yet */
+                     return i - 1 < macro_table->count ? &macro_table->macros[i - 1] : NULL;
+              bucket = (bucket + 1) & mask;
+       }
+       return NULL;
+}
+
+
+
+/* Looks a name up in the macro library */
+static int is_library_call(const char *name, struct Macro **macro_pointer, struct MacroTable *macro_table) {
+       const struct macro_library_entry *entry = macro_library_find(macro_table->library, name);
+
+       if (!entry)
+              return FALSE;
+
+       /* Already expanded when the library was built, so flatten_macro() leaves it alone */
+       strcpy(macro_table->library_macro.mName, entry->name);
+       macro_table->library_macro.flat_body = (char *)macro_table->library->bodies + entry->body_offset;
+       macro_table->library_macro.flat_length = entry->body_length;
+       *macro_pointer = &macro_table->library_macro;
+       return TRUE;
+}
+
+
+
 int is_macro_call(char *trimmed_line, struct Macro **macro_pointer, struct MacroTable *macro_table) 
 {
-	/* Look through the macro table to find a matching macro name in the line*/
-	int i;
-       char *after_macro_name;
-	for (i = 0; i < macro_table->count; i++) {
-		if (strncmp(trimmed_line, macro_table->macros[i].mName, strlen(macro_table->macros[i].mName)) == STRCMP_TRUE) {
-                     after_macro_name = skip_leading_whitespace(trimmed_line + strlen(macro_table->macros[i].mName));
-
-                     if (*after_macro_name == '\0') 
-                     {
-                            *macro_pointer = &macro_table->macros[i];
-			       return TRUE;  /* It's a macro call*/
-		       }
-	       }
+       char name[MAX_MACRO_LEN + 1];
+       struct Macro *macro;
+       int length = 0;
+
+       /* A call is a single word: the name, then only whitespace */
+       while (length <= MAX_MACRO_LEN && trimmed_line[length] != '\0' && !isspace((unsigned char)trimmed_line[length]))
+              length++;
+       if (length == 0 || length > MAX_MACRO_LEN || *skip_leading_whitespace(trimmed_line + length) != '\0')
+              return FALSE;
+       memcpy(name, trimmed_line, length);
+       name[length] = '\0';
+
+       /* Library macros were defined before anything in the file */
+       if (macro_table->library && is_library_call(name, macro_pointer, macro_table))
+              return TRUE;
+
+       macro = find_macro(macro_table, name, macro_name_hash(name));
+       if (!macro)
+              return FALSE;
+
+       *macro_pointer = macro;
+       return TRUE;  /* It's a macro call*/
+}
+
+
+
+int build_flat_body(struct MacroTable *macro_table, struct Macro *macro, const struct Macro **recursive) {
+       struct Macro *callee;
+       int result = FLATTEN_DONE;
+       int i;
+
+       /* Library bodies are stored expanded */
+       if (macro == &macro_table->library_macro)
+              return FLATTEN_DONE;
+
+       /* A memoized body stays valid until another macro is defined */
+       if (macro->flat_body != NULL && macro->flat_macro_count == macro_table->count)
+              return FLATTEN_DONE;
+
+       if (macro->expanding) {
+              *recursive = macro;
+              return FLATTEN_RECURSIVE;
        }
-	return FALSE;
+
+       macro->expanding = TRUE;
+       macro->flat_length = 0;
+
+       for (i = 0; i < macro->line_count && result == FLATTEN_DONE; i++) {
+              /* Nested call: flatten the callee once and copy its body in bulk */
+              if (is_macro_call(skip_leading_whitespace(macro->lines[i]), &callee, macro_table)) {
+                     result = build_flat_body(macro_table, callee, recursive);
+                     if (result == FLATTEN_DONE && !append_to_flat_body(macro, callee->flat_body, callee->flat_length))
+                            result = FLATTEN_NO_MEMORY;
+              }
+              else if (!append_to_flat_body(macro, macro->lines[i], strlen(macro->lines[i]))) {
+                     result = FLATTEN_NO_MEMORY;
+              }
+       }
+
+       /* An empty macro still gets a (zero-length) body so the memo check succeeds */
+       if (result == FLATTEN_DONE && macro->flat_body == NULL && !append_to_flat_body(macro, "", 0))
+              result = FLATTEN_NO_MEMORY;
+
+       if (result == FLATTEN_DONE)
+              macro->flat_macro_count = macro_table->count;
+       macro->expanding = FALSE;
+       return result;
+}
+
+
+
+int flatten_macro(struct MacroTable *macro_table, struct Macro *macro, int *error_flag, int line_count) {
+       const struct Macro *recursive = NULL;
+
+       switch (build_flat_body(macro_table, macro, &recursive)) {
+              case FLATTEN_RECURSIVE:
+                     diag_report(DIAG_MACRO_RECURSION, line_count, recursive->mName);
+                     break;
+              case FLATTEN_NO_MEMORY:
+                     diag_report(DIAG_NO_MEMORY, NO_LINE, "macro body");
+                     break;
+              default:
+                     return TRUE;
+       }
+
+       *error_flag = TRUE;
+       return FALSE;
 }
@@ -0,0 +1,271 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "../header_files/profile.h"
+#include "../header_files/parallel.h"
+
+#define TRUE 1
+#define FALSE 0
+#define NO_COUNTER (-1)
+#define NO_PHASE (-1)
+
+static const char *phase_names[NUMBER_OF_PHASES] = {
+       "preprocessor", "first pass", "second pass", "output"
+};
+
+static const char *counter_names[NUMBER_OF_COUNTERS] = {
+       "cycles", "instructions", "branch-misses", "cache-misses"
+};
+
+/* A counter's value and how long it was enabled and actually counting */
+struct counter_reading {
+       double value;
+       double enabled;
+       double running;
+};
+
+/* Counters of the whole run; the assembler is single-threaded between phases */
+static struct {
+       int active;                                    /* TRUE after profile_start() */
+       int fds[NUMBER_OF_COUNTERS];                   /* Counter descriptors, NO_COUNTER if unavailable */
+       int open_error;                                /* errno of the first counter that failed */
+       int phase;                                     /* Phase being measured, or NO_PHASE */
+       struct counter_reading start[NUMBER_OF_COUNTERS]; /* Readings when the phase began */
+       double started;                                /* When the phase began */
+       struct profile_sample file[NUMBER_OF_PHASES];  /* Current file */
+       struct profile_sample total[NUMBER_OF_PHASES]; /* All files */
+       int files;                                     /* Number of files reported */
+} profile = {0};
+
+
+#ifdef __linux__
+
+static const unsigned long counter_configs[NUMBER_OF_COUNTERS] = {
+       PERF_COUNT_HW_CPU_CYCLES,
+       PERF_COUNT_HW_INSTRUCTIONS,
+       PERF_COUNT_HW_BRANCH_MISSES,
+       PERF_COUNT_HW_CACHE_MISSES
+};
+
+/*
+ * Opens one counter of this process and the threads it starts later. The counts of
+ * finished threads are added to it but never reset, so phases are measured as the
+ * difference between two readings.
+ */
+static int open_counter(enum profile_counter counter) {
+       struct perf_event_attr attr;
+
+       memset(&attr, 0, sizeof(attr));
+       attr.type = PERF_TYPE_HARDWARE;
+       attr.size = sizeof(attr);
+       attr.config = counter_configs[counter];
+       attr.inherit = 1;
+       attr.exclude_kernel = 1;
+       attr.exclude_hv = 1;
+       attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+       return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void read_counter(int fd, struct counter_reading *reading) {
+       __u64 values[3];   /* value, time enabled, time running */
+
+       if (read(fd, values, sizeof(values)) != (ssize_t)sizeof(values)) {
+              memset(reading, 0, sizeof(*reading));
+              return;
+       }
+       reading->value = (double)values[0];
+       reading->enabled = (double)values[1];
+       reading->running = (double)values[2];
+}
+
+static void close_counter(int fd) {
+       close(fd);
+}
+
+#else
+
+static int open_counter(enum profile_counter counter) {
+       (void)counter;
+       errno = ENOSYS;
+       return NO_COUNTER;
+}
+
+static void read_counter(int fd, struct counter_reading *reading) {
+       (void)fd;
+       memset(reading, 0, sizeof(*reading));
+}
+
+static void close_counter(int fd) {
+       (void)fd;
+}
+
+#endif
+
+
+int profile_start(void) {
+       int opened = 0;
+       int i;
+
+       for (i = 0; i < NUMBER_OF_COUNTERS; i++) {
+              profile.fds[i] = open_counter(i);
+              if (profile.fds[i] < 0) {
+                     if (!profile.open_error)
+                            profile.open_error = errno;
+                     profile.fds[i] = NO_COUNTER;
+              }
+              else {
+                     opened++;
+              }
+       }
+
+       profile.active = TRUE;
+       profile.phase = NO_PHASE;
+
+       if (opened < NUMBER_OF_COUNTERS)
+              fprintf(stderr, "profile: %d of %d hardware counters unavailable (%s), those show n/a\n",
+                      NUMBER_OF_COUNTERS - opened, NUMBER_OF_COUNTERS, strerror(profile.open_error));
+       return opened;
+}
+
+
+/* Events counted between two readings, scaled up when the kernel multiplexed the counter */
+static double counted(const struct counter_reading *start, const struct counter_reading *end) {
+       double running = end->running - start->running;
+       double enabled = end->enabled - start->enabled;
+
+       if (running <= 0)
+              return 0.0;
+       return (end->value - start->value) * (running < enabled ? enabled / running : 1.0);
+}
+
+
+/* Stops the phase being measured and adds its numbers to the file */
+static void end_phase(void) {
+       struct profile_sample *sample;
+       struct counter_reading reading;
+       int i;
+
+       if (profile.phase == NO_PHASE)
+              return;
+
+       sample = &profile.file[profile.phase];
+       for (i = 0; i < NUMBER_OF_COUNTERS; i++) {
+              if (profile.fds[i] != NO_COUNTER) {
+                     read_counter(profile.fds[i], &reading);
+                     sample->counts[i] += counted(&profile.start[i], &reading);
+              }
+       }
+       sample->seconds += monotonic_seconds() - profile.started;
+       sample->runs++;
+       profile.phase = NO_PHASE;
+}
+
+
+void profile_phase(enum diag_phase phase) {
+       int i;
+
+       if (!profile.active)
+              return;
+
+       end_phase();
+       profile.phase = phase;
+       profile.started = monotonic_seconds();
+       for (i = 0; i < NUMBER_OF_COUNTERS; i++) {
+              if (profile.fds[i] != NO_COUNTER)
+                     read_counter(profile.fds[i], &profile.start[i]);
+       }
+}
+
+
+/* Writes one row per phase that ran, then their sum */
+static void print_table(const char *title, const struct profile_sample *samples) {
+       struct profile_sample sum;
+       const struct profile_sample *row;
+       int p, i;
+
+       memset(&sum, 0, sizeof(sum));
+       fprintf(stderr, "%s:\n  %-14s %10s", title, "phase", "seconds");
+       for (i = 0; i < NUMBER_OF_COUNTERS; i++)
+              fprintf(stderr, " %15s", counter_names[i]);
+       fprintf(stderr, " %6s\n", "IPC");
+
+       for (p = 0; p <= NUMBER_OF_PHASES; p++) {
+              row = (p < NUMBER_OF_PHASES) ? &samples[p] : &sum;
+              if (row->runs == 0)
+                     continue;
+
+              fprintf(stderr, "  %-14s %10.6f", p < NUMBER_OF_PHASES ? phase_names[p] : "all", row->seconds);
+              for (i = 0; i < NUMBER_OF_COUNTERS; i++) {
+                     if (profile.fds[i] == NO_COUNTER)
+                            fprintf(stderr, " %15s", "n/a");
+                     else
+                            fprintf(stderr, " %15.0f", row->counts[i]);
+              }
+              if (profile.fds[COUNTER_CYCLES] != NO_COUNTER && profile.fds[COUNTER_INSTRUCTIONS] != NO_COUNTER &&
+                  row->counts[COUNTER_CYCLES] > 0)
+                     fprintf(stderr, " %6.2f\n", row->counts[COUNTER_INSTRUCTIONS] / row->counts[COUNTER_CYCLES]);
+              else
+                     fprintf(stderr, " %6s\n", "n/a");
+
+              if (p < NUMBER_OF_PHASES) {
+                     sum.seconds += row->seconds;
+                     for (i = 0; i < NUMBER_OF_COUNTERS; i++)
+                            sum.counts[i] += row->counts[i];
+                     sum.runs += row->runs;
+              }
+       }
+}
+
+
+void profile_end_file(const char *base_name) {
+       char title[FILENAME_MAX + 32];
+       int p, i;
+
+       if (!profile.active)
+              return;
+
+       end_phase();
+       sprintf(title, "%.*s: profile", FILENAME_MAX, base_name);
+       print_table(title, profile.file);
+
+       /* Fold the file into the totals */
+       for (p = 0; p < NUMBER_OF_PHASES; p++) {
+              profile.total[p].seconds += profile.file[p].seconds;
+              for (i = 0; i < NUMBER_OF_COUNTERS; i++)
+                     profile.total[p].counts[i] += profile.file[p].counts[i];
+              profile.total[p].runs += profile.file[p].runs;
+       }
+       memset(profile.file, 0, sizeof(profile.file));
+       profile.files++;
+}
+
+
+void profile_stop(void) {
+       char title[64];
+       int i;
+
+       if (!profile.active)
+              return;
+
+       end_phase();
+       if (profile.files > 0) {
+              sprintf(title, "total of %d files", profile.files);
+              print_table(title, profile.total);
+       }
+
+       for (i = 0; i < NUMBER_OF_COUNTERS; i++) {
+              if (profile.fds[i] != NO_COUNTER)
+                     close_counter(profile.fds[i]);
+       }
+       profile.active = FALSE;
+}
@@ -0,0 +1,295 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../header_files/rebase.h"
+#include "../header_files/translation_unit.h"
+#include "../header_files/second_pass.h"
+#include "../header_files/output.h"
+#include "../header_files/mem_alloc.h"
+#include "../header_files/diagnostics.h"
+
+#define TRUE 1
+#define FALSE 0
+#define DECIMAL_BASE 10
+#define HEX_BASE 16
+#define ARE_MASK 7
+#define WORD_MASK 0xFFFFFFL    /* The 24 bits of a memory word */
+#define REBASE_LINE_SIZE 128   /* Longest line of the files, a symbol name and an address, fits easily */
+
+/* The files of an assembled file, each rewritten next to itself */
+enum rebased_kind {
+       REBASED_OB,
+       REBASED_REL,
+       REBASED_ENT,
+       REBASED_EXT,
+       NUMBER_OF_REBASED
+};
+
+static const char *rebased_extensions[NUMBER_OF_REBASED] = {".ob", ".rel", ".ent", ".ext"};
+static const char *rebased_parts[NUMBER_OF_REBASED] = {".ob.part", ".rel.part", ".ent.part", ".ext.part"};
+
+struct rebased_file {
+       char *path;   /* <name><extension> */
+       char *part;   /* The new version, renamed over path once every file is written */
+       FILE *in;     /* NULL if the file does not exist (.ent and .ext are optional) */
+       FILE *out;
+       int line;     /* Lines of in read so far */
+       int failed;   /* TRUE if a line was too long (reported) */
+};
+
+/* State of rebasing one assembled file */
+struct rebase {
+       struct rebased_file files[NUMBER_OF_REBASED];
+       int new_base;
+       int delta;    /* New base minus old base */
+};
+
+
+/* Reports a problem at a line of one of the files */
+static void report_rebase(const struct rebased_file *file, const char *problem) {
+       char *message = mem_malloc(strlen(file->path) + strlen(problem) + 32);
+
+       if (message)
+              sprintf(message, "%s, line %d: %s", file->path, file->line, problem);
+       diag_report(DIAG_REBASE, NO_LINE, message ? message : problem);
+       mem_free(message);
+}
+
+
+/* Reads the next line of a file; returns FALSE at its end, or if the line is too long (failed is set) */
+static int read_line(struct rebased_file *file, char *line) {
+       size_t length;
+
+       if (!fgets(line, REBASE_LINE_SIZE, file->in))
+              return FALSE;
+       file->line++;
+
+       length = strlen(line);
+       if (length > 0 && line[length - 1] == '\n')
+              line[length - 1] = '\0';
+       else if (!feof(file->in)) {
+              report_rebase(file, "line too long");
+              file->failed = TRUE;
+              return FALSE;
+       }
+       return TRUE;
+}
+
+
+/* Reads a number from 0 to max that must end the text; returns FALSE if it is malformed */
+static int parse_number(const char *text, int base, long max, int *value) {
+       char *end;
+       long number = strtol(text, &end, base);
+
+       if (end == text || *end != '\0' || number < 0 || number > max)
+              return FALSE;
+       *value = (int)number;
+       return TRUE;
+}
+
+
+/* Moves an address by the distance between the bases; returns FALSE if it leaves the memory (reported) */
+static int move_address(const struct rebase *state, const struct rebased_file *file, int *address) {
+       if (*address + state->delta < 0 || *address + state->delta > MAX_ADDRESS) {
+              report_rebase(file, "the address leaves the memory at the new base");
+              return FALSE;
+       }
+       *address += state->delta;
+       return TRUE;
+}
+
+
+/* Reads the next relocated address; returns FALSE at the end of the .rel file or on error (failed is set) */
+static int next_relocation(struct rebase *state, int *relocation, int *failed) {
+       struct rebased_file *rel = &state->files[REBASED_REL];
+       char line[REBASE_LINE_SIZE];
+       int previous = *relocation;
+
+       if (!read_line(rel, line)) {
+              *failed |= rel->failed || ferror(rel->in);
+              return FALSE;
+       }
+       if (!parse_number(line, DECIMAL_BASE, MAX_ADDRESS, relocation) || *relocation <= previous) {
+              report_rebase(rel, "expected an address above the previous one");
+              *failed = TRUE;
+              return FALSE;
+       }
+       return TRUE;
+}
+
+
+/* Splits a .ob word line into its address and word */
+static int parse_word_line(char *line, int *address, int *word) {
+       char *space = strchr(line, ' ');
+
+       if (!space)
+              return FALSE;
+       *space = '\0';
+       return parse_number(line, DECIMAL_BASE, MAX_ADDRESS, address) &&
+              parse_number(space + 1, HEX_BASE, WORD_MASK, word);
+}
+
+
+/*
+ * The single pass over the .ob file: every word line moves to its new address, and
+ * the word the .rel file lists next, if it is this one, gets its address moved too.
+ */
+static int rebase_words(struct rebase *state) {
+       struct rebased_file *ob = &state->files[REBASED_OB];
+       struct rebased_file *rel = &state->files[REBASED_REL];
+       char line[REBASE_LINE_SIZE];
+       int relocation = -1;
+       int have_relocation;
+       int failed = FALSE;
+       int old_base;
+       int address;
+       int word;
+       int target;
+
+       /* The .rel header holds the base the addresses were assembled for */
+       if (!read_line(rel, line) || !parse_number(line, DECIMAL_BASE, MAX_ADDRESS, &old_base)) {
+              report_rebase(rel, "expected the base address");
+              return FALSE;
+       }
+       state->delta = state->new_base - old_base;
+       fprintf(rel->out, "%d\n", state->new_base);
+
+       /* The "IC DC" header does not depend on the base */
+       if (!read_line(ob, line)) {
+              report_rebase(ob, "expected the IC and DC header");
+              return FALSE;
+       }
+       fprintf(ob->out, "%s\n", line);
+
+       have_relocation = next_relocation(state, &relocation, &failed);
+       while (!failed && read_line(ob, line)) {
+              if (!parse_word_line(line, &address, &word)) {
+                     report_rebase(ob, "expected an address and a word");
+                     return FALSE;
+              }
+
+              if (have_relocation && relocation < address) {
+                     report_rebase(rel, "the address holds no word of the .ob file");
+                     return FALSE;
+              }
+
+              if (have_relocation && relocation == address) {
+                     target = word >> ARE_SHIFT;
+                     if ((word & ARE_MASK) != R) {
+                            report_rebase(ob, "the word at an address listed in the .rel file is not relocatable");
+                            return FALSE;
+                     }
+                     if (!move_address(state, ob, &target) || !move_address(state, rel, &relocation))
+                            return FALSE;
+                     word = (target << ARE_SHIFT) | R;
+                     fprintf(rel->out, "%07d\n", relocation);
+                     relocation = address;
+                     have_relocation = next_relocation(state, &relocation, &failed);
+              }
+
+              if (!move_address(state, ob, &address))
+                     return FALSE;
+              print_ob_line(ob->out, address, word);
+       }
+
+       if (failed || ob->failed || ferror(ob->in))
+              return FALSE;
+       if (have_relocation) {
+              report_rebase(rel, "the address holds no word of the .ob file");
+              return FALSE;
+       }
+       return TRUE;
+}
+
+
+/* Moves the address ending each "name<TAB>address" line of a .ent or .ext file */
+static int rebase_symbols(struct rebase *state, struct rebased_file *file) {
+       char line[REBASE_LINE_SIZE];
+       char *tab;
+       int address;
+
+       while (read_line(file, line)) {
+              tab = strrchr(line, '\t');
+              if (!tab || !parse_number(tab + 1, DECIMAL_BASE, MAX_ADDRESS, &address)) {
+                     report_rebase(file, "expected a name and an address");
+                     return FALSE;
+              }
+              *tab = '\0';
+              if (!move_address(state, file, &address))
+                     return FALSE;
+              fprintf(file->out, "%s\t%07d\n", line, address);
+       }
+       return !file->failed && !ferror(file->in);
+}
+
+
+/* Opens a file and the temporary file replacing it; only .ob and .rel must exist */
+static int open_rebased_file(const char *base_name, int kind, struct rebased_file *file) {
+       file->path = build_filename(base_name, rebased_extensions[kind]);
+       file->part = build_filename(base_name, rebased_parts[kind]);
+       if (!file->path || !file->part) {
+              diag_report(DIAG_NO_MEMORY, NO_LINE, "file name");
+              return FALSE;
+       }
+
+       file->in = fopen(file->path, "r");
+       if (!file->in) {
+              if (kind == REBASED_ENT || kind == REBASED_EXT)
+                     return TRUE;
+              diag_report(DIAG_OPEN_FAILED, NO_LINE, file->path);
+              return FALSE;
+       }
+
+       file->out = fopen(file->part, "w");
+       if (!file->out) {
+              diag_report(DIAG_OPEN_FAILED, NO_LINE, file->part);
+              return FALSE;
+       }
+       return TRUE;
+}
+
+
+int rebase_object(const char *base_name, int new_base) {
+       struct rebase state;
+       struct rebased_file *file;
+       int ok = TRUE;
+       int kind;
+
+       memset(&state, 0, sizeof(state));
+       state.new_base = new_base;
+
+       for (kind = 0; kind < NUMBER_OF_REBASED && ok; kind++)
+              ok = open_rebased_file(base_name, kind, &state.files[kind]);
+
+       if (ok)
+              ok = rebase_words(&state);
+       for (kind = REBASED_ENT; kind <= REBASED_EXT && ok; kind++) {
+              if (state.files[kind].in)
+                     ok = rebase_symbols(&state, &state.files[kind]);
+       }
+
+       /* Close everything, then replace the old files only if every new one is complete */
+       for (kind = 0; kind < NUMBER_OF_REBASED; kind++) {
+              file = &state.files[kind];
+              if (file->in)
+                     fclose(file->in);
+              if (file->out && fclose(file->out) != 0 && ok) {
+                     diag_report(DIAG_OPEN_FAILED, NO_LINE, file->part);
+                     ok = FALSE;
+              }
+       }
+       for (kind = 0; kind < NUMBER_OF_REBASED; kind++) {
+              file = &state.files[kind];
+              if (file->out && ok && rename(file->part, file->path) != 0) {
+                     diag_report(DIAG_OPEN_FAILED, NO_LINE, file->path);
+                     ok = FALSE;
+              }
+              if (file->out && !ok)
+                     remove(file->part);
+              mem_free(file->path);
+              mem_free(file->part);
+       }
+
+       return !ok;
+}
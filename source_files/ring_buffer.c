@@ -0,0 +1,91 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <sched.h>
+
+#include "../header_files/ring_buffer.h"
+#include "../header_files/parallel.h"
+#include "../header_files/mem_alloc.h"
+
+/* Polls before a waiting side starts yielding its time slice */
+#define SPIN_LIMIT 64
+
+
+int ring_init(struct ring_buffer *ring, size_t slot_size, unsigned long capacity) {
+       ring->slots = mem_malloc(slot_size * capacity);
+       if (!ring->slots)
+              return 0;
+
+       ring->slot_size = slot_size;
+       ring->mask = capacity - 1;
+       ring->head = 0;
+       ring->tail = 0;
+       ring->closed = 0;
+       return 1;
+}
+
+
+void *ring_push_slot(struct ring_buffer *ring, double *waited) {
+       unsigned long head = ring->head;   /* Only this thread writes head */
+       double started;
+       int spins = 0;
+
+       if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) > ring->mask) {
+              started = monotonic_seconds();
+              while (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) > ring->mask) {
+                     if (++spins > SPIN_LIMIT)
+                            sched_yield();
+              }
+              *waited += monotonic_seconds() - started;
+       }
+
+       return ring->slots + (head & ring->mask) * ring->slot_size;
+}
+
+
+void ring_push(struct ring_buffer *ring) {
+       /* Release: the record's contents become visible before the new head */
+       __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+
+void ring_close(struct ring_buffer *ring) {
+       __atomic_store_n(&ring->closed, 1, __ATOMIC_RELEASE);
+}
+
+
+void *ring_pop_slot(struct ring_buffer *ring, double *waited) {
+       unsigned long tail = ring->tail;   /* Only this thread writes tail */
+       double started = 0;
+       int spins = 0;
+
+       while (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail) {
+              /* closed is set after the last push, so re-check head once it is seen */
+              if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE) &&
+                  __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail) {
+                     if (started)
+                            *waited += monotonic_seconds() - started;
+                     return NULL;
+              }
+              if (!started)
+                     started = monotonic_seconds();
+              if (++spins > SPIN_LIMIT)
+                     sched_yield();
+       }
+       if (started)
+              *waited += monotonic_seconds() - started;
+
+       return ring->slots + (tail & ring->mask) * ring->slot_size;
+}
+
+
+void ring_pop(struct ring_buffer *ring) {
+       /* Release: reading the record is finished before the producer may reuse it */
+       __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+}
+
+
+void ring_free(struct ring_buffer *ring) {
+       mem_free(ring->slots);
+       ring->slots = NULL;
+}
@@ -7,137 +7,418 @@
 #include "../header_files/ast.h"
 #include "../header_files/translation_unit.h"
 #include "../header_files/mem_alloc.h"
+#include "../header_files/diagnostics.h"
+#include "../header_files/encoding.h"
+#include "../header_files/parallel.h"
+#include "../header_files/options.h"
+#include "../header_files/incbin.h"
 
 
-int secondPass(struct translation_unit *prog, FILE *amFile) {
+/* Writes one encoded word to the streamed .ob file or to the chunk's code image */
+static void store_code_word(struct second_pass_chunk *chunk, int address, int word) {
+       if (chunk->ob)
+              print_ob_line(chunk->ob, address, word);
+
+       /* The listing reads the words back after the pass */
+       if (!chunk->ob || options.listing) {
+              if (!memory_write(&chunk->code_image, address, word))
+                     chunk->failed = TRUE;
+       }
+}
+
+
+/* Records a diagnostic to be reported when the chunks are merged */
+static void add_report(struct second_pass_chunk *chunk, enum diag_code code, int line, const char *label) {
+       struct second_pass_report *report;
+
+       if (!ensure_chunk_reports_capacity(chunk)) {
+              chunk->failed = TRUE;
+              return;
+       }
+
+       report = &chunk->reports[chunk->report_count++];
+       report->code = code;
+       report->line = line;
+       strncpy(report->label, label, MAX_LINE_LEN);
+       report->label[MAX_LINE_LEN] = '\0';
+}
+
+
+/* Records the words of an instruction or data directive for the listing */
+static void add_listing_entry(struct second_pass_chunk *chunk, int data, int address, int words, int line) {
+       struct listing *listing = &chunk->listing;
+
+       if (!options.listing || words == 0)
+              return;
+
+       if (data ? !listing_append(&listing->data, &listing->data_count, &listing->data_capacity, address, words, line)
+                : !listing_append(&listing->code, &listing->code_count, &listing->code_capacity, address, words, line))
+              chunk->failed = TRUE;
+}
+
+
+/* Records an operand word that refers to an external symbol */
+static void add_extern_use(struct second_pass_chunk *chunk, const struct symbol *symbol, int address) {
+       if (!ensure_chunk_uses_capacity(chunk)) {
+              chunk->failed = TRUE;
+              return;
+       }
+
+       chunk->uses[chunk->use_count].symbol = symbol - chunk->prog->symbol_table;
+       chunk->uses[chunk->use_count].address = address;
+       chunk->use_count++;
+}
+
+
+/* Records an operand word holding the address of a label of this file (--relocations) */
+static void add_relocation(struct second_pass_chunk *chunk, int address) {
+       if (!options.relocations)
+              return;
+
+       if (!ensure_chunk_relocations_capacity(chunk)) {
+              chunk->failed = TRUE;
+              return;
+       }
+       chunk->relocations[chunk->relocation_count++] = address;
+}
+
+
+/*
+ * Encodes the instructions of one chunk. Runs on a worker thread: the symbol table is
+ * only read, and everything written goes to the chunk.
+ */
+static void encode_chunk(void *task) {
+       struct second_pass_chunk *chunk = task;
+       const struct translation_unit *prog = chunk->prog;
        char line[MAX_LINE_LEN + 1] = {0};
-       int errorFlag = FALSE;
-       int lineC = 1;
+       size_t position = chunk->range->begin;
+       int lineC = chunk->range->first_line;
        struct ast line_struct = {0};
        struct symbol * SymFind;
-       struct ext *extFind;
        int i;
+       int ic = chunk->range->first_address;
+       int dc = chunk->range->first_data;
        int instruction_address;
+       int data_address;
+       int word;
+       int syntax_error;
+       const char *error;
+
+       /* The chunk's first word line is at a known place of the streamed file */
+       if (chunk->stream) {
+              chunk->ob = ob_stream_seek(chunk->stream, chunk->range->first_word);
+              if (!chunk->ob)
+                     chunk->stream_failed = TRUE;
+       }
 
-       /* Read each line from the .am file */
-       while (fgets(line, sizeof(line), amFile)) {
+       /* Read each line of the chunk */
+       while (position < chunk->range->end && !chunk->failed) {
+              position = next_source_line(chunk->source, position, line);
               remove_newline(line); 
               line_struct = line_ast(line);
+              syntax_error = line_struct.error != NULL && line_struct.error[0] != '\0';
+              mem_free(line_struct.error);
 
-              /* Process only instruction lines */
-              if (line_struct.ast_type == instruction) {
-
-                     instruction_address = prog->IC;
-
-                     /* Encode first word: opcode, funct, A-bit */
-                     prog->code_image[prog->IC] = 0;
-                     prog->code_image[prog->IC] |= (line_struct.ast_options.ast_instruction.funct << FUNCT_SHIFT);
-                     prog->code_image[prog->IC] |= (line_struct.ast_options.ast_instruction.opCode << OPCODE_SHIFT);
-                     prog->code_image[prog->IC] |= A;
+              /* Follow .org so instructions land on the addresses the first pass assigned */
+              if (line_struct.ast_type == directive &&
+                  line_struct.ast_options.ast_directive.directive_type == ast_org) {
+                     ic = line_struct.ast_options.ast_directive.directive_options.address;
+              }
 
-                     /* Encode source/destination addressing and registers (2 operands) */
-                     if (line_struct.ast_options.ast_instruction.number_of_operands == 2) {
-                            prog->code_image[prog->IC] |= (line_struct.ast_options.ast_instruction.oprand[0].oprand_type << OPERAND_TYPE_SOURCE_SHIFT);
-                            prog->code_image[prog->IC] |= (line_struct.ast_options.ast_instruction.oprand[1].oprand_type << OPERAND_TYPE_DEST_SHIFT);
+              /* Data words were stored by the first pass; only their place is listed */
+              if (options.listing && !syntax_error && line_struct.ast_type == directive) {
+                     word = 0;
+                     if (line_struct.ast_options.ast_directive.directive_type == ast_data)
+                            word = line_struct.ast_options.ast_directive.directive_options.data.number_of_operands;
+                     else if (line_struct.ast_options.ast_directive.directive_type == ast_string)
+                            word = strlen(line_struct.ast_options.ast_directive.directive_options.string) - 1;
+                     else if (line_struct.ast_options.ast_directive.directive_type == ast_incbin &&
+                              !incbin_measure(line_struct.ast_options.ast_directive.directive_options.incbin.path,
+                                              line_struct.ast_options.ast_directive.directive_options.incbin.offset,
+                                              line_struct.ast_options.ast_directive.directive_options.incbin.length,
+                                              &word, &error))
+                            word = 0;
+                     /* The words of a block --pool-data shared are listed with the kept copy */
+                     data_address = prog->data_map ? prog->data_map[dc] : dc;
+                     if (data_address >= 0)
+                            add_listing_entry(chunk, TRUE, prog->ICF + data_address, word, lineC);
+                     dc += word;
+              }
 
-                            if (line_struct.ast_options.ast_instruction.oprand[0].oprand_type == ast_register) {
-                                   prog->code_image[prog->IC] |= (line_struct.ast_options.ast_instruction.oprand[0].oprand_options.register_number << REG_SRC_SHIFT);
-                            }
+              /* Process only instruction lines, except those the optimizer removed */
+              if (line_struct.ast_type == instruction && !(prog->removed_lines && prog->removed_lines[lineC])) {
 
-                            if (line_struct.ast_options.ast_instruction.oprand[1].oprand_type == ast_register) {
-                                   prog->code_image[prog->IC] |= (line_struct.ast_options.ast_instruction.oprand[1].oprand_options.register_number << REG_DEST_SHIFT);
-                            }
-                     }
+                     instruction_address = ic;
 
-                     /* Encode destination addressing/register (1 operand) */
-                     if (line_struct.ast_options.ast_instruction.number_of_operands == 1) {
-                            prog->code_image[prog->IC] |= (line_struct.ast_options.ast_instruction.oprand[0].oprand_type << OPERAND_TYPE_DEST_SHIFT);
+                     /* First word: precomputed opcode, funct, modes and A-bit, plus the register numbers */
+                     word = instruction_first_word(&line_struct);
 
-                            if (line_struct.ast_options.ast_instruction.oprand[0].oprand_type == ast_register) {
-                                   prog->code_image[prog->IC] |= (line_struct.ast_options.ast_instruction.oprand[0].oprand_options.register_number << REG_DEST_SHIFT);
-                            }
-                     }
-                     /* Advance to next word in memory */
-                     prog->IC++;
+                     /* Store the first word and advance to the next word in memory */
+                     store_code_word(chunk, ic++, word);
 
                      /* Encode additional words for operands */
                      for (i = 0; i < line_struct.ast_options.ast_instruction.number_of_operands; i++) {
 
                             /* Direct addressing (label) */
                             if (line_struct.ast_options.ast_instruction.oprand[i].oprand_type == ast_direct) {
+                                   word = 0;
 
                                    SymFind = symbolLookUp(prog->symbol_table, prog->symCount,
                                                           line_struct.ast_options.ast_instruction.oprand[i].oprand_options.label);
 
                                    if (SymFind) {
-                                          prog->code_image[prog->IC] = SymFind->address << ARE_SHIFT;
+                                          word = SymFind->address << ARE_SHIFT;
 
-                                          /* Handle extern symbol */
+                                          /* Handle extern symbol: remember where it is used */
                                           if (SymFind->symType == symExtern) {
-                                                 prog->code_image[prog->IC] |= E;
-                                                 extFind = extSearch(prog->externals, prog->extCount, SymFind->symName);
-                                                 if (extFind) {
-                                                        extFind->addresses[extFind->address_count] = prog->IC + STARTING_ADDRESS;
-                                                        extFind->address_count++;
-                                                 } else {
-                                                        if (!ensure_externals_capacity(prog)) {
-                                                               printf("Memory error: Could not expand externals table.\n");
-                                                               errorFlag = TRUE;
-                                                               break;
-                                                        }
-                                                        prog->externals[prog->extCount].externalName = SymFind->symName;
-                                                        prog->externals[prog->extCount].addresses[0] = prog->IC + STARTING_ADDRESS;
-                                                        prog->externals[prog->extCount].address_count = 1;
-                                                        prog->extCount++;
-                                                 }
+                                                 word |= E;
+                                                 add_extern_use(chunk, SymFind, ic);
                                           } 
                                           else {
-                                                 prog->code_image[prog->IC] |= R;
+                                                 word |= R;
+                                                 add_relocation(chunk, ic);
                                           }
                                    } else {
-                                          printf("error in line %d: undefined label \"%s\"\n", lineC,
-                                                 line_struct.ast_options.ast_instruction.oprand[i].oprand_options.label);
-                                          errorFlag = TRUE;
+                                          add_report(chunk, DIAG_UNDEFINED_LABEL, lineC,
+                                                     line_struct.ast_options.ast_instruction.oprand[i].oprand_options.label);
                                    }
 
-                                   prog->IC++;
+                                   store_code_word(chunk, ic++, word);
                             }
 
                             /* Relative addressing (label - current address) */
                             else if (line_struct.ast_options.ast_instruction.oprand[i].oprand_type == ast_relative) {
+                                   word = 0;
                                    SymFind = symbolLookUp(prog->symbol_table, prog->symCount,
                                                           line_struct.ast_options.ast_instruction.oprand[i].oprand_options.label);
 
                                    if (SymFind) {
-                                          prog->code_image[prog->IC] = (SymFind->address - (instruction_address + STARTING_ADDRESS)) << ARE_SHIFT;
-                                          prog->code_image[prog->IC] |= A;
+                                          word = (SymFind->address - instruction_address) << ARE_SHIFT;
+                                          word |= A;
 
                                           if (SymFind->symType == symExtern) {
-                                                 printf("error in line %d: undefined label(extern label) \"%s\"\n", lineC,
-                                                        line_struct.ast_options.ast_instruction.oprand[i].oprand_options.label);
-                                                 errorFlag = TRUE;
+                                                 add_report(chunk, DIAG_RELATIVE_EXTERN, lineC,
+                                                            line_struct.ast_options.ast_instruction.oprand[i].oprand_options.label);
                                           }
                                    } else {
-                                          printf("error in line %d: undefined label \"%s\"\n", lineC,
-                                                 line_struct.ast_options.ast_instruction.oprand[i].oprand_options.label);
-                                          errorFlag = TRUE;
+                                          add_report(chunk, DIAG_UNDEFINED_LABEL, lineC,
+                                                     line_struct.ast_options.ast_instruction.oprand[i].oprand_options.label);
                                    }
 
-                                   prog->IC++;
+                                   store_code_word(chunk, ic++, word);
                             }
 
                             /* Immediate addressing (#number) */
                             else if (line_struct.ast_options.ast_instruction.oprand[i].oprand_type == ast_instant) {
-                                   prog->code_image[prog->IC] = (line_struct.ast_options.ast_instruction.oprand[i].oprand_options.number << ARE_SHIFT);
-                                   prog->code_image[prog->IC] |= A;
-                                   prog->IC++;
+                                   word = (line_struct.ast_options.ast_instruction.oprand[i].oprand_options.number << ARE_SHIFT);
+                                   word |= A;
+                                   store_code_word(chunk, ic++, word);
                             }
                      }
+
+                     add_listing_entry(chunk, FALSE, instruction_address, ic - instruction_address, lineC);
               }
 
               lineC++;
        }
 
+       if (chunk->ob && fclose(chunk->ob) != 0)
+              chunk->stream_failed = TRUE;
+       chunk->ob = NULL;
+}
+
+
+/* Appends one listing section of a chunk to that of the program */
+static int merge_listing_section(struct listing_entry **entries, int *count, int *capacity,
+                                 const struct listing_entry *tail, int tail_count) {
+       int i;
+
+       for (i = 0; i < tail_count; i++) {
+              if (!listing_append(entries, count, capacity, tail[i].address, tail[i].words, tail[i].line))
+                     return TRUE;
+       }
+
+       return FALSE;
+}
+
+
+/* Appends a chunk's extern uses to the externals table; uses arrive in address order */
+static int merge_extern_uses(struct translation_unit *prog, const struct second_pass_chunk *chunk, int *ext_of_symbol) {
+       struct ext *extFind;
+       int i;
+
+       for (i = 0; i < chunk->use_count; i++) {
+              /* The first use of a symbol creates its entry, so entries keep first-use order */
+              if (ext_of_symbol[chunk->uses[i].symbol] < 0) {
+                     if (!ensure_externals_capacity(prog))
+                            return TRUE;
+                     extFind = &prog->externals[prog->extCount];
+                     extFind->externalName = prog->symbol_table[chunk->uses[i].symbol].symName;
+                     extFind->addresses = NULL;
+                     extFind->address_count = 0;
+                     extFind->address_capacity = 0;
+                     ext_of_symbol[chunk->uses[i].symbol] = prog->extCount++;
+              }
+
+              extFind = &prog->externals[ext_of_symbol[chunk->uses[i].symbol]];
+              if (!ensure_ext_addresses_capacity(extFind))
+                     return TRUE;
+              extFind->addresses[extFind->address_count++] = chunk->uses[i].address;
+       }
+
+       return FALSE;
+}
+
+
+int secondPass(struct translation_unit *prog, const struct source_text *source, const struct ob_stream *stream) {
+       struct second_pass_chunk *chunks;
+       struct second_pass_chunk *chunk;
+       struct second_pass_report *report;
+       int *ext_of_symbol;
+       int errorFlag = FALSE;
+       int last_line = NO_LINE;
+       int stopped = FALSE;
+       int stream_failed = FALSE;
+       int c, i;
+
+       chunks = mem_calloc(prog->chunk_count > 0 ? prog->chunk_count : 1, sizeof(struct second_pass_chunk));
+       ext_of_symbol = mem_malloc((prog->symCount > 0 ? prog->symCount : 1) * sizeof(int));
+       if (!chunks || !ext_of_symbol) {
+              diag_report(DIAG_NO_MEMORY, NO_LINE, "second pass chunks");
+              mem_free(chunks);
+              mem_free(ext_of_symbol);
+              return TRUE;
+       }
+       for (i = 0; i < prog->symCount; i++)
+              ext_of_symbol[i] = -1;
+
+       /* Encode the chunks of the first pass, each starting at its precomputed address */
+       for (c = 0; c < prog->chunk_count; c++) {
+              chunks[c].source = source;
+              chunks[c].range = &prog->chunks[c];
+              chunks[c].prog = prog;
+              chunks[c].stream = stream;
+       }
+       parallel_run(encode_chunk, chunks, sizeof(struct second_pass_chunk), prog->chunk_count);
+
+       /* Merge in chunk order, which is both line and address order */
+       for (c = 0; c < prog->chunk_count; c++) {
+              chunk = &chunks[c];
+
+              /* A serial pass checks the error limit before each line, so stop at the same point */
+              for (i = 0; i < chunk->report_count && !stopped; i++) {
+                     report = &chunk->reports[i];
+                     if (report->line != last_line && diag_limit_reached()) {
+                            stopped = TRUE;
+                            break;
+                     }
+                     diag_report(report->code, report->line, report->label);
+                     last_line = report->line;
+                     errorFlag = TRUE;
+              }
+
+              if (chunk->failed) {
+                     diag_report(DIAG_NO_MEMORY, NO_LINE, "code image");
+                     errorFlag = TRUE;
+              }
+              stream_failed |= chunk->stream_failed;
+
+              errorFlag |= merge_extern_uses(prog, chunk, ext_of_symbol);
+
+              if (chunk->relocation_count > 0) {
+                     if (ensure_relocations_capacity(prog, chunk->relocation_count)) {
+                            memcpy(prog->relocations + prog->relocation_count, chunk->relocations,
+                                   chunk->relocation_count * sizeof(int));
+                            prog->relocation_count += chunk->relocation_count;
+                     }
+                     else {
+                            errorFlag = TRUE;
+                     }
+              }
+
+              if (merge_listing_section(&prog->listing.code, &prog->listing.code_count, &prog->listing.code_capacity,
+                                        chunk->listing.code, chunk->listing.code_count) ||
+                  merge_listing_section(&prog->listing.data, &prog->listing.data_count, &prog->listing.data_capacity,
+                                        chunk->listing.data, chunk->listing.data_count)) {
+                     diag_report(DIAG_NO_MEMORY, NO_LINE, "listing");
+                     errorFlag = TRUE;
+              }
+
+              if (!memory_append(&prog->code_image, &chunk->code_image)) {
+                     diag_report(DIAG_NO_MEMORY, NO_LINE, "code image");
+                     errorFlag = TRUE;
+              }
+       }
+
+       if (stream_failed) {
+              diag_report(DIAG_OPEN_FAILED, NO_LINE, stream->path);
+              errorFlag = TRUE;
+       }
+
+       for (c = 0; c < prog->chunk_count; c++) {
+              free_memory_image(&chunks[c].code_image);
+              mem_free(chunks[c].uses);
+              mem_free(chunks[c].relocations);
+              mem_free(chunks[c].reports);
+              free_listing(&chunks[c].listing);
+       }
+       mem_free(chunks);
+       mem_free(ext_of_symbol);
+
        return errorFlag;
 }
 
+
+/* Orders symbol pointers by name */
+static int compare_symbol_names(const void *a, const void *b) {
+       return strcmp((*(struct symbol * const *)a)->symName, (*(struct symbol * const *)b)->symName);
+}
+
+
+/* Compares a label with the name of a symbol pointer, for bsearch() */
+static int compare_label_to_symbol(const void *label, const void *element) {
+       return strcmp((const char *)label, (*(struct symbol * const *)element)->symName);
+}
+
+
+int check_references(struct translation_unit *prog) {
+       const struct symbol_reference *reference;
+       struct symbol **by_name;
+       struct symbol **SymFind;
+       enum diag_code code;
+       int errorFlag = FALSE;
+       int last_line = NO_LINE;
+       int i;
+
+       /* Names are unique in the table, so a sorted index finds the same symbol as symbolLookUp() */
+       by_name = mem_malloc((prog->symCount > 0 ? prog->symCount : 1) * sizeof(struct symbol *));
+       if (!by_name) {
+              diag_report(DIAG_NO_MEMORY, NO_LINE, "symbol index");
+              return TRUE;
+       }
+       for (i = 0; i < prog->symCount; i++)
+              by_name[i] = &prog->symbol_table[i];
+       qsort(by_name, prog->symCount, sizeof(struct symbol *), compare_symbol_names);
+
+       for (i = 0; i < prog->reference_count; i++) {
+              reference = &prog->references[i];
+              SymFind = bsearch(reference->label, by_name, prog->symCount, sizeof(struct symbol *), compare_label_to_symbol);
+
+              if (!SymFind)
+                     code = DIAG_UNDEFINED_LABEL;
+              else if (reference->relative && (*SymFind)->symType == symExtern)
+                     code = DIAG_RELATIVE_EXTERN;
+              else
+                     continue;
+
+              /* Stop where secondPass() would: at the error limit, before a new line */
+              if (reference->line != last_line && diag_limit_reached())
+                     break;
+              diag_report(code, reference->line, reference->label);
+              last_line = reference->line;
+              errorFlag = TRUE;
+       }
+
+       mem_free(by_name);
+       return errorFlag;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file sim_main.c
+ * @brief Entry point for the simulator that runs assembled .ob images.
+ *
+ * Each argument is a base name (without extension); "<name>.ob" is loaded and
+ * executed. red reads from standard input and prn writes to standard output,
+ * both through stdio buffers. A summary line with the number of executed
+ * instructions and instructions per second is written to stderr per file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../header_files/simulator.h"
+#include "../header_files/mem_alloc.h"
+
+#define OUTPUT_BUFFER_SIZE (1 << 16)
+
+
+int main(int argc, char const *argv[]) {
+    static char output_buffer[OUTPUT_BUFFER_SIZE];
+    unsigned long max_steps = 0;
+    int quiet = FALSE;
+    int failed = 0;
+    int i;
+
+    /* Parse options that precede the file names */
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "--max-steps") == STRCMP_TRUE && i + 1 < argc) {
+            max_steps = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--quiet") == STRCMP_TRUE) {
+            quiet = TRUE;
+        }
+        else {
+            break;
+        }
+    }
+
+    if (i >= argc) {
+        printf("Usage: simulator [--max-steps N] [--quiet] file1 [file2 ...]\n");
+        return 1;
+    }
+
+    setvbuf(stdout, output_buffer, _IOFBF, sizeof(output_buffer));
+
+    for (; i < argc; i++) {
+        struct machine m;
+        char *ob_filename = build_filename(argv[i], ".ob");
+        clock_t start;
+        double seconds;
+
+        if (!ob_filename) {
+            fprintf(stderr, "Memory allocation failed.\n");
+            return 1;
+        }
+
+        if (sim_load(&m, ob_filename) != SIM_OK) {
+            sim_free(&m);
+            mem_free(ob_filename);
+            failed = 1;
+            continue;
+        }
+
+        start = clock();
+        failed |= sim_run(&m, max_steps);
+        seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+        fflush(stdout);
+
+        if (!quiet) {
+            fprintf(stderr, "%s: %lu instructions in %.3f s (%.0f instructions/sec)\n",
+                    ob_filename, m.steps, seconds, seconds > 0 ? m.steps / seconds : 0.0);
+        }
+
+        sim_free(&m);
+        mem_free(ob_filename);
+    }
+
+    return failed;
+}
@@ -0,0 +1,394 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../header_files/simulator.h"
+#include "../header_files/second_pass.h"
+#include "../header_files/text_parser.h"
+#include "../header_files/mem_alloc.h"
+
+
+#define SIGN_BIT_24 0x800000
+#define SIGN_BIT_21 0x100000
+#define VALUE_MASK_21 0x1FFFFF
+#define MODE_INSTANT 0
+#define MODE_DIRECT 1
+#define MODE_RELATIVE 2
+#define MODE_REGISTER 3
+#define SRC 0
+#define DEST 1
+
+
+/**
+ * One slot of the dispatch table: the handler for an (opcode, funct) pair and
+ * the operand count taken from instruction_table.
+ */
+struct dispatch_entry {
+       sim_handler handler;
+       int number_of_operands;
+};
+
+static struct dispatch_entry dispatch[SIM_NUMBER_OF_OPCODES][SIM_NUMBER_OF_FUNCTS];
+static int dispatch_ready = FALSE;
+
+
+static int sign_extend_24(int word) {
+       return ((word & WORD_MASK) ^ SIGN_BIT_24) - SIGN_BIT_24;
+}
+
+static int sign_extend_21(int value) {
+       return ((value & VALUE_MASK_21) ^ SIGN_BIT_21) - SIGN_BIT_21;
+}
+
+static void sim_fault(struct machine *m, int address, const char *message) {
+       fprintf(stderr, "runtime error at address %07d: %s\n", address, message);
+       m->halted = TRUE;
+       m->error = SIM_ERROR;
+}
+
+static int legal_address(int address) {
+       return address >= 0 && address < SIM_MEMORY_SIZE;
+}
+
+/* Stores a word and drops every cached decoding that may contain it */
+static void sim_store(struct machine *m, int address, int value) {
+       int i;
+
+       if (!legal_address(address)) {
+              sim_fault(m, m->pc, "store outside of memory");
+              return;
+       }
+       m->memory[address] = value & WORD_MASK;
+       m->loaded[address] = TRUE;
+
+       /* An instruction is at most three words long */
+       for (i = address - 2; i <= address; i++) {
+              if (i >= m->code_start && i < m->code_end)
+                     m->decoded[i - m->code_start].handler = NULL;
+       }
+}
+
+static int read_operand(struct machine *m, const struct decoded_instruction *d, int k, int address) {
+       switch (d->mode[k]) {
+              case MODE_INSTANT:
+                     return d->value[k];
+              case MODE_DIRECT:
+                     if (d->are[k] == E) {
+                            sim_fault(m, address, "reference to an unresolved external symbol");
+                            return 0;
+                     }
+                     if (!legal_address(d->value[k])) {
+                            sim_fault(m, address, "load outside of memory");
+                            return 0;
+                     }
+                     return sign_extend_24(m->memory[d->value[k]]);
+              case MODE_REGISTER:
+                     return m->registers[d->reg[k]];
+       }
+       sim_fault(m, address, "relative operand used as a value");
+       return 0;
+}
+
+static void write_operand(struct machine *m, const struct decoded_instruction *d, int k, int address, int value) {
+       switch (d->mode[k]) {
+              case MODE_DIRECT:
+                     if (d->are[k] == E)
+                            sim_fault(m, address, "reference to an unresolved external symbol");
+                     else
+                            sim_store(m, d->value[k], value);
+                     return;
+              case MODE_REGISTER:
+                     m->registers[d->reg[k]] = sign_extend_24(value);
+                     return;
+       }
+       sim_fault(m, address, "illegal destination operand");
+}
+
+static int jump_target(struct machine *m, const struct decoded_instruction *d, int address) {
+       if (d->mode[DEST] == MODE_DIRECT) {
+              if (d->are[DEST] == E)
+                     sim_fault(m, address, "jump to an unresolved external symbol");
+              return d->value[DEST];
+       }
+       if (d->mode[DEST] == MODE_RELATIVE)
+              return address + d->value[DEST];
+
+       sim_fault(m, address, "illegal jump operand");
+       return address;
+}
+
+
+static void exec_mov(struct machine *m, const struct decoded_instruction *d, int address) {
+       write_operand(m, d, DEST, address, read_operand(m, d, SRC, address));
+}
+
+static void exec_cmp(struct machine *m, const struct decoded_instruction *d, int address) {
+       int src = read_operand(m, d, SRC, address);
+       int dest = read_operand(m, d, DEST, address);
+       m->zero_flag = (sign_extend_24(src - dest) == 0);
+}
+
+static void exec_add(struct machine *m, const struct decoded_instruction *d, int address) {
+       int src = read_operand(m, d, SRC, address);
+       write_operand(m, d, DEST, address, read_operand(m, d, DEST, address) + src);
+}
+
+static void exec_sub(struct machine *m, const struct decoded_instruction *d, int address) {
+       int src = read_operand(m, d, SRC, address);
+       write_operand(m, d, DEST, address, read_operand(m, d, DEST, address) - src);
+}
+
+static void exec_lea(struct machine *m, const struct decoded_instruction *d, int address) {
+       if (d->mode[SRC] != MODE_DIRECT || d->are[SRC] == E) {
+              sim_fault(m, address, "illegal lea source operand");
+              return;
+       }
+       write_operand(m, d, DEST, address, d->value[SRC]);
+}
+
+static void exec_clr(struct machine *m, const struct decoded_instruction *d, int address) {
+       write_operand(m, d, DEST, address, 0);
+}
+
+static void exec_not(struct machine *m, const struct decoded_instruction *d, int address) {
+       write_operand(m, d, DEST, address, ~read_operand(m, d, DEST, address));
+}
+
+static void exec_inc(struct machine *m, const struct decoded_instruction *d, int address) {
+       write_operand(m, d, DEST, address, read_operand(m, d, DEST, address) + 1);
+}
+
+static void exec_dec(struct machine *m, const struct decoded_instruction *d, int address) {
+       write_operand(m, d, DEST, address, read_operand(m, d, DEST, address) - 1);
+}
+
+static void exec_jmp(struct machine *m, const struct decoded_instruction *d, int address) {
+       m->pc = jump_target(m, d, address);
+}
+
+static void exec_bne(struct machine *m, const struct decoded_instruction *d, int address) {
+       if (!m->zero_flag)
+              m->pc = jump_target(m, d, address);
+}
+
+static void exec_jsr(struct machine *m, const struct decoded_instruction *d, int address) {
+       if (m->sp >= SIM_STACK_SIZE) {
+              sim_fault(m, address, "return stack overflow");
+              return;
+       }
+       m->stack[m->sp++] = m->pc;
+       m->pc = jump_target(m, d, address);
+}
+
+static void exec_red(struct machine *m, const struct decoded_instruction *d, int address) {
+       write_operand(m, d, DEST, address, getc(m->in));
+}
+
+static void exec_prn(struct machine *m, const struct decoded_instruction *d, int address) {
+       int value = read_operand(m, d, DEST, address);
+       if (!m->error)
+              fprintf(m->out, "%d\n", value);
+}
+
+static void exec_rts(struct machine *m, const struct decoded_instruction *d, int address) {
+       if (m->sp == 0) {
+              sim_fault(m, address, "rts with an empty return stack");
+              return;
+       }
+       m->pc = m->stack[--m->sp];
+}
+
+static void exec_stop(struct machine *m, const struct decoded_instruction *d, int address) {
+       m->halted = TRUE;
+}
+
+
+/* Handlers in the order of instruction_table */
+static const sim_handler handlers[NUMBER_OF_INSTRACTIONS] = {
+       exec_mov, exec_cmp, exec_add, exec_sub, exec_lea,
+       exec_clr, exec_not, exec_inc, exec_dec,
+       exec_jmp, exec_bne, exec_jsr,
+       exec_red, exec_prn, exec_rts, exec_stop
+};
+
+static void build_dispatch_table(void) {
+       int i;
+
+       if (dispatch_ready)
+              return;
+
+       for (i = 0; i < NUMBER_OF_INSTRACTIONS; i++) {
+              dispatch[instruction_table[i].opCode][instruction_table[i].funct].handler = handlers[i];
+              dispatch[instruction_table[i].opCode][instruction_table[i].funct].number_of_operands = instruction_table[i].number_of_operands;
+       }
+       dispatch_ready = TRUE;
+}
+
+
+/* Reads the extra word of operand k (if its mode has one) and returns the next word address */
+static int decode_extra_word(struct machine *m, struct decoded_instruction *d, int k, int address) {
+       int word;
+
+       if (d->mode[k] == MODE_REGISTER || !legal_address(address))
+              return address;
+
+       word = m->memory[address];
+       d->value[k] = sign_extend_21(word >> ARE_SHIFT);
+       d->are[k] = word & ARE_MASK;
+       d->length++;
+       return address + 1;
+}
+
+/* Fills the cache slot of the instruction at address, returns FALSE for an illegal word */
+static int decode(struct machine *m, int address, struct decoded_instruction *d) {
+       int word = m->memory[address];
+       const struct dispatch_entry *entry;
+       int next = address + 1;
+
+       entry = &dispatch[(word >> OPCODE_SHIFT) & OPCODE_MASK][(word >> FUNCT_SHIFT) & FUNCT_MASK];
+       if (!entry->handler)
+              return FALSE;
+
+       memset(d, 0, sizeof(*d));
+       d->length = 1;
+       d->number_of_operands = entry->number_of_operands;
+       d->mode[SRC] = (word >> OPERAND_TYPE_SOURCE_SHIFT) & OPERAND_TYPE_MASK;
+       d->reg[SRC] = (word >> REG_SRC_SHIFT) & REGISTER_MASK;
+       d->mode[DEST] = (word >> OPERAND_TYPE_DEST_SHIFT) & OPERAND_TYPE_MASK;
+       d->reg[DEST] = (word >> REG_DEST_SHIFT) & REGISTER_MASK;
+
+       if (d->number_of_operands == 2)
+              next = decode_extra_word(m, d, SRC, next);
+       if (d->number_of_operands >= 1)
+              decode_extra_word(m, d, DEST, next);
+
+       d->handler = entry->handler;
+       return TRUE;
+}
+
+
+int sim_load(struct machine *m, const char *obFileName) {
+       FILE *obFile;
+       int ic, dc;
+       int address;
+       unsigned int word;
+       int line = 0;
+       int i;
+
+       memset(m, 0, sizeof(*m));
+       m->in = stdin;
+       m->out = stdout;
+       build_dispatch_table();
+
+       obFile = fopen(obFileName, "r");
+       if (!obFile) {
+              fprintf(stderr, "Could not open file: %s\n", obFileName);
+              return SIM_ERROR;
+       }
+
+       if (fscanf(obFile, "%d %d", &ic, &dc) != 2 || ic < 0 || dc < 0) {
+              fprintf(stderr, "%s: missing IC/DC header\n", obFileName);
+              fclose(obFile);
+              return SIM_ERROR;
+       }
+
+       m->memory = mem_calloc(SIM_MEMORY_SIZE, sizeof(int));
+       m->loaded = mem_calloc(SIM_MEMORY_SIZE, sizeof(unsigned char));
+       if (!m->memory || !m->loaded) {
+              fprintf(stderr, "Memory allocation failed.\n");
+              fclose(obFile);
+              return SIM_ERROR;
+       }
+
+       m->code_start = SIM_MEMORY_SIZE;
+       m->code_end = 0;
+
+       /* Every following line is "address word"; the first IC lines hold code */
+       while (fscanf(obFile, "%d %x", &address, &word) == 2) {
+              if (!legal_address(address)) {
+                     fprintf(stderr, "%s: address %d out of range\n", obFileName, address);
+                     fclose(obFile);
+                     return SIM_ERROR;
+              }
+              m->memory[address] = (int)word & WORD_MASK;
+              m->loaded[address] = TRUE;
+
+              if (line < ic) {
+                     if (address < m->code_start)
+                            m->code_start = address;
+                     if (address >= m->code_end)
+                            m->code_end = address + 1;
+              }
+              line++;
+       }
+       fclose(obFile);
+
+       if (line != ic + dc || m->code_start >= m->code_end) {
+              fprintf(stderr, "%s: expected %d words with code, found %d\n", obFileName, ic + dc, line);
+              return SIM_ERROR;
+       }
+
+       m->decoded = mem_calloc(m->code_end - m->code_start, sizeof(struct decoded_instruction));
+       if (!m->decoded) {
+              fprintf(stderr, "Memory allocation failed.\n");
+              return SIM_ERROR;
+       }
+
+       /* Pre-decode the code section in program order, skipping addresses without a word; anything else is decoded when first executed */
+       for (i = m->code_start; i < m->code_end; ) {
+              if (!m->loaded[i]) {
+                     i++;
+                     continue;
+              }
+              if (!decode(m, i, &m->decoded[i - m->code_start]))
+                     break;
+              i += m->decoded[i - m->code_start].length;
+       }
+
+       m->pc = m->code_start;
+       return SIM_OK;
+}
+
+
+int sim_run(struct machine *m, unsigned long max_steps) {
+       struct decoded_instruction *d;
+       int address;
+
+       while (!m->halted) {
+              address = m->pc;
+              if (address < m->code_start || address >= m->code_end) {
+                     sim_fault(m, address, "execution left the code section");
+                     break;
+              }
+
+              /* An address the image holds no word for is not code */
+              d = &m->decoded[address - m->code_start];
+              if (!d->handler && !m->loaded[address]) {
+                     sim_fault(m, address, "executing an address with no word");
+                     break;
+              }
+              if (!d->handler && !decode(m, address, d)) {
+                     sim_fault(m, address, "illegal instruction");
+                     break;
+              }
+
+              m->pc = address + d->length;
+              d->handler(m, d, address);
+              m->steps++;
+
+              if (max_steps && m->steps >= max_steps && !m->halted) {
+                     sim_fault(m, m->pc, "step limit reached");
+              }
+       }
+       return m->error;
+}
+
+
+void sim_free(struct machine *m) {
+       mem_free(m->memory);
+       mem_free(m->loaded);
+       mem_free(m->decoded);
+       m->memory = NULL;
+       m->loaded = NULL;
+       m->decoded = NULL;
+}
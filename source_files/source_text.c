@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../header_files/source_text.h"
+#include "../header_files/ast.h"
+#include "../header_files/mem_alloc.h"
+
+
+int load_source_text(struct source_text *source, const char *filename) {
+       FILE *file = fopen(filename, "r");
+       long size;
+
+       source->text = NULL;
+       source->length = 0;
+       source->capacity = 0;
+       if (!file)
+              return 0;
+
+       /* The .am file is a regular file, so its size is known up front */
+       if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < 0 || fseek(file, 0, SEEK_SET) != 0) {
+              fclose(file);
+              return 0;
+       }
+
+       source->text = mem_malloc((size_t)size + 1);
+       if (!source->text) {
+              fclose(file);
+              return 0;
+       }
+
+       source->capacity = (size_t)size + 1;
+       source->length = fread(source->text, 1, (size_t)size, file);
+       source->text[source->length] = '\0';
+       fclose(file);
+       return 1;
+}
+
+
+int append_source_text(struct source_text *source, const char *text, size_t length) {
+       if (!ensure_source_text_capacity(source, length))
+              return 0;
+
+       memcpy(source->text + source->length, text, length);
+       source->length += length;
+       source->text[source->length] = '\0';
+       return 1;
+}
+
+
+size_t next_source_line(const struct source_text *source, size_t position, char *line) {
+       size_t count = 0;
+
+       /* Same split as fgets(line, MAX_LINE_LEN + 1, file): stop after a newline or a full buffer */
+       while (position < source->length && count < MAX_LINE_LEN) {
+              line[count++] = source->text[position++];
+              if (line[count - 1] == '\n')
+                     break;
+       }
+       line[count] = '\0';
+       return position;
+}
+
+
+size_t source_line_boundary(const struct source_text *source, size_t position) {
+       const char *newline;
+
+       if (position >= source->length)
+              return source->length;
+       if (position == 0 || source->text[position - 1] == '\n')
+              return position;
+
+       newline = memchr(source->text + position, '\n', source->length - position);
+       return newline ? (size_t)(newline - source->text) + 1 : source->length;
+}
+
+
+void free_source_text(struct source_text *source) {
+       mem_free(source->text);
+       source->text = NULL;
+       source->length = 0;
+       source->capacity = 0;
+}
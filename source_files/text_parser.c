@@ -2,6 +2,10 @@
 #include <stdio.h>
 #include "../header_files/ast.h"
 #include "../header_files/text_parser.h"
+#include "../header_files/translation_unit.h"
+#include "../header_files/encoding.h"
+#include "../header_files/mem_alloc.h"
+#include "../header_files/incbin.h"
 #include <string.h>
 #include <limits.h>
 #include <stdlib.h>
@@ -9,28 +13,17 @@
 #define END_OF_WORD ", \t\v\f\""
 #define MAX_NUMBER INT_MAX
 #define MIN_NUMBER INT_MIN 
+#define INCBIN_MAX_TOKENS 5   /* "file" , offset , length */
 
 char * register_names[NUMBER_OF_REGISTERS]   = {"r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7"};
-char * directive_names[NUMBER_OF_DIRECTIVES]  = {"data", "string", "entry", "extern"};
+char * directive_names[NUMBER_OF_DIRECTIVES]  = {"data", "string", "entry", "extern", "org", "incbin"};
+
+#define INSTRUCTION_ENTRY(name, opcode, funct, src_modes, dest_modes, operands) \
+       {#name, opcode, funct, operands},
 
 struct instruction instruction_table[NUMBER_OF_INSTRACTIONS] = 
 {
-    {"mov",  0,   0, {"013", "13" }, 2},
-    {"cmp",  1,   0, {"013", "013"}, 2},
-    {"add",  2,   1, {"013", "13" }, 2},
-    {"sub",  2,   2, {"013", "13" }, 2},
-    {"lea",  4,   0, {"1"  , "13" }, 2},
-    {"clr",  5,   1, {""   , "13" }, 1},
-    {"not",  5,   2, {""   , "13" }, 1},
-    {"inc",  5,   3, {""   , "13" }, 1},
-    {"dec",  5,   4, {""   , "13" }, 1},
-    {"jmp",  9,   1, {""   , "12" }, 1},
-    {"bne",  9,   2, {""   , "12" }, 1},
-    {"jsr",  9,   3, {""   , "12" }, 1},
-    {"red",  12,  0, {""   , "13" }, 1},
-    {"prn",  13,  0, {""   , "013"}, 1},
-    {"rts",  14,  0, {""   , ""   }, 0},
-    {"stop", 15,  0, {""   , ""   }, 0}
+       INSTRUCTION_LIST(INSTRUCTION_ENTRY)
 };
 
 
@@ -109,8 +102,8 @@ int legal_label(char *str) {
 int legal_label_def(char *str, char *label_out) {
         char temp_label[MAX_LABEL_LEN + 1];
 
-        /* Must be at least 2 characters and end with ':' */
-        if (!str || strlen(str) < 2 || str[strlen(str) - 1] != ':')
+        /* Must be at least 2 characters, end with ':' and fit the label buffer */
+        if (!str || strlen(str) < 2 || strlen(str) - 1 > MAX_LABEL_LEN || str[strlen(str) - 1] != ':')
                 return FALSE;
 
         /* Copy label without ':' into temporary buffer */
@@ -225,48 +218,46 @@ void parse_instruction_operand(char *operand, int operand_number, struct instruc
        int number;
        char *label;
        int register_number;
-       char operand_type = '4';
+       int operand_type = NUMBER_OF_MODES;
 
        /* Determine the operand type by checking format and content */
        if (inst_number_operand(operand, &number))
-              operand_type = '0';
+              operand_type = ast_instant;
        else if (legal_label(operand))
-              operand_type = '1';
+              operand_type = ast_direct;
        else if (relative_operand(operand, &label))
-              operand_type = '2';
+              operand_type = ast_relative;
        else if (register_operand(operand, &register_number))
-              operand_type = '3';
+              operand_type = ast_register;
 
        /* If the instruction has two operands and this is the first, it's a source operand */
        if (inst->number_of_operands == 2 && operand_number == 0)
               destination = 0;
 
        /* If the operand type is legal for this instruction and position, encode it in AST */
-       if (strchr(inst->operands_legal_types[destination], operand_type))
+       if (operand_type < NUMBER_OF_MODES && operand_legal((int)(inst - instruction_table), destination, operand_type))
        {
+              ast->ast_options.ast_instruction.oprand[operand_number].oprand_type = operand_type;
+
               switch (operand_type)
               {
-                     case '0':
+                     case ast_instant:
                             /* Encode immediate value */
-                            ast->ast_options.ast_instruction.oprand[operand_number].oprand_type = ast_instant;
                             ast->ast_options.ast_instruction.oprand[operand_number].oprand_options.number = number;
                             break;
 
-                     case '1':
+                     case ast_direct:
                             /* Encode direct label */
-                            ast->ast_options.ast_instruction.oprand[operand_number].oprand_type = ast_direct;
                             ast->ast_options.ast_instruction.oprand[operand_number].oprand_options.label = operand;
                             break;
 
-                     case '2':
+                     case ast_relative:
                             /* Encode relative label */
-                            ast->ast_options.ast_instruction.oprand[operand_number].oprand_type = ast_relative;
                             ast->ast_options.ast_instruction.oprand[operand_number].oprand_options.label = label;
                             break;
 
-                     case '3':
+                     case ast_register:
                             /* Encode register number */
-                            ast->ast_options.ast_instruction.oprand[operand_number].oprand_type = ast_register;
                             ast->ast_options.ast_instruction.oprand[operand_number].oprand_options.register_number = register_number;
                             break;
               }
@@ -345,8 +336,9 @@ void parse_directive_operands(char **operands_array, int size_of_operands_array,
                 }
         }
 
-        /* Only .data (type 0) can have more than one operand */
-        if(directive_type != DATA && size_of_operands_array > 1)
+        /* Only .data (type 0) can have more than one operand; .incbin takes up to three */
+        if((directive_type == INCBIN && size_of_operands_array > INCBIN_MAX_TOKENS) ||
+           (directive_type != DATA && directive_type != INCBIN && size_of_operands_array > 1))
         {
                 append_error(&ast->error, "to many operands");
         }
@@ -386,6 +378,48 @@ void parse_directive_operands(char **operands_array, int size_of_operands_array,
                 }
                 break;
 
+        case ORG:
+                /* Handle .org: a single non-negative address */
+                if(legal_number(operands_array[0], 0, MAX_ADDRESS, &result, FALSE) == VALID_NUMBER)
+                {
+                        ast->ast_options.ast_directive.directive_options.address = result;
+                }
+                else
+                {
+                        append_error(&ast->error, "illegal address");
+                }
+                break;
+
+        case INCBIN:
+                /* Handle .incbin: a quoted file name, then an optional byte offset and word count */
+                ast->ast_options.ast_directive.directive_options.incbin.offset = 0;
+                ast->ast_options.ast_directive.directive_options.incbin.length = INCBIN_TO_END;
+                if(size_of_operands_array > 0 && legal_string(operands_array[0]) && strlen(operands_array[0]) > 2)
+                {
+                        /* Drop the quotation marks in place, like the newline of a label */
+                        operands_array[0][strlen(operands_array[0]) - 1] = '\0';
+                        ast->ast_options.ast_directive.directive_options.incbin.path = operands_array[0] + 1;
+                }
+                else
+                {
+                        append_error(&ast->error, "illegal file name");
+                }
+                if(size_of_operands_array > 2)
+                {
+                        if(legal_number(operands_array[2], 0, MAX_NUMBER, &result, FALSE) == VALID_NUMBER)
+                                ast->ast_options.ast_directive.directive_options.incbin.offset = result;
+                        else
+                                append_error(&ast->error, "illegal offset");
+                }
+                if(size_of_operands_array > 4)
+                {
+                        if(legal_number(operands_array[4], 0, MAX_ADDRESS + 1, &result, FALSE) == VALID_NUMBER)
+                                ast->ast_options.ast_directive.directive_options.incbin.length = result;
+                        else
+                                append_error(&ast->error, "illegal length");
+                }
+                break;
+
         case ENTRY:
         case EXTERN:
                 /* Handle .entry and .extern */
@@ -435,6 +469,18 @@ int check_directive(char *str)
                 return EXTERN; /* Return 3 for .extern directive */
         }
 
+        /* Check if the directive is ".org" */
+        else if (strcmp(str, ".org") == STRCMP_TRUE)
+        {
+                return ORG; /* Return 4 for .org directive */
+        }
+
+        /* Check if the directive is ".incbin" */
+        else if (strcmp(str, ".incbin") == STRCMP_TRUE)
+        {
+                return INCBIN; /* Return 5 for .incbin directive */
+        }
+
         /* If none of the directives match, return -1 */
         return NOT_A_DIRECTIVE;
 }
@@ -528,7 +574,7 @@ void append_error(char **error, const char *new_msg) {
        size_t new_len = current_len + strlen(new_msg) + 2; /* +2 for \n + \0 */
 
        /* Attempt to reallocate memory for the error message */
-       char *temp = realloc(*error, new_len);
+       char *temp = mem_realloc(*error, new_len);
        if (!temp) return;  /* If realloc fails, do nothing */
 
        /* Update the original pointer with the new memory */
@@ -0,0 +1,154 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <pthread.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+#include "../header_files/trace.h"
+#include "../header_files/parallel.h"
+
+#define TRUE 1
+#define FALSE 0
+#define TRACE_BUFFER_SIZE (1 << 16)
+#define MICROSECONDS 1e6
+
+/* The open trace; events come from the main thread and from workers */
+static struct {
+       FILE *file;              /* NULL when not tracing */
+       pthread_mutex_t lock;    /* Serializes the writes */
+       double origin;           /* monotonic_seconds() at trace_start() */
+       long process;            /* pid of every event */
+       int events;              /* Events written, to place the commas */
+} trace = {NULL, PTHREAD_MUTEX_INITIALIZER};
+
+
+/* Thread id of the caller, as shown by top and perf; the process id elsewhere */
+static long thread_id(void) {
+#ifdef __linux__
+       return (long)syscall(SYS_gettid);
+#else
+       return trace.process;
+#endif
+}
+
+
+/* Writes a string as a JSON string literal */
+static void print_json_string(FILE *f, const char *str) {
+       fputc('"', f);
+       for (; *str != '\0'; str++) {
+              if (*str == '"' || *str == '\\')
+                     fprintf(f, "\\%c", *str);
+              else if ((unsigned char)*str < ' ')
+                     fprintf(f, "\\u%04x", (unsigned char)*str);
+              else
+                     fputc(*str, f);
+       }
+       fputc('"', f);
+}
+
+
+/* Starts an event with the fields all of them share; called with the lock held */
+static void begin_event(const char *name, const char *phase, long thread) {
+       fputs(trace.events++ > 0 ? ",\n{\"name\":" : "{\"name\":", trace.file);
+       print_json_string(trace.file, name);
+       fprintf(trace.file, ",\"ph\":\"%s\",\"pid\":%ld,\"tid\":%ld", phase, trace.process, thread);
+}
+
+
+int trace_start(const char *path) {
+       trace.file = fopen(path, "w");
+       if (!trace.file)
+              return FALSE;
+       setvbuf(trace.file, NULL, _IOFBF, TRACE_BUFFER_SIZE);
+
+       trace.origin = monotonic_seconds();
+#ifdef __linux__
+       trace.process = (long)getpid();
+#endif
+       trace.events = 0;
+
+       /* The JSON array format, which viewers accept even without the closing bracket */
+       fputs("[\n", trace.file);
+       begin_event("process_name", "M", thread_id());
+       fputs(",\"args\":{\"name\":\"assembler\"}}", trace.file);
+       begin_event("thread_name", "M", thread_id());
+       fputs(",\"args\":{\"name\":\"main\"}}", trace.file);
+       return TRUE;
+}
+
+
+double trace_clock(void) {
+       if (!trace.file)
+              return 0;
+       return (monotonic_seconds() - trace.origin) * MICROSECONDS;
+}
+
+
+void trace_event(const char *name, const char *category, double start, const struct trace_arg *args, int arg_count) {
+       double end;
+       long thread;
+       int i;
+
+       if (!trace.file)
+              return;
+       end = trace_clock();
+       thread = thread_id();
+
+       pthread_mutex_lock(&trace.lock);
+       begin_event(name, "X", thread);
+       fputs(",\"cat\":", trace.file);
+       print_json_string(trace.file, category);
+       fprintf(trace.file, ",\"ts\":%.3f,\"dur\":%.3f", start, end - start);
+       if (arg_count > 0) {
+              fputs(",\"args\":{", trace.file);
+              for (i = 0; i < arg_count; i++) {
+                     if (i > 0)
+                            fputc(',', trace.file);
+                     print_json_string(trace.file, args[i].name);
+                     fprintf(trace.file, ":%ld", args[i].value);
+              }
+              fputc('}', trace.file);
+       }
+       fputc('}', trace.file);
+       pthread_mutex_unlock(&trace.lock);
+}
+
+
+void trace_counter(const char *name, long value) {
+       double now;
+       long thread;
+
+       if (!trace.file)
+              return;
+       now = trace_clock();
+       thread = thread_id();
+
+       pthread_mutex_lock(&trace.lock);
+       begin_event(name, "C", thread);
+       fprintf(trace.file, ",\"ts\":%.3f,\"args\":{\"value\":%ld}}", now, value);
+       pthread_mutex_unlock(&trace.lock);
+}
+
+
+void trace_flush(void) {
+       if (!trace.file)
+              return;
+
+       pthread_mutex_lock(&trace.lock);
+       fflush(trace.file);
+       pthread_mutex_unlock(&trace.lock);
+}
+
+
+void trace_stop(void) {
+       if (!trace.file)
+              return;
+
+       fputs("\n]\n", trace.file);
+       fclose(trace.file);
+       trace.file = NULL;
+}
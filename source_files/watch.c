@@ -0,0 +1,311 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+#include "../header_files/watch.h"
+#include "../header_files/includes.h"
+#include "../header_files/mem_alloc.h"
+#include "../header_files/parallel.h"
+
+#define TRUE 1
+#define FALSE 0
+#define NO_SIZE (-1L)
+#define READ_BUFFER_SIZE 65536
+#define FNV_OFFSET_BASIS 2166136261UL
+#define FNV_PRIME 16777619UL
+#define HASH_MASK 0xFFFFFFFFUL
+
+
+/* A file an input depends on, the .as file or one it includes, as it was read last */
+struct watched_source {
+       char *path;              /* As the preprocessor opened it */
+       const char *name;        /* File name inside its directory, points into path */
+       int directory;           /* inotify watch of the directory, -1 if it could not be watched */
+       unsigned long hash;      /* FNV-1a hash of the contents */
+       long size;               /* Size of the contents, NO_SIZE if the file could not be read */
+       int touched;             /* TRUE if an event named the file since it was last checked */
+};
+
+/* An input file and the sources of the version of it that was assembled last */
+struct watched_file {
+       const char *base_name;            /* As given on the command line */
+       struct watched_source *sources;   /* sources[0] is base_name.as */
+       int source_count;
+};
+
+
+/* Hashes the contents of a file; size is NO_SIZE if it cannot be read (for example during a rename) */
+static void hash_file(const char *path, unsigned long *hash, long *size) {
+       unsigned char buffer[READ_BUFFER_SIZE];
+       FILE *file = fopen(path, "rb");
+       size_t length;
+       size_t i;
+
+       *hash = FNV_OFFSET_BASIS;
+       *size = NO_SIZE;
+       if (!file)
+              return;
+
+       *size = 0;
+       while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+              for (i = 0; i < length; i++)
+                     *hash = ((*hash ^ buffer[i]) * FNV_PRIME) & HASH_MASK;
+              *size += (long)length;
+       }
+       fclose(file);
+}
+
+
+#ifdef __linux__
+
+static int watch_fd = -1;                     /* The inotify instance */
+static struct watched_file *assembling;       /* Input being assembled, whose sources the preprocessor reports */
+
+
+/* Splits a source path into its directory, which is watched, and the name inside it */
+static int watch_directory(int fd, struct watched_source *source) {
+       char *slash;
+       int watch;
+
+       slash = strrchr(source->path, '/');
+       if (!slash) {
+              source->name = source->path;
+              watch = inotify_add_watch(fd, ".", IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+       }
+       else {
+              source->name = slash + 1;
+              *slash = '\0';
+              watch = inotify_add_watch(fd, slash == source->path ? "/" : source->path,
+                                        IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+              *slash = '/';
+       }
+
+       /* The same directory yields the same watch, so shared directories are watched once */
+       source->directory = watch;
+       return watch >= 0;
+}
+
+
+static void free_sources(struct watched_source *sources, int count) {
+       int i;
+
+       for (i = 0; sources && i < count; i++)
+              mem_free(sources[i].path);
+       mem_free(sources);
+}
+
+
+/*
+ * The include observer: replaces the sources of the input being assembled with the
+ * files its preprocessing read, watches their directories and hashes them. If memory
+ * runs out, the previous sources stay.
+ */
+static void record_sources(const struct include_state *state) {
+       struct watched_source *sources;
+       int i;
+
+       if (!assembling)
+              return;
+
+       sources = mem_calloc(state->file_count, sizeof(struct watched_source));
+       for (i = 0; sources && i < state->file_count; i++) {
+              sources[i].path = mem_malloc(strlen(state->files[i].path) + 1);
+              if (!sources[i].path) {
+                     free_sources(sources, i);
+                     sources = NULL;
+                     break;
+              }
+              strcpy(sources[i].path, state->files[i].path);
+              if (!watch_directory(watch_fd, &sources[i]))
+                     fprintf(stderr, "watch: could not watch %s (%s)\n", sources[i].path, strerror(errno));
+              hash_file(sources[i].path, &sources[i].hash, &sources[i].size);
+       }
+       if (!sources) {
+              fprintf(stderr, "watch: out of memory, the sources of %s.as are not updated\n", assembling->base_name);
+              return;
+       }
+
+       free_sources(assembling->sources, assembling->source_count);
+       assembling->sources = sources;
+       assembling->source_count = state->file_count;
+}
+
+
+/* Assembles an input; the preprocessor reports the files it read to record_sources() */
+static int assemble_watched(struct watched_file *file, watch_assemble assemble) {
+       int error;
+
+       assembling = file;
+       error = assemble(file->base_name);
+       assembling = NULL;
+       return error;
+}
+
+
+/* Reads the pending events and marks the sources they name */
+static int read_events(int fd, struct watched_file *files, int count) {
+       char buffer[READ_BUFFER_SIZE];
+       struct inotify_event event;
+       struct watched_source *source;
+       ssize_t length = read(fd, buffer, sizeof(buffer));
+       ssize_t offset;
+       const char *name;
+       int i, j;
+
+       if (length < 0)
+              return errno == EINTR;
+
+       for (offset = 0; offset + (ssize_t)sizeof(event) <= length; offset += sizeof(event) + event.len) {
+              /* Copied out, since the records in the buffer are not aligned for the struct */
+              memcpy(&event, buffer + offset, sizeof(event));
+              name = buffer + offset + sizeof(event);
+
+              for (i = 0; i < count; i++) {
+                     for (j = 0; j < files[i].source_count; j++) {
+                            source = &files[i].sources[j];
+                            /* After an overflow it is unknown which files changed, so all are checked */
+                            if ((event.mask & IN_Q_OVERFLOW) ||
+                                (event.wd == source->directory && event.len > 0 && strcmp(name, source->name) == 0))
+                                   source->touched = TRUE;
+                     }
+              }
+       }
+       return TRUE;
+}
+
+
+/* Blocks until an event arrives, then keeps collecting until none came for WATCH_DEBOUNCE_MS */
+static int wait_for_changes(int fd, struct watched_file *files, int count) {
+       struct pollfd poll_fd;
+       int timeout = -1;
+       int ready;
+
+       poll_fd.fd = fd;
+       poll_fd.events = POLLIN;
+       for (;;) {
+              ready = poll(&poll_fd, 1, timeout);
+              if (ready < 0) {
+                     if (errno == EINTR)
+                            continue;
+                     return FALSE;
+              }
+              if (ready == 0)
+                     return TRUE;
+              if (!read_events(fd, files, count))
+                     return FALSE;
+              timeout = WATCH_DEBOUNCE_MS;
+       }
+}
+
+
+/* Checks the touched sources of an input; returns TRUE if one of them has new contents */
+static int sources_changed(struct watched_file *file) {
+       struct watched_source *source;
+       unsigned long hash;
+       long size;
+       int changed = FALSE;
+       int i;
+
+       for (i = 0; i < file->source_count; i++) {
+              source = &file->sources[i];
+              if (!source->touched)
+                     continue;
+              source->touched = FALSE;
+
+              /* Saving without changes, or a file that is gone for the moment, needs no work */
+              hash_file(source->path, &hash, &size);
+              if (size == NO_SIZE || (size == source->size && hash == source->hash))
+                     continue;
+              source->hash = hash;
+              source->size = size;
+              changed = TRUE;
+       }
+       return changed;
+}
+
+
+static void free_watched(struct watched_file *watched, int count) {
+       int i;
+
+       for (i = 0; i < count; i++)
+              free_sources(watched[i].sources, watched[i].source_count);
+       mem_free(watched);
+}
+
+
+int watch_files(char const *files[], int count, watch_assemble assemble) {
+       struct watched_file *watched;
+       double started;
+       int error;
+       int i;
+
+       watched = mem_calloc(count, sizeof(struct watched_file));
+       watch_fd = inotify_init();
+       if (!watched || watch_fd < 0) {
+              fprintf(stderr, "watch: could not start watching (%s)\n", strerror(errno));
+              mem_free(watched);
+              return 1;
+       }
+
+       /* Until the preprocessor reports what an input read, its .as file is its only source */
+       for (i = 0; i < count; i++) {
+              watched[i].base_name = files[i];
+              watched[i].sources = mem_calloc(1, sizeof(struct watched_source));
+              if (watched[i].sources)
+                     watched[i].sources[0].path = build_filename(files[i], ".as");
+              if (!watched[i].sources || !watched[i].sources[0].path ||
+                  !watch_directory(watch_fd, &watched[i].sources[0])) {
+                     fprintf(stderr, "watch: could not watch %s.as (%s)\n", files[i], strerror(errno));
+                     free_watched(watched, i + 1);
+                     close(watch_fd);
+                     return 1;
+              }
+              watched[i].source_count = 1;
+              hash_file(watched[i].sources[0].path, &watched[i].sources[0].hash, &watched[i].sources[0].size);
+       }
+
+       includes_set_observer(record_sources);
+       for (i = 0; i < count; i++)
+              assemble_watched(&watched[i], assemble);
+       fprintf(stderr, "watch: waiting for changes to %d file%s, Ctrl-C to stop\n", count, count == 1 ? "" : "s");
+
+       while (wait_for_changes(watch_fd, watched, count)) {
+              for (i = 0; i < count; i++) {
+                     if (!sources_changed(&watched[i]))
+                            continue;
+
+                     started = monotonic_seconds();
+                     error = assemble_watched(&watched[i], assemble);
+                     fprintf(stderr, "watch: %s reassembled in %.1f ms, %s\n", watched[i].sources[0].path,
+                             (monotonic_seconds() - started) * 1000.0, error ? "failed" : "ok");
+              }
+       }
+
+       fprintf(stderr, "watch: stopped (%s)\n", strerror(errno));
+       includes_set_observer(NULL);
+       free_watched(watched, count);
+       close(watch_fd);
+       return 1;
+}
+
+#else
+
+int watch_files(char const *files[], int count, watch_assemble assemble) {
+       int i;
+
+       (void)hash_file;
+       for (i = 0; i < count; i++)
+              assemble(files[i]);
+       fprintf(stderr, "watch: --watch needs inotify, which is only available on Linux\n");
+       return 1;
+}
+
+#endif